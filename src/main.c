@@ -20,7 +20,6 @@
 #include <glib-unix.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
-#include <libnotify/notify.h>
 #include <locale.h>
 #include <signal.h>
 #include <snapd-glib/snapd-glib.h>
@@ -28,6 +27,8 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include "sdi-fdo-notification.h"
+#include "sdi-latency.h"
 #include "sdi-notify.h"
 #include "sdi-progress-dock.h"
 #include "sdi-progress-window.h"
@@ -35,6 +36,7 @@
 #include "sdi-snapd-client-factory.h"
 #include "sdi-snapd-monitor.h"
 #include "sdi-theme-monitor.h"
+#include "sdi-trace.h"
 #include "sdi-user-session-helper.h"
 
 static SnapdClient *client = NULL;
@@ -46,15 +48,25 @@ static SdiProgressWindow *progress_window = NULL;
 static SdiProgressDock *progress_dock = NULL;
 
 static gchar *snapd_socket_path = NULL;
+static gchar *trace_path = NULL;
 
-static GOptionEntry entries[] = {{"snapd-socket-path", 0, G_OPTION_FLAG_NONE,
-                                  G_OPTION_ARG_FILENAME, &snapd_socket_path,
-                                  "Snapd socket path", "PATH"},
-                                 {NULL}};
+static GOptionEntry entries[] = {
+    {"snapd-socket-path", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+     &snapd_socket_path, "Snapd socket path", "PATH"},
+    {"record-trace", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &trace_path,
+     "Record the notices and changes received from snapd into a file", "FILE"},
+    {NULL}};
 
 static void do_startup(GObject *object, gpointer data) {
   sdi_snapd_client_factory_set_custom_path(snapd_socket_path);
 
+  if (trace_path != NULL) {
+    g_autoptr(GError) error = NULL;
+    if (!sdi_trace_start(trace_path, &error)) {
+      g_message("Failed to start the trace: %s", error->message);
+    }
+  }
+
   refresh_monitor = sdi_refresh_monitor_new();
 
   notify_manager = sdi_notify_new(G_APPLICATION(object));
@@ -67,6 +79,9 @@ static void do_startup(GObject *object, gpointer data) {
   g_signal_connect_object(refresh_monitor, "notify-refresh-complete",
                           (GCallback)sdi_notify_refresh_complete,
                           notify_manager, G_CONNECT_SWAPPED);
+  g_signal_connect_object(refresh_monitor, "notify-refresh-complete-multiple",
+                          (GCallback)sdi_notify_refresh_complete_multiple,
+                          notify_manager, G_CONNECT_SWAPPED);
   g_signal_connect_object(notify_manager, "ignore-snap-event",
                           (GCallback)sdi_refresh_monitor_ignore_snap,
                           refresh_monitor, G_CONNECT_SWAPPED);
@@ -80,6 +95,13 @@ static void do_startup(GObject *object, gpointer data) {
   g_signal_connect_object(snapd_monitor, "notice-event",
                           (GCallback)sdi_refresh_monitor_notice,
                           refresh_monitor, G_CONNECT_SWAPPED);
+  /* request only the notices that the #sdi_refresh_monitor manages, to avoid
+   * receiving and parsing the other ones.
+   */
+  sdi_snapd_monitor_add_notice_type(snapd_monitor, "change-update");
+  sdi_snapd_monitor_add_notice_type(snapd_monitor, "refresh-inhibit");
+  sdi_snapd_monitor_add_change_kind(snapd_monitor, "auto-refresh");
+  sdi_snapd_monitor_add_change_kind(snapd_monitor, "refresh-snap");
 
   progress_window = sdi_progress_window_new(G_APPLICATION(object));
   g_signal_connect_object(refresh_monitor, "begin-refresh",
@@ -105,14 +127,27 @@ static void do_startup(GObject *object, gpointer data) {
 static void do_activate(GObject *object, gpointer data) {
   // because, by default, there are no windows, so the application would quit
   g_application_hold(G_APPLICATION(object));
-  client = sdi_snapd_client_factory_new_snapd_client();
+  client = sdi_snapd_client_factory_get_client();
 
   theme_monitor = sdi_theme_monitor_new(client);
   sdi_theme_monitor_start(theme_monitor);
 }
 
+/**
+ * Writes into the log the histograms with the time elapsed between the
+ * notices from snapd and the actions done because of them. It is done only
+ * when requested with SIGUSR1.
+ */
+static gboolean show_latency(gpointer data) {
+  g_autofree gchar *report = sdi_latency_report();
+  if (report != NULL) {
+    g_message("Notice latency:\n%s", report);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
 static void do_shutdown(GObject *object, gpointer data) {
-  notify_uninit();
+  sdi_fdo_notification_shutdown();
   g_clear_object(&client);
   g_clear_object(&theme_monitor);
   g_clear_object(&refresh_monitor);
@@ -120,6 +155,8 @@ static void do_shutdown(GObject *object, gpointer data) {
   g_clear_object(&progress_dock);
   g_clear_object(&notify_manager);
   g_clear_object(&snapd_monitor);
+  sdi_trace_stop();
+  sdi_latency_shutdown();
 }
 
 static int global_retval = 0;
@@ -183,6 +220,7 @@ int main(int argc, char **argv) {
 
   g_unix_signal_add(SIGINT, (GSourceFunc)close_app, app);
   g_unix_signal_add(SIGTERM, (GSourceFunc)close_app, app);
+  g_unix_signal_add(SIGUSR1, show_latency, NULL);
 
   g_application_run(G_APPLICATION(app), argc, argv);
 
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-change-model.h"
+
+/**
+ * This module converts a #SnapdChange into a compact structure, with the
+ * status and kind strings parsed into enums, the tasks stored in a single
+ * array, and the affected snaps stored as indexes into a table with the
+ * snap names. This allows to process the changes without comparing the same
+ * strings over and over.
+ *
+ * The model keeps a reference to the #SnapdChange and points to its strings,
+ * instead of copying them, so building one for each check of a change
+ * doesn't allocate memory for each task.
+ */
+
+static const struct {
+  const gchar *name;
+  SdiChangeStatus status;
+} status_names[] = {
+    {"Do", SDI_CHANGE_STATUS_DO},
+    {"Doing", SDI_CHANGE_STATUS_DOING},
+    {"Done", SDI_CHANGE_STATUS_DONE},
+    {"Undo", SDI_CHANGE_STATUS_UNDO},
+    {"Undoing", SDI_CHANGE_STATUS_UNDOING},
+    {"Undone", SDI_CHANGE_STATUS_UNDONE},
+    {"Abort", SDI_CHANGE_STATUS_ABORT},
+    {"Error", SDI_CHANGE_STATUS_ERROR},
+    {"Hold", SDI_CHANGE_STATUS_HOLD},
+    {"Wait", SDI_CHANGE_STATUS_WAIT},
+};
+
+static GQuark status_quarks[G_N_ELEMENTS(status_names)];
+
+static void init_status_quarks(void) {
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)) {
+    for (guint i = 0; i < G_N_ELEMENTS(status_names); i++) {
+      status_quarks[i] = g_quark_from_static_string(status_names[i].name);
+    }
+    g_once_init_leave(&initialized, 1);
+  }
+}
+
+/**
+ * Converts a status string into its enum value. The status strings are
+ * interned, so this is just a few integer comparisons.
+ */
+SdiChangeStatus sdi_change_status_from_string(const gchar *status) {
+  init_status_quarks();
+  GQuark quark = g_quark_try_string(status);
+  if (quark == 0) {
+    return SDI_CHANGE_STATUS_UNKNOWN;
+  }
+  for (guint i = 0; i < G_N_ELEMENTS(status_quarks); i++) {
+    if (status_quarks[i] == quark) {
+      return status_names[i].status;
+    }
+  }
+  return SDI_CHANGE_STATUS_UNKNOWN;
+}
+
+SdiChangeKind sdi_change_kind_from_string(const gchar *kind) {
+  if (g_strcmp0(kind, "auto-refresh") == 0) {
+    return SDI_CHANGE_KIND_AUTO_REFRESH;
+  }
+  if (g_strcmp0(kind, "refresh-snap") == 0) {
+    return SDI_CHANGE_KIND_REFRESH_SNAP;
+  }
+  return SDI_CHANGE_KIND_OTHER;
+}
+
+/**
+ * Returns TRUE if a change with this status is being done, or has been done.
+ */
+gboolean sdi_change_status_is_working(SdiChangeStatus status) {
+  return (status == SDI_CHANGE_STATUS_DO) ||
+         (status == SDI_CHANGE_STATUS_DOING) ||
+         (status == SDI_CHANGE_STATUS_DONE);
+}
+
+/**
+ * Returns TRUE if a change with this status has been, or is being, cancelled.
+ */
+gboolean sdi_change_status_is_cancelled(SdiChangeStatus status) {
+  return (status == SDI_CHANGE_STATUS_UNDOING) ||
+         (status == SDI_CHANGE_STATUS_UNDONE) ||
+         (status == SDI_CHANGE_STATUS_UNDO) ||
+         (status == SDI_CHANGE_STATUS_ERROR) ||
+         (status == SDI_CHANGE_STATUS_ABORT);
+}
+
+/**
+ * Returns TRUE if a task with this status won't progress anymore.
+ */
+gboolean sdi_change_status_is_task_done(SdiChangeStatus status) {
+  return (status == SDI_CHANGE_STATUS_DONE) ||
+         (status == SDI_CHANGE_STATUS_ABORT) ||
+         (status == SDI_CHANGE_STATUS_ERROR) ||
+         (status == SDI_CHANGE_STATUS_HOLD) ||
+         (status == SDI_CHANGE_STATUS_WAIT) ||
+         (status == SDI_CHANGE_STATUS_UNDONE);
+}
+
+static guint add_snap_name(SdiChange *self, const gchar *snap_name) {
+  guint index =
+      GPOINTER_TO_UINT(g_hash_table_lookup(self->snap_index, snap_name));
+  if (index != 0) {
+    return index - 1;
+  }
+  g_ptr_array_add(self->snap_names, (gpointer)snap_name);
+  index = self->snap_names->len;
+  g_hash_table_insert(self->snap_index, (gpointer)snap_name,
+                      GUINT_TO_POINTER(index));
+  return index - 1;
+}
+
+SdiChange *sdi_change_new(SnapdChange *change) {
+  SdiChange *self = g_malloc0(sizeof(SdiChange));
+  GPtrArray *tasks = snapd_change_get_tasks(change);
+
+  self->change = g_object_ref(change);
+  self->id = snapd_change_get_id(change);
+  self->kind = sdi_change_kind_from_string(snapd_change_get_kind(change));
+  self->status = sdi_change_status_from_string(snapd_change_get_status(change));
+  self->tasks = g_array_sized_new(FALSE, TRUE, sizeof(SdiTask), tasks->len);
+  self->snap_names = g_ptr_array_new();
+  self->task_snaps = g_array_new(FALSE, FALSE, sizeof(guint));
+  self->refresh_snaps = g_array_new(FALSE, FALSE, sizeof(guint));
+  self->snap_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+  for (guint i = 0; i < tasks->len; i++) {
+    SnapdTask *task = tasks->pdata[i];
+    SdiTask new_task = {
+        .id = snapd_task_get_id(task),
+        .summary = snapd_task_get_summary(task),
+        .status = sdi_change_status_from_string(snapd_task_get_status(task)),
+        .first_snap = self->task_snaps->len,
+        .n_snaps = 0,
+    };
+    SnapdTaskData *task_data = snapd_task_get_data(task);
+    GStrv affected_snaps = (task_data == NULL)
+                               ? NULL
+                               : snapd_task_data_get_affected_snaps(task_data);
+    for (gchar **p = affected_snaps; (p != NULL) && (*p != NULL); p++) {
+      guint index = add_snap_name(self, *p);
+      g_array_append_val(self->task_snaps, index);
+      new_task.n_snaps++;
+    }
+    g_array_append_val(self->tasks, new_task);
+  }
+
+  SnapdChangeData *change_data = snapd_change_get_data(change);
+  if ((change_data != NULL) && SNAPD_IS_AUTOREFRESH_CHANGE_DATA(change_data)) {
+    GStrv snap_names = snapd_autorefresh_change_data_get_snap_names(
+        SNAPD_AUTOREFRESH_CHANGE_DATA(change_data));
+    for (gchar **p = snap_names; (p != NULL) && (*p != NULL); p++) {
+      guint index = add_snap_name(self, *p);
+      g_array_append_val(self->refresh_snaps, index);
+    }
+  }
+  return self;
+}
+
+void sdi_change_free(SdiChange *self) {
+  g_array_unref(self->tasks);
+  g_hash_table_unref(self->snap_index);
+  g_clear_pointer(&self->task_index, g_hash_table_unref);
+  g_ptr_array_unref(self->snap_names);
+  g_array_unref(self->task_snaps);
+  g_array_unref(self->refresh_snaps);
+  g_object_unref(self->change);
+  g_free(self);
+}
+
+SdiTask *sdi_change_get_task(SdiChange *self, guint index) {
+  return &g_array_index(self->tasks, SdiTask, index);
+}
+
+/**
+ * Returns the task with the specified ID, or NULL if there is none. Since
+ * snapd only appends tasks to a change, it is first looked for at
+ * `position`, which is its position in a newer version of the change.
+ */
+SdiTask *sdi_change_find_task(SdiChange *self, const gchar *id,
+                              guint position) {
+  if (position < self->tasks->len) {
+    SdiTask *task = sdi_change_get_task(self, position);
+    if (g_str_equal(task->id, id)) {
+      return task;
+    }
+  }
+  if (self->task_index == NULL) {
+    self->task_index = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < self->tasks->len; i++) {
+      g_hash_table_insert(self->task_index,
+                          (gpointer)sdi_change_get_task(self, i)->id,
+                          GUINT_TO_POINTER(i + 1));
+    }
+  }
+  guint index = GPOINTER_TO_UINT(g_hash_table_lookup(self->task_index, id));
+  return (index == 0) ? NULL : sdi_change_get_task(self, index - 1);
+}
+
+/**
+ * Returns the name of the n-th snap affected by the task.
+ */
+const gchar *sdi_change_get_task_snap(SdiChange *self, SdiTask *task,
+                                      guint index) {
+  guint snap = g_array_index(self->task_snaps, guint, task->first_snap + index);
+  return self->snap_names->pdata[snap];
+}
+
+/**
+ * Returns the name of the n-th snap listed in the auto-refresh data.
+ */
+const gchar *sdi_change_get_refresh_snap(SdiChange *self, guint index) {
+  guint snap = g_array_index(self->refresh_snaps, guint, index);
+  return self->snap_names->pdata[snap];
+}
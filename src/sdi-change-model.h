@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <snapd-glib/snapd-glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  SDI_CHANGE_STATUS_UNKNOWN,
+  SDI_CHANGE_STATUS_DO,
+  SDI_CHANGE_STATUS_DOING,
+  SDI_CHANGE_STATUS_DONE,
+  SDI_CHANGE_STATUS_UNDO,
+  SDI_CHANGE_STATUS_UNDOING,
+  SDI_CHANGE_STATUS_UNDONE,
+  SDI_CHANGE_STATUS_ABORT,
+  SDI_CHANGE_STATUS_ERROR,
+  SDI_CHANGE_STATUS_HOLD,
+  SDI_CHANGE_STATUS_WAIT,
+} SdiChangeStatus;
+
+typedef enum {
+  SDI_CHANGE_KIND_OTHER,
+  SDI_CHANGE_KIND_AUTO_REFRESH,
+  SDI_CHANGE_KIND_REFRESH_SNAP,
+} SdiChangeKind;
+
+// the strings are owned by the #SnapdChange
+typedef struct {
+  const gchar *id;
+  const gchar *summary;
+  SdiChangeStatus status;
+  // range of this task's affected snaps in the `task_snaps` array
+  guint first_snap;
+  guint n_snaps;
+} SdiTask;
+
+typedef struct {
+  // the change this model was built from, which owns all the strings
+  SnapdChange *change;
+  const gchar *id;
+  SdiChangeKind kind;
+  SdiChangeStatus status;
+  // array of SdiTask structures
+  GArray *tasks;
+  // table with the names of all the snaps referenced by the change
+  GPtrArray *snap_names;
+  // indexes in `snap_names` of the snaps affected by each task
+  GArray *task_snaps;
+  // indexes in `snap_names` of the snaps listed in the auto-refresh data
+  GArray *refresh_snaps;
+  // the key is a snap name; the value is its index in `snap_names` plus one
+  GHashTable *snap_index;
+  /* the key is a task ID; the value is its index in `tasks` plus one. It is
+   * built only when a task isn't found at its expected position.
+   */
+  GHashTable *task_index;
+} SdiChange;
+
+SdiChangeStatus sdi_change_status_from_string(const gchar *status);
+
+SdiChangeKind sdi_change_kind_from_string(const gchar *kind);
+
+gboolean sdi_change_status_is_working(SdiChangeStatus status);
+
+gboolean sdi_change_status_is_cancelled(SdiChangeStatus status);
+
+gboolean sdi_change_status_is_task_done(SdiChangeStatus status);
+
+SdiChange *sdi_change_new(SnapdChange *change);
+
+void sdi_change_free(SdiChange *change);
+
+SdiTask *sdi_change_get_task(SdiChange *change, guint index);
+
+SdiTask *sdi_change_find_task(SdiChange *change, const gchar *id,
+                              guint position);
+
+const gchar *sdi_change_get_task_snap(SdiChange *change, SdiTask *task,
+                                      guint index);
+
+const gchar *sdi_change_get_refresh_snap(SdiChange *change, guint index);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(SdiChange, sdi_change_free);
+
+G_END_DECLS
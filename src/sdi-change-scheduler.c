@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-change-scheduler.h"
+
+/**
+ * This class keeps the list of Changes that are currently being done by
+ * snapd, and periodically requests their status to allow to update the
+ * progress bars.
+ *
+ * Instead of having one timer and one request per Change, it has a single
+ * timer that wakes up when the next Change must be checked, and asks snapd
+ * for all the in-progress Changes in a single request, emitting a
+ * `change-update` signal for each tracked one that was due. Tracked Changes
+ * that aren't in progress anymore are requested individually, to get their
+ * final status, and then removed from the list.
+ *
+ * The interval between checks is adapted for each Change: the owner must
+ * call `sdi_change_scheduler_report_progress()` after processing each
+ * `change-update` signal, and the interval will be shortened when there is
+ * progress, and enlarged when there isn't, always between the
+ * `min-interval` and `max-interval` values. The timer is armed again only
+ * once per check, after all the signals have been processed.
+ */
+
+// initial time in ms between two checks of an in-progress change.
+#define CHANGE_REFRESH_PERIOD 500
+
+enum { PROP_MIN_INTERVAL = 1, PROP_MAX_INTERVAL, PROP_LAST };
+
+struct _SdiChangeScheduler {
+  GObject parent_instance;
+
+  SnapdClient *client;
+  // the key is the change ID; the value is a ChangeSchedule structure.
+  GHashTable *changes;
+  guint timer_id;
+  // TRUE from the request of the in-progress changes until they are processed
+  gboolean polling;
+  guint min_interval;
+  guint max_interval;
+};
+
+G_DEFINE_TYPE(SdiChangeScheduler, sdi_change_scheduler, G_TYPE_OBJECT)
+
+typedef struct {
+  // monotonic time, in microseconds, when the change must be checked again
+  gint64 next_check;
+  // current interval between checks, in milliseconds
+  guint interval;
+} ChangeSchedule;
+
+static guint clamp_interval(SdiChangeScheduler *self, guint interval) {
+  return CLAMP(interval, self->min_interval,
+               MAX(self->min_interval, self->max_interval));
+}
+
+static void set_next_check(ChangeSchedule *schedule, gint64 now) {
+  schedule->next_check = now + ((gint64)schedule->interval) * 1000;
+}
+
+static ChangeSchedule *change_schedule_new(SdiChangeScheduler *self) {
+  ChangeSchedule *schedule = g_malloc0(sizeof(ChangeSchedule));
+  schedule->interval = clamp_interval(self, CHANGE_REFRESH_PERIOD);
+  set_next_check(schedule, g_get_monotonic_time());
+  return schedule;
+}
+
+/* A change is considered due if it must be checked before half the
+ * minimum interval, to group in the same request those that are close.
+ */
+static gboolean change_is_due(SdiChangeScheduler *self,
+                              ChangeSchedule *schedule, gint64 now) {
+  return schedule->next_check <= now + ((gint64)self->min_interval) * 500;
+}
+
+static void schedule_tick(SdiChangeScheduler *self);
+
+static void final_change_cb(SnapdClient *source, GAsyncResult *res,
+                            gpointer p) {
+  g_autoptr(SdiChangeScheduler) self = p;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(SnapdChange) change =
+      snapd_client_get_change_finish(source, res, &error);
+
+  if (error != NULL) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_debug("Error in final_change_cb: %s\n", error->message);
+    }
+    return;
+  }
+  if (change != NULL) {
+    g_signal_emit_by_name(self, "change-update", change);
+  }
+}
+
+static void in_progress_changes_cb(SnapdClient *source, GAsyncResult *res,
+                                   gpointer p) {
+  g_autoptr(SdiChangeScheduler) self = p;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) changes =
+      snapd_client_get_changes_finish(source, res, &error);
+
+  if (error != NULL) {
+    self->polling = FALSE;
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      return;
+    }
+    g_debug("Error in in_progress_changes_cb: %s\n", error->message);
+    schedule_tick(self);
+    return;
+  }
+
+  /* The listeners can add or remove changes while processing the signal, so
+   * work over a copy of the tracked IDs.
+   */
+  g_autoptr(GHashTable) not_in_progress =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GHashTableIter iter;
+  gpointer change_id;
+  g_hash_table_iter_init(&iter, self->changes);
+  while (g_hash_table_iter_next(&iter, &change_id, NULL)) {
+    g_hash_table_add(not_in_progress, g_strdup(change_id));
+  }
+
+  gint64 now = g_get_monotonic_time();
+  for (guint i = 0; i < changes->len; i++) {
+    SnapdChange *change = changes->pdata[i];
+    const gchar *id = snapd_change_get_id(change);
+    if (!g_hash_table_remove(not_in_progress, id)) {
+      continue;
+    }
+    ChangeSchedule *schedule = g_hash_table_lookup(self->changes, id);
+    if ((schedule == NULL) || !change_is_due(self, schedule, now)) {
+      continue;
+    }
+    g_signal_emit_by_name(self, "change-update", change);
+    // the listeners may have updated the interval, or removed the change
+    schedule = g_hash_table_lookup(self->changes, id);
+    if (schedule != NULL) {
+      set_next_check(schedule, now);
+    }
+  }
+
+  /* Any tracked change that isn't in progress anymore has finished since the
+   * last check, so ask for it once to get its final status.
+   */
+  g_hash_table_iter_init(&iter, not_in_progress);
+  while (g_hash_table_iter_next(&iter, &change_id, NULL)) {
+    if (!g_hash_table_remove(self->changes, change_id)) {
+      continue;
+    }
+    snapd_client_get_change_async(self->client, change_id, NULL,
+                                  (GAsyncReadyCallback)final_change_cb,
+                                  g_object_ref(self));
+  }
+  self->polling = FALSE;
+  schedule_tick(self);
+}
+
+static void tick(SdiChangeScheduler *self) {
+  self->timer_id = 0;
+  if (g_hash_table_size(self->changes) == 0) {
+    return;
+  }
+  self->polling = TRUE;
+  snapd_client_get_changes_async(
+      self->client, SNAPD_CHANGE_FILTER_IN_PROGRESS, NULL, NULL,
+      (GAsyncReadyCallback)in_progress_changes_cb, g_object_ref(self));
+}
+
+static void schedule_tick(SdiChangeScheduler *self) {
+  /* If there is already a request in progress, the timer will be armed
+   * again when it finishes.
+   */
+  if (self->polling) {
+    return;
+  }
+  g_clear_handle_id(&self->timer_id, g_source_remove);
+
+  gint64 next_check = G_MAXINT64;
+  GHashTableIter iter;
+  ChangeSchedule *schedule;
+  g_hash_table_iter_init(&iter, self->changes);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&schedule)) {
+    next_check = MIN(next_check, schedule->next_check);
+  }
+  if (next_check == G_MAXINT64) {
+    return;
+  }
+  gint64 delay = (next_check - g_get_monotonic_time()) / 1000;
+  self->timer_id =
+      g_timeout_add_once(MAX(delay, 0), (GSourceOnceFunc)tick, self);
+}
+
+/**
+ * Adds a change to the list of changes being checked periodically. Adding
+ * a change that is already in the list does nothing.
+ */
+void sdi_change_scheduler_add_change(SdiChangeScheduler *self,
+                                     const gchar *change_id) {
+  g_return_if_fail(SDI_IS_CHANGE_SCHEDULER(self));
+  g_return_if_fail(change_id != NULL);
+
+  if (g_hash_table_contains(self->changes, change_id)) {
+    return;
+  }
+  g_hash_table_insert(self->changes, g_strdup(change_id),
+                      change_schedule_new(self));
+  schedule_tick(self);
+}
+
+/**
+ * Must be called after processing a `change-update` signal, to inform
+ * whether the change did progress since the previous check. The interval
+ * for the next check of that change is shortened if it did, and enlarged
+ * if it didn't. The time of the next check is set from it when the current
+ * one finishes, so reports about Changes received by other means don't
+ * delay it.
+ */
+void sdi_change_scheduler_report_progress(SdiChangeScheduler *self,
+                                          const gchar *change_id,
+                                          gboolean progressed) {
+  g_return_if_fail(SDI_IS_CHANGE_SCHEDULER(self));
+  g_return_if_fail(change_id != NULL);
+
+  ChangeSchedule *schedule = g_hash_table_lookup(self->changes, change_id);
+  if (schedule == NULL) {
+    return;
+  }
+  if (progressed) {
+    schedule->interval = clamp_interval(self, schedule->interval / 2);
+  } else {
+    schedule->interval = clamp_interval(self, schedule->interval * 3 / 2);
+  }
+}
+
+void sdi_change_scheduler_remove_change(SdiChangeScheduler *self,
+                                        const gchar *change_id) {
+  g_return_if_fail(SDI_IS_CHANGE_SCHEDULER(self));
+  g_return_if_fail(change_id != NULL);
+
+  g_hash_table_remove(self->changes, change_id);
+  if (g_hash_table_size(self->changes) == 0) {
+    g_clear_handle_id(&self->timer_id, g_source_remove);
+  }
+}
+
+gboolean sdi_change_scheduler_contains(SdiChangeScheduler *self,
+                                       const gchar *change_id) {
+  g_return_val_if_fail(SDI_IS_CHANGE_SCHEDULER(self), FALSE);
+  return g_hash_table_contains(self->changes, change_id);
+}
+
+static void sdi_change_scheduler_set_property(GObject *object, guint prop_id,
+                                              const GValue *value,
+                                              GParamSpec *pspec) {
+  SdiChangeScheduler *self = SDI_CHANGE_SCHEDULER(object);
+
+  switch (prop_id) {
+  case PROP_MIN_INTERVAL:
+    self->min_interval = g_value_get_uint(value);
+    break;
+  case PROP_MAX_INTERVAL:
+    self->max_interval = g_value_get_uint(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void sdi_change_scheduler_get_property(GObject *object, guint prop_id,
+                                              GValue *value,
+                                              GParamSpec *pspec) {
+  SdiChangeScheduler *self = SDI_CHANGE_SCHEDULER(object);
+
+  switch (prop_id) {
+  case PROP_MIN_INTERVAL:
+    g_value_set_uint(value, self->min_interval);
+    break;
+  case PROP_MAX_INTERVAL:
+    g_value_set_uint(value, self->max_interval);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void sdi_change_scheduler_dispose(GObject *object) {
+  SdiChangeScheduler *self = SDI_CHANGE_SCHEDULER(object);
+
+  g_clear_handle_id(&self->timer_id, g_source_remove);
+  g_clear_pointer(&self->changes, g_hash_table_unref);
+  g_clear_object(&self->client);
+
+  G_OBJECT_CLASS(sdi_change_scheduler_parent_class)->dispose(object);
+}
+
+static void sdi_change_scheduler_init(SdiChangeScheduler *self) {
+  self->changes =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->min_interval = SDI_CHANGE_SCHEDULER_DEFAULT_MIN_INTERVAL;
+  self->max_interval = SDI_CHANGE_SCHEDULER_DEFAULT_MAX_INTERVAL;
+}
+
+static void sdi_change_scheduler_class_init(SdiChangeSchedulerClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->set_property = sdi_change_scheduler_set_property;
+  gobject_class->get_property = sdi_change_scheduler_get_property;
+  gobject_class->dispose = sdi_change_scheduler_dispose;
+
+  g_object_class_install_property(
+      gobject_class, PROP_MIN_INTERVAL,
+      g_param_spec_uint("min-interval", "min-interval",
+                        "Minimum time in ms between checks of a change", 1,
+                        G_MAXUINT, SDI_CHANGE_SCHEDULER_DEFAULT_MIN_INTERVAL,
+                        G_PARAM_READWRITE));
+  g_object_class_install_property(
+      gobject_class, PROP_MAX_INTERVAL,
+      g_param_spec_uint("max-interval", "max-interval",
+                        "Maximum time in ms between checks of a change", 1,
+                        G_MAXUINT, SDI_CHANGE_SCHEDULER_DEFAULT_MAX_INTERVAL,
+                        G_PARAM_READWRITE));
+
+  g_signal_new("change-update", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
+               NULL, NULL, NULL, G_TYPE_NONE, 1, SNAPD_TYPE_CHANGE);
+}
+
+SdiChangeScheduler *sdi_change_scheduler_new(SnapdClient *client) {
+  SdiChangeScheduler *self = g_object_new(SDI_TYPE_CHANGE_SCHEDULER, NULL);
+  self->client = g_object_ref(client);
+  return self;
+}
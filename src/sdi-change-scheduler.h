@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <snapd-glib/snapd-glib.h>
+
+G_BEGIN_DECLS
+
+// default bounds, in ms, of the interval between checks of a change.
+#define SDI_CHANGE_SCHEDULER_DEFAULT_MIN_INTERVAL 250
+#define SDI_CHANGE_SCHEDULER_DEFAULT_MAX_INTERVAL 2000
+
+#define SDI_TYPE_CHANGE_SCHEDULER sdi_change_scheduler_get_type()
+
+G_DECLARE_FINAL_TYPE(SdiChangeScheduler, sdi_change_scheduler, SDI,
+                     CHANGE_SCHEDULER, GObject)
+
+SdiChangeScheduler *sdi_change_scheduler_new(SnapdClient *client);
+
+void sdi_change_scheduler_add_change(SdiChangeScheduler *self,
+                                     const gchar *change_id);
+
+void sdi_change_scheduler_remove_change(SdiChangeScheduler *self,
+                                        const gchar *change_id);
+
+void sdi_change_scheduler_report_progress(SdiChangeScheduler *self,
+                                          const gchar *change_id,
+                                          gboolean progressed);
+
+gboolean sdi_change_scheduler_contains(SdiChangeScheduler *self,
+                                       const gchar *change_id);
+
+G_END_DECLS
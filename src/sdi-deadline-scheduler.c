@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-deadline-scheduler.h"
+
+/**
+ * This class emits a `deadline` signal, with the key of a deadline, when
+ * the wall clock reaches it. Each key has, at most, one deadline; setting
+ * it again replaces the previous one.
+ *
+ * The deadlines are kept in a binary min-heap, so adding, replacing or
+ * removing one costs O(log n), and there is a single timer, set for the
+ * earliest deadline, which is only re-armed when that deadline changes.
+ *
+ * The deadlines are in wall clock time, but the timers use the monotonic
+ * clock, which doesn't advance while the computer is suspended. To avoid
+ * firing too late after a suspension, or after a change of the clock, the
+ * timer never waits more than MAX_TIMER_DELAY.
+ */
+
+// maximum time, in seconds, between two checks of the deadlines
+#define MAX_TIMER_DELAY 3600
+
+struct _SdiDeadlineScheduler {
+  GObject parent_instance;
+
+  // the heap; each element is a Deadline structure
+  GPtrArray *heap;
+  // the key is the deadline key; the value is its Deadline structure
+  GHashTable *deadlines;
+  guint timer_id;
+};
+
+G_DEFINE_TYPE(SdiDeadlineScheduler, sdi_deadline_scheduler, G_TYPE_OBJECT)
+
+typedef struct {
+  gchar *key;
+  // real time, in microseconds, when the signal must be emitted
+  gint64 time;
+  // position in the heap
+  guint index;
+} Deadline;
+
+static void deadline_free(Deadline *deadline) {
+  g_free(deadline->key);
+  g_free(deadline);
+}
+
+static void swap(SdiDeadlineScheduler *self, guint a, guint b) {
+  Deadline *deadline_a = self->heap->pdata[a];
+  Deadline *deadline_b = self->heap->pdata[b];
+  self->heap->pdata[a] = deadline_b;
+  self->heap->pdata[b] = deadline_a;
+  deadline_a->index = b;
+  deadline_b->index = a;
+}
+
+static Deadline *get_first(SdiDeadlineScheduler *self) {
+  return (self->heap->len == 0) ? NULL : self->heap->pdata[0];
+}
+
+static gint64 get_time(SdiDeadlineScheduler *self, guint index) {
+  return ((Deadline *)self->heap->pdata[index])->time;
+}
+
+static void sift_up(SdiDeadlineScheduler *self, guint index) {
+  while (index > 0) {
+    guint parent = (index - 1) / 2;
+    if (get_time(self, parent) <= get_time(self, index)) {
+      return;
+    }
+    swap(self, parent, index);
+    index = parent;
+  }
+}
+
+static void sift_down(SdiDeadlineScheduler *self, guint index) {
+  while (TRUE) {
+    guint smallest = index;
+    guint left = 2 * index + 1;
+    guint right = left + 1;
+    if ((left < self->heap->len) &&
+        (get_time(self, left) < get_time(self, smallest))) {
+      smallest = left;
+    }
+    if ((right < self->heap->len) &&
+        (get_time(self, right) < get_time(self, smallest))) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+    swap(self, index, smallest);
+    index = smallest;
+  }
+}
+
+/**
+ * Removes a deadline from the heap, but not from the table.
+ */
+static void heap_remove(SdiDeadlineScheduler *self, Deadline *deadline) {
+  guint index = deadline->index;
+  guint last = self->heap->len - 1;
+  if (index != last) {
+    swap(self, index, last);
+  }
+  g_ptr_array_remove_index(self->heap, last);
+  if (index < self->heap->len) {
+    sift_down(self, index);
+    sift_up(self, index);
+  }
+}
+
+static void schedule_timer(SdiDeadlineScheduler *self);
+
+static void timer_cb(SdiDeadlineScheduler *self) {
+  self->timer_id = 0;
+
+  // the handlers can modify the heap, so get all the due keys first
+  g_autoptr(GPtrArray) keys = g_ptr_array_new_with_free_func(g_free);
+  gint64 now = g_get_real_time();
+  while ((self->heap->len > 0) && (get_time(self, 0) <= now)) {
+    Deadline *deadline = self->heap->pdata[0];
+    heap_remove(self, deadline);
+    g_ptr_array_add(keys, g_strdup(deadline->key));
+    g_hash_table_remove(self->deadlines, deadline->key);
+  }
+  g_object_ref(self);
+  for (guint i = 0; i < keys->len; i++) {
+    g_signal_emit_by_name(self, "deadline", keys->pdata[i]);
+  }
+  schedule_timer(self);
+  g_object_unref(self);
+}
+
+static void schedule_timer(SdiDeadlineScheduler *self) {
+  g_clear_handle_id(&self->timer_id, g_source_remove);
+  if (self->heap->len == 0) {
+    return;
+  }
+  // round up, to never wake before the deadline
+  gint64 delay = (get_time(self, 0) - g_get_real_time() + 999) / 1000;
+  delay = CLAMP(delay, 0, MAX_TIMER_DELAY * 1000);
+  self->timer_id = g_timeout_add_once(delay, (GSourceOnceFunc)timer_cb, self);
+#ifdef DEBUG_TESTS
+  g_signal_emit_by_name(self, "timer-scheduled", (guint)delay);
+#endif
+}
+
+/**
+ * Sets the deadline, in microseconds of real time, for a key, replacing the
+ * previous one. If it has already passed, the signal is emitted as soon as
+ * possible.
+ */
+void sdi_deadline_scheduler_set(SdiDeadlineScheduler *self, const gchar *key,
+                                gint64 time) {
+  g_return_if_fail(SDI_IS_DEADLINE_SCHEDULER(self));
+  g_return_if_fail(key != NULL);
+
+  Deadline *first = get_first(self);
+  gint64 first_time = (first == NULL) ? 0 : first->time;
+  Deadline *deadline = g_hash_table_lookup(self->deadlines, key);
+  if (deadline == NULL) {
+    deadline = g_malloc0(sizeof(Deadline));
+    deadline->key = g_strdup(key);
+    deadline->time = time;
+    deadline->index = self->heap->len;
+    g_ptr_array_add(self->heap, deadline);
+    g_hash_table_insert(self->deadlines, deadline->key, deadline);
+    sift_up(self, deadline->index);
+  } else if (deadline->time != time) {
+    deadline->time = time;
+    sift_down(self, deadline->index);
+    sift_up(self, deadline->index);
+  } else {
+    return;
+  }
+  // the timer only depends on the earliest deadline
+  if ((get_first(self) != first) || (first->time != first_time)) {
+    schedule_timer(self);
+  }
+}
+
+void sdi_deadline_scheduler_remove(SdiDeadlineScheduler *self,
+                                   const gchar *key) {
+  g_return_if_fail(SDI_IS_DEADLINE_SCHEDULER(self));
+
+  Deadline *deadline = g_hash_table_lookup(self->deadlines, key);
+  if (deadline == NULL) {
+    return;
+  }
+  gboolean was_first = deadline->index == 0;
+  heap_remove(self, deadline);
+  g_hash_table_remove(self->deadlines, key);
+  if (was_first) {
+    schedule_timer(self);
+  }
+}
+
+static void sdi_deadline_scheduler_dispose(GObject *object) {
+  SdiDeadlineScheduler *self = SDI_DEADLINE_SCHEDULER(object);
+
+  g_clear_handle_id(&self->timer_id, g_source_remove);
+  g_clear_pointer(&self->heap, g_ptr_array_unref);
+  g_clear_pointer(&self->deadlines, g_hash_table_unref);
+
+  G_OBJECT_CLASS(sdi_deadline_scheduler_parent_class)->dispose(object);
+}
+
+static void sdi_deadline_scheduler_init(SdiDeadlineScheduler *self) {
+  // the table owns the Deadline structures; the heap only points to them
+  self->heap = g_ptr_array_new();
+  self->deadlines = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                          (GDestroyNotify)deadline_free);
+}
+
+static void
+sdi_deadline_scheduler_class_init(SdiDeadlineSchedulerClass *klass) {
+  G_OBJECT_CLASS(klass)->dispose = sdi_deadline_scheduler_dispose;
+
+  g_signal_new("deadline", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
+               NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_STRING);
+#ifdef DEBUG_TESTS
+  g_signal_new("timer-scheduled", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+               0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_UINT);
+#endif
+}
+
+SdiDeadlineScheduler *sdi_deadline_scheduler_new(void) {
+  return g_object_new(SDI_TYPE_DEADLINE_SCHEDULER, NULL);
+}
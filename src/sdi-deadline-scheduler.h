@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define SDI_TYPE_DEADLINE_SCHEDULER sdi_deadline_scheduler_get_type()
+
+G_DECLARE_FINAL_TYPE(SdiDeadlineScheduler, sdi_deadline_scheduler, SDI,
+                     DEADLINE_SCHEDULER, GObject)
+
+SdiDeadlineScheduler *sdi_deadline_scheduler_new(void);
+
+void sdi_deadline_scheduler_set(SdiDeadlineScheduler *self, const gchar *key,
+                                gint64 time);
+
+void sdi_deadline_scheduler_remove(SdiDeadlineScheduler *self,
+                                   const gchar *key);
+
+G_END_DECLS
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-desktop-file-index.h"
+#include <string.h>
+
+/**
+ * This class keeps an in-memory index of the .desktop files of the snaps,
+ * grouped by snap name, to avoid scanning the whole folder every time the
+ * desktop files of a snap are needed. The folder is read once when the
+ * object is created, and then a #GFileMonitor keeps the index up to date.
+ *
+ * The .desktop files of the snaps are named `SNAPNAME_APPNAME.desktop`.
+ * Since a snap name can't contain an underscore, everything before the
+ * first one is the snap name.
+ */
+
+struct _SdiDesktopFileIndex {
+  GObject parent_instance;
+
+  gchar *folder;
+  GFileMonitor *monitor;
+  /* the key is the snap name; the value is a GPtrArray with the .desktop
+   * file names.
+   */
+  GHashTable *snaps;
+};
+
+G_DEFINE_TYPE(SdiDesktopFileIndex, sdi_desktop_file_index, G_TYPE_OBJECT)
+
+static SdiDesktopFileIndex *default_index = NULL;
+
+static gchar *get_snap_name(const gchar *desktop_file) {
+  if (!g_str_has_suffix(desktop_file, ".desktop")) {
+    return NULL;
+  }
+  const gchar *separator = strchr(desktop_file, '_');
+  if ((separator == NULL) || (separator == desktop_file)) {
+    return NULL;
+  }
+  return g_strndup(desktop_file, separator - desktop_file);
+}
+
+static gboolean find_desktop_file(GPtrArray *desktop_files,
+                                  const gchar *desktop_file, guint *index) {
+  return g_ptr_array_find_with_equal_func(desktop_files, desktop_file,
+                                          g_str_equal, index);
+}
+
+static void add_desktop_file(SdiDesktopFileIndex *self,
+                             const gchar *desktop_file) {
+  g_autofree gchar *snap_name = get_snap_name(desktop_file);
+  if (snap_name == NULL) {
+    return;
+  }
+  GPtrArray *desktop_files = g_hash_table_lookup(self->snaps, snap_name);
+  if (desktop_files == NULL) {
+    desktop_files = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_insert(self->snaps, g_steal_pointer(&snap_name),
+                        desktop_files);
+  } else if (find_desktop_file(desktop_files, desktop_file, NULL)) {
+    return;
+  }
+  g_ptr_array_add(desktop_files, g_strdup(desktop_file));
+}
+
+static void remove_desktop_file(SdiDesktopFileIndex *self,
+                                const gchar *desktop_file) {
+  g_autofree gchar *snap_name = get_snap_name(desktop_file);
+  if (snap_name == NULL) {
+    return;
+  }
+  GPtrArray *desktop_files = g_hash_table_lookup(self->snaps, snap_name);
+  guint index;
+  if ((desktop_files == NULL) ||
+      !find_desktop_file(desktop_files, desktop_file, &index)) {
+    return;
+  }
+  g_ptr_array_remove_index(desktop_files, index);
+  if (desktop_files->len == 0) {
+    g_hash_table_remove(self->snaps, snap_name);
+  }
+}
+
+static void read_folder(SdiDesktopFileIndex *self) {
+  g_hash_table_remove_all(self->snaps);
+
+  g_autoptr(GDir) desktop_folder = g_dir_open(self->folder, 0, NULL);
+  if (desktop_folder == NULL) {
+    return;
+  }
+  const gchar *filename = NULL;
+  while ((filename = g_dir_read_name(desktop_folder)) != NULL) {
+    add_desktop_file(self, filename);
+  }
+}
+
+static void add_file(SdiDesktopFileIndex *self, GFile *file) {
+  g_autofree gchar *desktop_file = g_file_get_basename(file);
+  add_desktop_file(self, desktop_file);
+}
+
+static void remove_file(SdiDesktopFileIndex *self, GFile *file) {
+  g_autofree gchar *desktop_file = g_file_get_basename(file);
+  remove_desktop_file(self, desktop_file);
+}
+
+static void folder_changed_cb(SdiDesktopFileIndex *self, GFile *file,
+                              GFile *other_file, GFileMonitorEvent event_type,
+                              GFileMonitor *monitor) {
+  g_autofree gchar *path = g_file_get_path(file);
+  if (g_strcmp0(path, self->folder) == 0) {
+    // the folder itself has been created or removed
+    read_folder(self);
+    return;
+  }
+
+  switch (event_type) {
+  case G_FILE_MONITOR_EVENT_CREATED:
+  case G_FILE_MONITOR_EVENT_MOVED_IN:
+    add_file(self, file);
+    break;
+  case G_FILE_MONITOR_EVENT_DELETED:
+  case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    remove_file(self, file);
+    break;
+  case G_FILE_MONITOR_EVENT_RENAMED:
+    remove_file(self, file);
+    add_file(self, other_file);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Returns a new array with the names of the .desktop files of the specified
+ * snap, or an empty one if there are none. The names don't include the path.
+ */
+GStrv sdi_desktop_file_index_get_desktop_files(SdiDesktopFileIndex *self,
+                                               const gchar *snap_name) {
+  g_return_val_if_fail(SDI_IS_DESKTOP_FILE_INDEX(self), NULL);
+
+  g_autoptr(GStrvBuilder) desktop_files_builder = g_strv_builder_new();
+  GPtrArray *desktop_files = g_hash_table_lookup(self->snaps, snap_name);
+  if (desktop_files != NULL) {
+    for (guint i = 0; i < desktop_files->len; i++) {
+      g_strv_builder_add(desktop_files_builder, desktop_files->pdata[i]);
+    }
+  }
+  return g_strv_builder_end(desktop_files_builder);
+}
+
+/**
+ * Returns whether the specified .desktop file, without path, exists in the
+ * folder.
+ */
+gboolean sdi_desktop_file_index_contains(SdiDesktopFileIndex *self,
+                                         const gchar *desktop_file) {
+  g_return_val_if_fail(SDI_IS_DESKTOP_FILE_INDEX(self), FALSE);
+
+  g_autofree gchar *snap_name = get_snap_name(desktop_file);
+  if (snap_name == NULL) {
+    return FALSE;
+  }
+  GPtrArray *desktop_files = g_hash_table_lookup(self->snaps, snap_name);
+  if (desktop_files == NULL) {
+    return FALSE;
+  }
+  return find_desktop_file(desktop_files, desktop_file, NULL);
+}
+
+const gchar *sdi_desktop_file_index_get_folder(SdiDesktopFileIndex *self) {
+  g_return_val_if_fail(SDI_IS_DESKTOP_FILE_INDEX(self), NULL);
+  return self->folder;
+}
+
+static void sdi_desktop_file_index_dispose(GObject *object) {
+  SdiDesktopFileIndex *self = SDI_DESKTOP_FILE_INDEX(object);
+
+  if (self->monitor != NULL) {
+    g_file_monitor_cancel(self->monitor);
+  }
+  g_clear_object(&self->monitor);
+  g_clear_pointer(&self->snaps, g_hash_table_unref);
+  g_clear_pointer(&self->folder, g_free);
+
+  G_OBJECT_CLASS(sdi_desktop_file_index_parent_class)->dispose(object);
+}
+
+static void sdi_desktop_file_index_init(SdiDesktopFileIndex *self) {
+  self->snaps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void
+sdi_desktop_file_index_class_init(SdiDesktopFileIndexClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->dispose = sdi_desktop_file_index_dispose;
+}
+
+SdiDesktopFileIndex *sdi_desktop_file_index_new(const gchar *folder) {
+  SdiDesktopFileIndex *self = g_object_new(SDI_TYPE_DESKTOP_FILE_INDEX, NULL);
+  self->folder = g_strdup(folder);
+
+  /* The monitor is created before reading the folder, to avoid losing
+   * any change done between both operations.
+   */
+  g_autoptr(GFile) file = g_file_new_for_path(folder);
+  g_autoptr(GError) error = NULL;
+  self->monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES,
+                                           NULL, &error);
+  if (self->monitor == NULL) {
+    g_warning("Failed to monitor %s: %s", folder, error->message);
+  } else {
+    g_signal_connect_object(self->monitor, "changed",
+                            (GCallback)folder_changed_cb, self,
+                            G_CONNECT_SWAPPED);
+  }
+  read_folder(self);
+  return self;
+}
+
+/**
+ * Returns the index for the folder with the .desktop files of the snaps,
+ * creating it the first time it is called. The returned object is owned by
+ * this module, and must not be freed.
+ */
+SdiDesktopFileIndex *sdi_desktop_file_index_get_default(void) {
+  if (default_index == NULL) {
+    default_index = sdi_desktop_file_index_new(SNAPS_DESKTOP_FILES_FOLDER);
+  }
+  return default_index;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+// The folder where the snaps .desktop files are stored.
+// It must be possible to change it for the tests
+#ifndef SNAPS_DESKTOP_FILES_FOLDER
+#define SNAPS_DESKTOP_FILES_FOLDER "/var/lib/snapd/desktop/applications"
+#endif
+
+#define SDI_TYPE_DESKTOP_FILE_INDEX sdi_desktop_file_index_get_type()
+
+G_DECLARE_FINAL_TYPE(SdiDesktopFileIndex, sdi_desktop_file_index, SDI,
+                     DESKTOP_FILE_INDEX, GObject)
+
+SdiDesktopFileIndex *sdi_desktop_file_index_new(const gchar *folder);
+
+SdiDesktopFileIndex *sdi_desktop_file_index_get_default(void);
+
+const gchar *sdi_desktop_file_index_get_folder(SdiDesktopFileIndex *self);
+
+GStrv sdi_desktop_file_index_get_desktop_files(SdiDesktopFileIndex *self,
+                                               const gchar *snap_name);
+
+gboolean sdi_desktop_file_index_contains(SdiDesktopFileIndex *self,
+                                         const gchar *desktop_file);
+
+G_END_DECLS
@@ -0,0 +1,492 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-fdo-notification.h"
+#include <unistd.h>
+
+/**
+ * This is a small client for the org.freedesktop.Notifications interface,
+ * with the same features that the daemon used from libnotify. All the D-Bus
+ * calls are asynchronous, so a busy notification server never blocks the
+ * main loop.
+ *
+ * The session bus is the one passed to sdi_fdo_notification_setup(), or it is
+ * obtained the first time that it is needed; the notifications shown before
+ * it is available wait for it. The server capabilities are requested once,
+ * just after connecting.
+ *
+ * The notifications that are being shown are kept alive by this module until
+ * the server closes them, so the caller can drop its reference just after
+ * showing one. The `ActionInvoked` and `NotificationClosed` signals are
+ * routed to them by their ID.
+ */
+
+#define NOTIFICATIONS_NAME "org.freedesktop.Notifications"
+#define NOTIFICATIONS_PATH "/org/freedesktop/Notifications"
+
+typedef struct {
+  gchar *action;
+  gchar *label;
+  SdiFdoNotificationActionCallback callback;
+  gpointer user_data;
+  GDestroyNotify free_func;
+} Action;
+
+struct _SdiFdoNotification {
+  GObject parent_instance;
+
+  gchar *title;
+  gchar *body;
+  gchar *icon_name;
+  // the key is the hint name; the value is a GVariant
+  GHashTable *hints;
+  GPtrArray *actions;
+  gint timeout;
+  // ID assigned by the server, or 0 if it isn't shown
+  guint32 id;
+  // TRUE while waiting for the reply to a Notify call
+  gboolean notify_pending;
+  // things to do once the pending Notify call has finished
+  gboolean show_again;
+  gboolean close_requested;
+};
+
+G_DEFINE_TYPE(SdiFdoNotification, sdi_fdo_notification, G_TYPE_OBJECT)
+
+static gchar *app_name = NULL;
+static GDBusConnection *connection = NULL;
+static GCancellable *cancellable = NULL;
+// notifications to show once the connection is available
+static GPtrArray *waiting_notifications = NULL;
+// the key is the notification ID; the value is the notification
+static GHashTable *shown_notifications = NULL;
+// NULL until the server replies
+static GStrv capabilities = NULL;
+static guint action_invoked_id = 0;
+static guint notification_closed_id = 0;
+
+static void action_free(Action *action) {
+  if (action->free_func != NULL) {
+    action->free_func(action->user_data);
+  }
+  g_free(action->action);
+  g_free(action->label);
+  g_free(action);
+}
+
+static void action_invoked_cb(GDBusConnection *bus, const gchar *sender_name,
+                              const gchar *object_path,
+                              const gchar *interface_name,
+                              const gchar *signal_name, GVariant *parameters,
+                              gpointer user_data) {
+  guint32 id;
+  const gchar *action_name;
+  g_variant_get(parameters, "(u&s)", &id, &action_name);
+  SdiFdoNotification *notification =
+      g_hash_table_lookup(shown_notifications, GUINT_TO_POINTER(id));
+  if (notification == NULL) {
+    return;
+  }
+  // the callback can drop the last reference
+  g_autoptr(SdiFdoNotification) self = g_object_ref(notification);
+  for (guint i = 0; i < self->actions->len; i++) {
+    Action *action = self->actions->pdata[i];
+    if (g_strcmp0(action->action, action_name) == 0) {
+      action->callback(self, (gchar *)action_name, action->user_data);
+      return;
+    }
+  }
+}
+
+static void notification_closed_cb(GDBusConnection *bus,
+                                   const gchar *sender_name,
+                                   const gchar *object_path,
+                                   const gchar *interface_name,
+                                   const gchar *signal_name,
+                                   GVariant *parameters, gpointer user_data) {
+  guint32 id;
+  guint32 reason;
+  g_variant_get(parameters, "(uu)", &id, &reason);
+  SdiFdoNotification *notification =
+      g_hash_table_lookup(shown_notifications, GUINT_TO_POINTER(id));
+  if (notification == NULL) {
+    return;
+  }
+  g_autoptr(SdiFdoNotification) self = g_object_ref(notification);
+  self->id = 0;
+  g_hash_table_remove(shown_notifications, GUINT_TO_POINTER(id));
+  g_signal_emit_by_name(self, "closed");
+}
+
+static void get_capabilities_cb(GObject *object, GAsyncResult *res,
+                                gpointer data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) result =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), res, &error);
+  if (result == NULL) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_debug("Error in get_capabilities: %s\n", error->message);
+    }
+    return;
+  }
+  g_strfreev(capabilities);
+  g_variant_get(result, "(^as)", &capabilities);
+}
+
+static void clear_module(void) {
+  if (cancellable == NULL) {
+    return;
+  }
+  g_cancellable_cancel(cancellable);
+  g_clear_object(&cancellable);
+  if (connection != NULL) {
+    g_dbus_connection_signal_unsubscribe(connection, action_invoked_id);
+    g_dbus_connection_signal_unsubscribe(connection, notification_closed_id);
+    action_invoked_id = 0;
+    notification_closed_id = 0;
+  }
+  g_clear_object(&connection);
+  g_clear_pointer(&waiting_notifications, g_ptr_array_unref);
+  g_clear_pointer(&shown_notifications, g_hash_table_unref);
+  g_clear_pointer(&capabilities, g_strfreev);
+}
+
+static void set_connection(GDBusConnection *bus) {
+  connection = g_object_ref(bus);
+  /* The signals come from the unique name of the server; GDBus tracks which
+   * one owns the well-known name, so other clients can't fake them.
+   */
+  action_invoked_id = g_dbus_connection_signal_subscribe(
+      connection, NOTIFICATIONS_NAME, NOTIFICATIONS_NAME, "ActionInvoked",
+      NOTIFICATIONS_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE, action_invoked_cb,
+      NULL, NULL);
+  notification_closed_id = g_dbus_connection_signal_subscribe(
+      connection, NOTIFICATIONS_NAME, NOTIFICATIONS_NAME, "NotificationClosed",
+      NOTIFICATIONS_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+      notification_closed_cb, NULL, NULL);
+  g_dbus_connection_call(connection, NOTIFICATIONS_NAME, NOTIFICATIONS_PATH,
+                         NOTIFICATIONS_NAME, "GetCapabilities", NULL,
+                         G_VARIANT_TYPE("(as)"), G_DBUS_CALL_FLAGS_NONE, -1,
+                         cancellable, get_capabilities_cb, NULL);
+
+  g_autoptr(GPtrArray) notifications = g_steal_pointer(&waiting_notifications);
+  waiting_notifications = g_ptr_array_new_with_free_func(g_object_unref);
+  for (guint i = 0; i < notifications->len; i++) {
+    sdi_fdo_notification_show(notifications->pdata[i]);
+  }
+}
+
+static void bus_get_cb(GObject *object, GAsyncResult *res, gpointer data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GDBusConnection) bus = g_bus_get_finish(res, &error);
+  if (bus == NULL) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_warning("Failed to connect to the session bus: %s", error->message);
+      // the next notification will try again
+      clear_module();
+    }
+    return;
+  }
+  // a connection can have been passed to sdi_fdo_notification_setup() since
+  if (connection == NULL) {
+    set_connection(bus);
+  }
+}
+
+static void init_module(GDBusConnection *bus) {
+  if (cancellable != NULL) {
+    if ((bus != NULL) && (connection == NULL)) {
+      set_connection(bus);
+    }
+    return;
+  }
+  cancellable = g_cancellable_new();
+  waiting_notifications = g_ptr_array_new_with_free_func(g_object_unref);
+  shown_notifications = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, g_object_unref);
+  if (bus != NULL) {
+    set_connection(bus);
+  } else {
+    g_bus_get(G_BUS_TYPE_SESSION, cancellable, bus_get_cb, NULL);
+  }
+}
+
+/**
+ * Sets the application name sent with the notifications, and the session bus
+ * connection to use. If @bus is NULL, it is obtained asynchronously. Passing
+ * the connection of the GApplication avoids waiting for it, and allows to
+ * know the capabilities of the server before the first notification is
+ * shown. Calling this is optional.
+ */
+void sdi_fdo_notification_setup(GDBusConnection *bus, const gchar *name) {
+  g_free(app_name);
+  app_name = g_strdup(name);
+  init_module(bus);
+}
+
+/**
+ * Forgets all the notifications, and disconnects from the session bus.
+ */
+void sdi_fdo_notification_shutdown(void) {
+  clear_module();
+  g_clear_pointer(&app_name, g_free);
+}
+
+/**
+ * Returns whether the notification server has the specified capability. If
+ * the server hasn't replied yet, it assumes that it has it; the servers
+ * ignore the features that they don't support.
+ */
+gboolean sdi_fdo_notification_server_has_capability(const gchar *capability) {
+  init_module(NULL);
+  if (capabilities == NULL) {
+    return TRUE;
+  }
+  return g_strv_contains((const gchar *const *)capabilities, capability);
+}
+
+static void notify_cb(GObject *object, GAsyncResult *res, gpointer data) {
+  g_autoptr(SdiFdoNotification) self = data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) result =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), res, &error);
+  self->notify_pending = FALSE;
+  // the module can have been shut down while waiting
+  if ((result == NULL) || (shown_notifications == NULL)) {
+    if ((result == NULL) &&
+        !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_debug("Error in notify: %s\n", error->message);
+    }
+    self->show_again = FALSE;
+    self->close_requested = FALSE;
+    return;
+  }
+  guint32 id;
+  g_variant_get(result, "(u)", &id);
+  if ((self->id != 0) && (self->id != id)) {
+    g_hash_table_remove(shown_notifications, GUINT_TO_POINTER(self->id));
+  }
+  self->id = id;
+  g_hash_table_insert(shown_notifications, GUINT_TO_POINTER(id),
+                      g_object_ref(self));
+
+  if (self->close_requested) {
+    self->close_requested = FALSE;
+    self->show_again = FALSE;
+    sdi_fdo_notification_close(self);
+  } else if (self->show_again) {
+    self->show_again = FALSE;
+    sdi_fdo_notification_show(self);
+  }
+}
+
+static GVariant *build_notify_parameters(SdiFdoNotification *self) {
+  g_autoptr(GVariantBuilder) actions =
+      g_variant_builder_new(G_VARIANT_TYPE("as"));
+  for (guint i = 0; i < self->actions->len; i++) {
+    Action *action = self->actions->pdata[i];
+    g_variant_builder_add(actions, "s", action->action);
+    g_variant_builder_add(actions, "s", action->label);
+  }
+  g_autoptr(GVariantBuilder) hints =
+      g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+  GHashTableIter iter;
+  gchar *key;
+  GVariant *value;
+  g_hash_table_iter_init(&iter, self->hints);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&key, (gpointer *)&value)) {
+    g_variant_builder_add(hints, "{sv}", key, value);
+  }
+  if (!g_hash_table_contains(self->hints, "sender-pid")) {
+    g_variant_builder_add(hints, "{sv}", "sender-pid",
+                          g_variant_new_int64(getpid()));
+  }
+  return g_variant_new("(susssasa{sv}i)",
+                       (app_name == NULL) ? "" : app_name,
+                       self->id,
+                       (self->icon_name == NULL) ? "" : self->icon_name,
+                       (self->title == NULL) ? "" : self->title,
+                       (self->body == NULL) ? "" : self->body, actions, hints,
+                       self->timeout);
+}
+
+/**
+ * Shows the notification, or updates it if it is already shown.
+ */
+void sdi_fdo_notification_show(SdiFdoNotification *self) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+
+  init_module(NULL);
+  if (connection == NULL) {
+    if (!g_ptr_array_find(waiting_notifications, self, NULL)) {
+      g_ptr_array_add(waiting_notifications, g_object_ref(self));
+    }
+    return;
+  }
+  // the ID of the notification to replace isn't known yet
+  if (self->notify_pending) {
+    self->show_again = TRUE;
+    return;
+  }
+  self->notify_pending = TRUE;
+  g_dbus_connection_call(connection, NOTIFICATIONS_NAME, NOTIFICATIONS_PATH,
+                         NOTIFICATIONS_NAME, "Notify",
+                         build_notify_parameters(self), G_VARIANT_TYPE("(u)"),
+                         G_DBUS_CALL_FLAGS_NONE, -1, cancellable, notify_cb,
+                         g_object_ref(self));
+}
+
+static void close_notification_cb(GObject *object, GAsyncResult *res,
+                                  gpointer data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) result =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), res, &error);
+  if ((result == NULL) &&
+      !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_debug("Error in close_notification: %s\n", error->message);
+  }
+}
+
+/**
+ * Removes the notification from the screen. The "closed" signal isn't
+ * emitted in this case.
+ */
+void sdi_fdo_notification_close(SdiFdoNotification *self) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+
+  if (self->notify_pending) {
+    self->close_requested = TRUE;
+    return;
+  }
+  guint index;
+  if ((waiting_notifications != NULL) &&
+      g_ptr_array_find(waiting_notifications, self, &index)) {
+    g_ptr_array_remove_index(waiting_notifications, index);
+    return;
+  }
+  if ((connection == NULL) || (self->id == 0)) {
+    return;
+  }
+  guint32 id = self->id;
+  self->id = 0;
+  g_dbus_connection_call(connection, NOTIFICATIONS_NAME, NOTIFICATIONS_PATH,
+                         NOTIFICATIONS_NAME, "CloseNotification",
+                         g_variant_new("(u)", id), NULL,
+                         G_DBUS_CALL_FLAGS_NONE, -1, cancellable,
+                         close_notification_cb, NULL);
+  // this can drop the last reference, so `self` can't be used after it
+  g_hash_table_remove(shown_notifications, GUINT_TO_POINTER(id));
+}
+
+void sdi_fdo_notification_update(SdiFdoNotification *self, const gchar *title,
+                                 const gchar *body, const gchar *icon_name) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+
+  g_free(self->title);
+  self->title = g_strdup(title);
+  g_free(self->body);
+  self->body = g_strdup(body);
+  g_free(self->icon_name);
+  self->icon_name = g_strdup(icon_name);
+}
+
+/**
+ * Sets a hint. If @value is floating, its ownership is taken.
+ */
+void sdi_fdo_notification_set_hint(SdiFdoNotification *self, const gchar *key,
+                                   GVariant *value) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+  g_return_if_fail(key != NULL);
+  g_return_if_fail(value != NULL);
+
+  g_hash_table_insert(self->hints, g_strdup(key), g_variant_ref_sink(value));
+}
+
+void sdi_fdo_notification_clear_hints(SdiFdoNotification *self) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+
+  g_hash_table_remove_all(self->hints);
+}
+
+void sdi_fdo_notification_set_timeout(SdiFdoNotification *self, gint timeout) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+
+  self->timeout = timeout;
+}
+
+/**
+ * Adds a button to the notification. The "default" action is the one
+ * invoked when the user clicks on the notification itself.
+ */
+void sdi_fdo_notification_add_action(SdiFdoNotification *self,
+                                     const gchar *action, const gchar *label,
+                                     SdiFdoNotificationActionCallback callback,
+                                     gpointer user_data,
+                                     GDestroyNotify free_func) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+  g_return_if_fail(action != NULL);
+  g_return_if_fail(label != NULL);
+  g_return_if_fail(callback != NULL);
+
+  Action *data = g_malloc0(sizeof(Action));
+  data->action = g_strdup(action);
+  data->label = g_strdup(label);
+  data->callback = callback;
+  data->user_data = user_data;
+  data->free_func = free_func;
+  g_ptr_array_add(self->actions, data);
+}
+
+void sdi_fdo_notification_clear_actions(SdiFdoNotification *self) {
+  g_return_if_fail(SDI_IS_FDO_NOTIFICATION(self));
+
+  g_ptr_array_set_size(self->actions, 0);
+}
+
+static void sdi_fdo_notification_dispose(GObject *object) {
+  SdiFdoNotification *self = SDI_FDO_NOTIFICATION(object);
+
+  g_clear_pointer(&self->title, g_free);
+  g_clear_pointer(&self->body, g_free);
+  g_clear_pointer(&self->icon_name, g_free);
+  g_clear_pointer(&self->hints, g_hash_table_unref);
+  g_clear_pointer(&self->actions, g_ptr_array_unref);
+
+  G_OBJECT_CLASS(sdi_fdo_notification_parent_class)->dispose(object);
+}
+
+void sdi_fdo_notification_init(SdiFdoNotification *self) {
+  self->hints = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      (GDestroyNotify)g_variant_unref);
+  self->actions = g_ptr_array_new_with_free_func((GDestroyNotify)action_free);
+  self->timeout = SDI_FDO_NOTIFICATION_EXPIRES_DEFAULT;
+}
+
+void sdi_fdo_notification_class_init(SdiFdoNotificationClass *klass) {
+  G_OBJECT_CLASS(klass)->dispose = sdi_fdo_notification_dispose;
+
+  g_signal_new("closed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL,
+               NULL, NULL, G_TYPE_NONE, 0);
+}
+
+SdiFdoNotification *sdi_fdo_notification_new(const gchar *title,
+                                             const gchar *body,
+                                             const gchar *icon_name) {
+  SdiFdoNotification *self = g_object_new(SDI_TYPE_FDO_NOTIFICATION, NULL);
+  sdi_fdo_notification_update(self, title, body, icon_name);
+  return self;
+}
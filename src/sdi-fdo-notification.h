@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define SDI_TYPE_FDO_NOTIFICATION sdi_fdo_notification_get_type()
+
+G_DECLARE_FINAL_TYPE(SdiFdoNotification, sdi_fdo_notification, SDI,
+                     FDO_NOTIFICATION, GObject)
+
+// expiration timeouts, in ms, with special meaning
+#define SDI_FDO_NOTIFICATION_EXPIRES_DEFAULT -1
+#define SDI_FDO_NOTIFICATION_EXPIRES_NEVER 0
+
+typedef void (*SdiFdoNotificationActionCallback)(
+    SdiFdoNotification *notification, gchar *action, gpointer user_data);
+
+void sdi_fdo_notification_setup(GDBusConnection *bus, const gchar *app_name);
+
+void sdi_fdo_notification_shutdown(void);
+
+gboolean sdi_fdo_notification_server_has_capability(const gchar *capability);
+
+SdiFdoNotification *sdi_fdo_notification_new(const gchar *title,
+                                             const gchar *body,
+                                             const gchar *icon_name);
+
+void sdi_fdo_notification_update(SdiFdoNotification *self, const gchar *title,
+                                 const gchar *body, const gchar *icon_name);
+
+void sdi_fdo_notification_set_hint(SdiFdoNotification *self, const gchar *key,
+                                   GVariant *value);
+
+void sdi_fdo_notification_clear_hints(SdiFdoNotification *self);
+
+void sdi_fdo_notification_set_timeout(SdiFdoNotification *self, gint timeout);
+
+void sdi_fdo_notification_add_action(SdiFdoNotification *self,
+                                     const gchar *action, const gchar *label,
+                                     SdiFdoNotificationActionCallback callback,
+                                     gpointer user_data,
+                                     GDestroyNotify free_func);
+
+void sdi_fdo_notification_clear_actions(SdiFdoNotification *self);
+
+void sdi_fdo_notification_show(SdiFdoNotification *self);
+
+void sdi_fdo_notification_close(SdiFdoNotification *self);
+
+G_END_DECLS
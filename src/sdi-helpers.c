@@ -16,6 +16,81 @@
  */
 
 #include "sdi-helpers.h"
+#include <glib/gstdio.h>
+
+/* Parsed .desktop files, to avoid reading and parsing them every time a
+ * notification or a dialog needs the name or the icon of a snap. The key is
+ * the path of the file; the value is a CachedAppInfo structure. Each entry
+ * is validated against the modification time and size of the file, so the
+ * heuristics that choose the file of a snap only cost a stat per file.
+ */
+static GHashTable *app_info_cache = NULL;
+
+typedef struct {
+  // NULL if the file couldn't be parsed
+  GDesktopAppInfo *app_info;
+  gint64 mtime;
+  glong mtime_nsec;
+  gint64 size;
+} CachedAppInfo;
+
+static void free_cached_app_info(CachedAppInfo *cached) {
+  g_clear_object(&cached->app_info);
+  g_free(cached);
+}
+
+/**
+ * Returns whether the modification time of a file, with nanoseconds, is
+ * different from the specified one. A file can be written twice in the same
+ * second, so the seconds aren't enough.
+ */
+static gboolean mtime_changed(GStatBuf *stat_data, gint64 mtime,
+                              glong mtime_nsec) {
+  return (stat_data->st_mtim.tv_sec != mtime) ||
+         (stat_data->st_mtim.tv_nsec != mtime_nsec);
+}
+
+/**
+ * Returns the cached data of a .desktop file, parsing it only if it isn't in
+ * the cache or it has changed since it was parsed, or NULL if it doesn't
+ * exist.
+ */
+static CachedAppInfo *get_cached_app_info(const gchar *desktop_file) {
+  if (app_info_cache == NULL) {
+    app_info_cache =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                              (GDestroyNotify)free_cached_app_info);
+  }
+  GStatBuf stat_data;
+  if (g_stat(desktop_file, &stat_data) != 0) {
+    g_hash_table_remove(app_info_cache, desktop_file);
+    return NULL;
+  }
+  CachedAppInfo *cached = g_hash_table_lookup(app_info_cache, desktop_file);
+  if ((cached == NULL) ||
+      mtime_changed(&stat_data, cached->mtime, cached->mtime_nsec) ||
+      (cached->size != stat_data.st_size)) {
+    cached = g_malloc0(sizeof(CachedAppInfo));
+    cached->app_info = g_desktop_app_info_new_from_filename(desktop_file);
+    cached->mtime = stat_data.st_mtim.tv_sec;
+    cached->mtime_nsec = stat_data.st_mtim.tv_nsec;
+    cached->size = stat_data.st_size;
+    g_hash_table_insert(app_info_cache, g_strdup(desktop_file), cached);
+  }
+  return cached;
+}
+
+/**
+ * Returns the app info of a .desktop file, or NULL if it doesn't exist or
+ * can't be parsed.
+ */
+static GAppInfo *get_app_info(const gchar *desktop_file) {
+  CachedAppInfo *cached = get_cached_app_info(desktop_file);
+  if ((cached == NULL) || (cached->app_info == NULL)) {
+    return NULL;
+  }
+  return g_object_ref(G_APP_INFO(cached->app_info));
+}
 
 /**
  * Analyzes a SnapdSnap and uses several heuristics to return the most
@@ -33,7 +108,7 @@ GAppInfo *sdi_get_desktop_file_from_snap(SnapdSnap *snap) {
     if (desktop_file == NULL) {
       return NULL;
     }
-    return G_APP_INFO(g_desktop_app_info_new_from_filename(desktop_file));
+    return get_app_info(desktop_file);
   }
 
   const gchar *name = snapd_snap_get_name(snap);
@@ -46,7 +121,7 @@ GAppInfo *sdi_get_desktop_file_from_snap(SnapdSnap *snap) {
         // there can't be several entries with the same name, so stop searching
         return NULL;
       }
-      return G_APP_INFO(g_desktop_app_info_new_from_filename(desktop_file));
+      return get_app_info(desktop_file);
     }
   }
   // if it doesn't exist, get the first entry with an icon
@@ -56,8 +131,7 @@ GAppInfo *sdi_get_desktop_file_from_snap(SnapdSnap *snap) {
     if (desktop_file == NULL) {
       continue;
     }
-    g_autoptr(GAppInfo) app_info =
-        G_APP_INFO(g_desktop_app_info_new_from_filename(desktop_file));
+    g_autoptr(GAppInfo) app_info = get_app_info(desktop_file);
     if (app_info != NULL) {
       GIcon *icon = g_app_info_get_icon(app_info);
       if (icon != NULL) {
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-latency.h"
+#include <string.h>
+
+/**
+ * This module measures the time between a notice and each of the actions
+ * that it causes: getting the data from snapd, emitting `begin-refresh` and
+ * `refresh-progress`, showing a notification and updating the dock. Each
+ * time is measured both from the moment snapd says the notice occurred and
+ * from the moment the daemon received it, so it's possible to know whether
+ * a delay comes from snapd, from the daemon itself, or from the UI.
+ *
+ * The notices are identified by a key: the change ID for "change-update"
+ * notices, and "refresh-inhibit" for the "refresh-inhibit" ones. The actions
+ * that only know the snap name find the notice through the last key linked
+ * to that snap. Only the first action of each kind after a notice is
+ * measured; the rest are caused by the periodic polling, not by the notice.
+ *
+ * The times are accumulated in histograms with fixed buckets, so the
+ * percentiles are estimated: they are the upper limit of the bucket that
+ * contains them.
+ */
+
+#define REFRESH_INHIBIT_KEY "refresh-inhibit"
+
+// Time, in seconds, after which a notice is forgotten
+#define MAX_NOTICE_AGE 600
+
+// Upper limits, in ms, of each bucket; the last bucket has no limit
+static const gint64 bucket_limits[] = {1,   2,    5,    10,   20,   50,  100,
+                                       200, 500,  1000, 2000, 5000, 10000};
+
+#define N_BUCKETS (G_N_ELEMENTS(bucket_limits) + 1)
+
+static const gchar *stage_names[] = {"fetch", "begin-refresh",
+                                     "refresh-progress", "notification",
+                                     "dock"};
+
+static const gchar *origin_names[] = {"occurred", "received"};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(stage_names) == SDI_LATENCY_N_STAGES);
+G_STATIC_ASSERT(G_N_ELEMENTS(origin_names) == SDI_LATENCY_N_ORIGINS);
+
+typedef struct {
+  guint counts[N_BUCKETS];
+  guint n_samples;
+  gint64 total;
+  gint64 max;
+} Histogram;
+
+typedef struct {
+  // real time, in us, when snapd says that the notice occurred
+  gint64 occurred;
+  // monotonic time, in us, when the notice was received
+  gint64 received;
+  // bitmask with the stages already measured for this notice
+  guint measured_stages;
+} NoticeTimes;
+
+static Histogram histograms[SDI_LATENCY_N_STAGES][SDI_LATENCY_N_ORIGINS];
+// the key is the notice key; the value is a NoticeTimes structure
+static GHashTable *notices = NULL;
+// the key is a snap name; the value is the key of its last notice
+static GHashTable *snap_keys = NULL;
+
+static void init_tables(void) {
+  if (notices != NULL) {
+    return;
+  }
+  notices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  snap_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+static void add_sample(Histogram *histogram, gint64 time) {
+  time = MAX(time, 0) / 1000;
+  guint bucket = 0;
+  while ((bucket < G_N_ELEMENTS(bucket_limits)) &&
+         (time > bucket_limits[bucket])) {
+    bucket++;
+  }
+  histogram->counts[bucket]++;
+  histogram->n_samples++;
+  histogram->total += time;
+  histogram->max = MAX(histogram->max, time);
+}
+
+static void remove_old_notices(gint64 now) {
+  GHashTableIter iter;
+  NoticeTimes *times;
+  g_hash_table_iter_init(&iter, notices);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&times)) {
+    if ((now - times->received) > MAX_NOTICE_AGE * G_USEC_PER_SEC) {
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+  gchar *key;
+  g_hash_table_iter_init(&iter, snap_keys);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&key)) {
+    if (!g_hash_table_contains(notices, key)) {
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+}
+
+/**
+ * Stores the times of a notice just received from snapd. It must be called
+ * before passing it to the refresh monitor.
+ */
+void sdi_latency_notice_received(SnapdNotice *notice) {
+  const gchar *key;
+  switch (snapd_notice_get_notice_type(notice)) {
+  case SNAPD_NOTICE_TYPE_CHANGE_UPDATE:
+    key = snapd_notice_get_key(notice);
+    break;
+  case SNAPD_NOTICE_TYPE_REFRESH_INHIBIT:
+    key = REFRESH_INHIBIT_KEY;
+    break;
+  default:
+    return;
+  }
+  if (key == NULL) {
+    return;
+  }
+  init_tables();
+  gint64 now = g_get_monotonic_time();
+  remove_old_notices(now);
+
+  NoticeTimes *times = g_malloc0(sizeof(NoticeTimes));
+  times->received = now;
+  times->occurred = g_get_real_time();
+  GDateTime *last_occurred = snapd_notice_get_last_occurred(notice);
+  if (last_occurred != NULL) {
+    times->occurred = g_date_time_to_unix_usec(last_occurred);
+  }
+  g_hash_table_insert(notices, g_strdup(key), times);
+}
+
+/**
+ * Links a snap to the notice that caused its last update, so the actions
+ * that only know the snap name can be measured. A NULL key links it to the
+ * last "refresh-inhibit" notice.
+ */
+void sdi_latency_link_snap(const gchar *snap_name, const gchar *key) {
+  if (key == NULL) {
+    key = REFRESH_INHIBIT_KEY;
+  }
+  // the changes are polled periodically, so this is called very often
+  if ((notices == NULL) || !g_hash_table_contains(notices, key) ||
+      (g_strcmp0(g_hash_table_lookup(snap_keys, snap_name), key) == 0)) {
+    return;
+  }
+  g_hash_table_insert(snap_keys, g_strdup(snap_name), g_strdup(key));
+}
+
+/**
+ * Measures the time since the notice with this key for the specified
+ * stage, if it is the first time that this stage happens for that notice.
+ * A NULL key means the last "refresh-inhibit" notice.
+ */
+void sdi_latency_record(SdiLatencyStage stage, const gchar *key) {
+  if (notices == NULL) {
+    return;
+  }
+  NoticeTimes *times = g_hash_table_lookup(
+      notices, (key == NULL) ? REFRESH_INHIBIT_KEY : key);
+  if ((times == NULL) || (times->measured_stages & (1 << stage))) {
+    return;
+  }
+  times->measured_stages |= 1 << stage;
+  add_sample(&histograms[stage][SDI_LATENCY_SINCE_OCCURRED],
+             g_get_real_time() - times->occurred);
+  add_sample(&histograms[stage][SDI_LATENCY_SINCE_RECEIVED],
+             g_get_monotonic_time() - times->received);
+}
+
+void sdi_latency_record_snap(SdiLatencyStage stage, const gchar *snap_name) {
+  if ((snap_keys == NULL) || (snap_name == NULL)) {
+    return;
+  }
+  const gchar *key = g_hash_table_lookup(snap_keys, snap_name);
+  if (key != NULL) {
+    sdi_latency_record(stage, key);
+  }
+}
+
+/**
+ * Returns an estimate, in ms, of the specified percentile of the times
+ * measured for a stage, or -1 if there are no samples.
+ */
+gint64 sdi_latency_get_percentile(SdiLatencyStage stage,
+                                  SdiLatencyOrigin origin, guint percent) {
+  g_return_val_if_fail(stage < SDI_LATENCY_N_STAGES, -1);
+  g_return_val_if_fail(origin < SDI_LATENCY_N_ORIGINS, -1);
+  g_return_val_if_fail(percent <= 100, -1);
+
+  Histogram *histogram = &histograms[stage][origin];
+  if (histogram->n_samples == 0) {
+    return -1;
+  }
+  // position, starting at 1, of the sample at that percentile
+  guint rank = MAX((histogram->n_samples * percent + 99) / 100, 1);
+  guint accumulated = 0;
+  for (guint bucket = 0; bucket < G_N_ELEMENTS(bucket_limits); bucket++) {
+    accumulated += histogram->counts[bucket];
+    if (accumulated >= rank) {
+      return MIN(bucket_limits[bucket], histogram->max);
+    }
+  }
+  return histogram->max;
+}
+
+/**
+ * Returns a text with one line for each histogram that has samples, or NULL
+ * if nothing has been measured yet.
+ */
+gchar *sdi_latency_report(void) {
+  g_autoptr(GString) report = NULL;
+  for (guint stage = 0; stage < SDI_LATENCY_N_STAGES; stage++) {
+    for (guint origin = 0; origin < SDI_LATENCY_N_ORIGINS; origin++) {
+      Histogram *histogram = &histograms[stage][origin];
+      if (histogram->n_samples == 0) {
+        continue;
+      }
+      if (report == NULL) {
+        report = g_string_new(NULL);
+      }
+      g_string_append_printf(
+          report,
+          "%s since %s: %u samples, mean %" G_GINT64_FORMAT
+          " ms, p50 %" G_GINT64_FORMAT " ms, p95 %" G_GINT64_FORMAT
+          " ms, max %" G_GINT64_FORMAT " ms;",
+          stage_names[stage], origin_names[origin], histogram->n_samples,
+          histogram->total / histogram->n_samples,
+          sdi_latency_get_percentile(stage, origin, 50),
+          sdi_latency_get_percentile(stage, origin, 95), histogram->max);
+      for (guint bucket = 0; bucket < N_BUCKETS; bucket++) {
+        if (histogram->counts[bucket] == 0) {
+          continue;
+        }
+        if (bucket < G_N_ELEMENTS(bucket_limits)) {
+          g_string_append_printf(report, " <=%" G_GINT64_FORMAT "ms:%u",
+                                 bucket_limits[bucket],
+                                 histogram->counts[bucket]);
+        } else {
+          g_string_append_printf(report, " >%" G_GINT64_FORMAT "ms:%u",
+                                 bucket_limits[bucket - 1],
+                                 histogram->counts[bucket]);
+        }
+      }
+      g_string_append_c(report, '\n');
+    }
+  }
+  return (report == NULL) ? NULL : g_string_free(g_steal_pointer(&report),
+                                                 FALSE);
+}
+
+/**
+ * Frees the notices pending of measurement and clears the histograms.
+ */
+void sdi_latency_shutdown(void) {
+  g_clear_pointer(&notices, g_hash_table_unref);
+  g_clear_pointer(&snap_keys, g_hash_table_unref);
+  memset(histograms, 0, sizeof(histograms));
+}
+
+#ifdef DEBUG_TESTS
+
+/**
+ * Adds a time, in microseconds, to the histogram of a stage.
+ */
+void sdi_latency_add_sample(SdiLatencyStage stage, SdiLatencyOrigin origin,
+                            gint64 time) {
+  add_sample(&histograms[stage][origin], time);
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <snapd-glib/snapd-glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  SDI_LATENCY_FETCH,
+  SDI_LATENCY_BEGIN_REFRESH,
+  SDI_LATENCY_REFRESH_PROGRESS,
+  SDI_LATENCY_NOTIFICATION,
+  SDI_LATENCY_DOCK,
+  SDI_LATENCY_N_STAGES,
+} SdiLatencyStage;
+
+typedef enum {
+  SDI_LATENCY_SINCE_OCCURRED,
+  SDI_LATENCY_SINCE_RECEIVED,
+  SDI_LATENCY_N_ORIGINS,
+} SdiLatencyOrigin;
+
+void sdi_latency_notice_received(SnapdNotice *notice);
+
+void sdi_latency_link_snap(const gchar *snap_name, const gchar *key);
+
+void sdi_latency_record(SdiLatencyStage stage, const gchar *key);
+
+void sdi_latency_record_snap(SdiLatencyStage stage, const gchar *snap_name);
+
+gint64 sdi_latency_get_percentile(SdiLatencyStage stage,
+                                  SdiLatencyOrigin origin, guint percent);
+
+gchar *sdi_latency_report(void);
+
+void sdi_latency_shutdown(void);
+
+#ifdef DEBUG_TESTS
+
+void sdi_latency_add_sample(SdiLatencyStage stage, SdiLatencyOrigin origin,
+                            gint64 time);
+
+#endif
+
+G_END_DECLS
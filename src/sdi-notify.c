@@ -18,15 +18,19 @@
 // .desktop files for snap store.
 #define SNAP_STORE "snap-store_snap-store.desktop"
 #define SNAP_STORE_UPDATES "snap-store_show-updates.desktop"
+// topic of the notification that lists the pending refreshes
+#define PENDING_UPDATE_TOPIC "pending-update"
 
 #include "sdi-notify.h"
 #include <gio/gdesktopappinfo.h>
 #include <glib/gi18n.h>
-#include <libnotify/notify.h>
 #include <stdbool.h>
 
 #include "io.snapcraft.PrivilegedDesktopLauncher.h"
+#include "sdi-desktop-file-index.h"
+#include "sdi-fdo-notification.h"
 #include "sdi-helpers.h"
+#include "sdi-latency.h"
 
 enum { PROP_APPLICATION = 1, PROP_LAST };
 
@@ -34,32 +38,102 @@ struct _SdiNotify {
   GObject parent_instance;
 
   GApplication *application;
+#ifndef USE_GNOTIFY
+  /* the key is the topic of a pending-refresh notification; the value is
+   * the SdiFdoNotification shown for it, which is updated in place.
+   */
+  GHashTable *pending_notifications;
+#endif
+  // created the first time that a desktop file is launched, and reused
+  PrivilegedDesktopLauncher *launcher;
+  // desktop files to launch once the launcher proxy has been created
+  GPtrArray *pending_launches;
+  GCancellable *cancellable;
 };
 
 G_DEFINE_TYPE(SdiNotify, sdi_notify, G_TYPE_OBJECT)
 
-static bool launch_desktop(GApplication *app, const gchar *desktop_file) {
-  g_autofree gchar *full_desktop_path = NULL;
+static void open_desktop_entry_cb(GObject *source, GAsyncResult *res,
+                                  gpointer p) {
+  g_autoptr(GError) error = NULL;
+  if (!privileged_desktop_launcher__call_open_desktop_entry_finish(
+          (PrivilegedDesktopLauncher *)source, res, &error)) {
+    g_debug("Error in open_desktop_entry_cb: %s\n", error->message);
+  }
+}
+
+static void open_desktop_entry(SdiNotify *self, const gchar *desktop_file) {
+  privileged_desktop_launcher__call_open_desktop_entry(
+      self->launcher, desktop_file, self->cancellable, open_desktop_entry_cb,
+      NULL);
+}
+
+static void launcher_created_cb(GObject *source, GAsyncResult *res,
+                                gpointer p) {
+  g_autoptr(SdiNotify) self = p;
+  g_autoptr(GError) error = NULL;
+
+  PrivilegedDesktopLauncher *launcher =
+      privileged_desktop_launcher__proxy_new_finish(res, &error);
+  if (launcher == NULL) {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      return;
+    }
+    g_debug("Error in launcher_created_cb: %s\n", error->message);
+    // try again the next time
+    g_ptr_array_set_size(self->pending_launches, 0);
+    return;
+  }
+  self->launcher = launcher;
+  for (guint i = 0; i < self->pending_launches->len; i++) {
+    open_desktop_entry(self, self->pending_launches->pdata[i]);
+  }
+  g_ptr_array_set_size(self->pending_launches, 0);
+}
+
+/**
+ * Asks the privileged launcher to open a desktop file, either by its full
+ * path or by its name in the snaps desktop folder. Returns false if the file
+ * doesn't exist. The launch is done asynchronously, so this returns
+ * immediately.
+ */
+static bool launch_desktop(SdiNotify *self, const gchar *desktop_file) {
+  SdiDesktopFileIndex *index = sdi_desktop_file_index_get_default();
   g_autofree gchar *desktop_file2 = NULL;
   if (*desktop_file == '/') {
-    full_desktop_path = g_strdup(desktop_file);
+    g_autofree gchar *folder = g_path_get_dirname(desktop_file);
     desktop_file2 = g_path_get_basename(desktop_file);
+    // the index already knows the files in the snaps folder
+    gboolean exists =
+        (g_strcmp0(folder, sdi_desktop_file_index_get_folder(index)) == 0)
+            ? sdi_desktop_file_index_contains(index, desktop_file2)
+            : g_file_test(desktop_file, G_FILE_TEST_EXISTS);
+    if (!exists) {
+      return false;
+    }
   } else {
-    full_desktop_path = g_build_path("/", "/var/lib/snapd/desktop/applications",
-                                     desktop_file, NULL);
+    if (!sdi_desktop_file_index_contains(index, desktop_file)) {
+      return false;
+    }
     desktop_file2 = g_strdup(desktop_file);
   }
-  if (!g_file_test(full_desktop_path, G_FILE_TEST_EXISTS)) {
-    return false;
-  }
-  g_autoptr(PrivilegedDesktopLauncher) launcher = NULL;
 
-  launcher = privileged_desktop_launcher__proxy_new_sync(
-      g_application_get_dbus_connection(app), G_DBUS_PROXY_FLAGS_NONE,
-      "io.snapcraft.Launcher", "/io/snapcraft/PrivilegedDesktopLauncher", NULL,
-      NULL);
-  privileged_desktop_launcher__call_open_desktop_entry_sync(
-      launcher, desktop_file2, NULL, NULL);
+  if (self->launcher != NULL) {
+    open_desktop_entry(self, desktop_file2);
+    return true;
+  }
+  GDBusConnection *connection =
+      g_application_get_dbus_connection(self->application);
+  if (connection == NULL) {
+    return true;
+  }
+  g_ptr_array_add(self->pending_launches, g_steal_pointer(&desktop_file2));
+  if (self->pending_launches->len == 1) {
+    privileged_desktop_launcher__proxy_new(
+        connection, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        "io.snapcraft.Launcher", "/io/snapcraft/PrivilegedDesktopLauncher",
+        self->cancellable, launcher_created_cb, g_object_ref(self));
+  }
   return true;
 }
 
@@ -67,8 +141,8 @@ static void show_updates(SdiNotify *self) {
 #ifdef DEBUG_TESTS
   g_signal_emit_by_name(self, "notification-closed", "show-updates");
 #endif
-  if (!launch_desktop(self->application, SNAP_STORE_UPDATES)) {
-    launch_desktop(self->application, SNAP_STORE);
+  if (!launch_desktop(self, SNAP_STORE_UPDATES)) {
+    launch_desktop(self, SNAP_STORE);
   }
 }
 
@@ -92,11 +166,20 @@ static void sdi_notify_action_ignore(GActionGroup *action_group,
 #endif
 }
 
+/**
+ * Returns the topic of the notification shown for the forced refresh of a
+ * snap, so each reminder replaces the previous one.
+ */
+static gchar *get_forced_refresh_topic(const gchar *snap_name) {
+  return g_strdup_printf("pending-update-forced-%s", snap_name);
+}
+
 /* Currently, due to the way Snapd creates the .desktop files, the notifications
  * created with GNotify don't show the application icon in the upper-left
  * corner, putting instead the "generic gears" icon. This is the reason why, by
- * default, we use libnotify. This problem is being tackled by the snapd people,
- * so, in the future, GNotify would be the prefered choice.
+ * default, we talk directly to the org.freedesktop.Notifications server. This
+ * problem is being tackled by the snapd people, so, in the future, GNotify
+ * would be the prefered choice.
  */
 #ifndef USE_GNOTIFY
 
@@ -136,6 +219,7 @@ static gchar *get_icon_name_from_gicon(GIcon *icon) {
 }
 
 typedef struct {
+  // not owned: the notification that uses this is owned by the notifier
   SdiNotify *self;
   GVariant *snaps;
 } IgnoreNotifyData;
@@ -143,13 +227,12 @@ typedef struct {
 static IgnoreNotifyData *ignore_notify_data_new(SdiNotify *self,
                                                 GVariant *snaps) {
   IgnoreNotifyData *data = g_malloc0(sizeof(IgnoreNotifyData));
-  data->self = g_object_ref(self);
+  data->self = self;
   data->snaps = g_variant_ref(snaps);
   return data;
 }
 
 static void ignore_notify_data_free(IgnoreNotifyData *data) {
-  g_object_unref(data->self);
   g_variant_unref(data->snaps);
   g_free(data);
 }
@@ -178,76 +261,126 @@ static void launch_updated_app_free(void *user_data) {
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(LaunchUpdatedApp, launch_updated_app_free)
 
-static void app_close_notification(NotifyNotification *notification,
+static void app_close_notification(SdiFdoNotification *notification,
                                    char *action, SdiNotify *self) {
 #ifdef DEBUG_TESTS
   g_signal_emit_by_name(self, "notification-closed", "close-notification");
 #endif
-  g_object_unref(notification);
 }
 
-static void app_launch_updated(NotifyNotification *notification, char *action,
+static void app_launch_updated(SdiFdoNotification *notification, char *action,
                                LaunchUpdatedApp *data) {
 #ifdef DEBUG_TESTS
   g_autofree gchar *param =
       g_strdup_printf("app-launch-updated %s", data->desktop);
   g_signal_emit_by_name(data->self, "notification-closed", param);
 #endif
-  launch_desktop(data->self->application, (const gchar *)data->desktop);
-  g_object_unref(notification);
+  launch_desktop(data->self, (const gchar *)data->desktop);
 }
 
-static void app_show_updates(NotifyNotification *notification, char *action,
+static void app_show_updates(SdiFdoNotification *notification, char *action,
                              SdiNotify *self) {
   show_updates(self);
-  g_object_unref(notification);
 }
 
-static void app_ignore_snaps_notification(NotifyNotification *notification,
+static void app_ignore_snaps_notification(SdiFdoNotification *notification,
                                           char *action,
                                           IgnoreNotifyData *data) {
   sdi_notify_action_ignore(NULL, data->snaps, data->self);
-  g_object_unref(notification);
+}
+
+static void pending_notification_closed_cb(SdiFdoNotification *notification,
+                                           SdiNotify *self) {
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, self->pending_notifications);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    if (value == notification) {
+      g_signal_handlers_disconnect_by_data(notification, self);
+      g_hash_table_iter_remove(&iter);
+      return;
+    }
+  }
+}
+
+/**
+ * Returns the notification shown for a topic, updated with new contents and
+ * without actions, or a new one if there isn't one. This keeps a single
+ * notification for each topic, no matter how many reminders are shown.
+ */
+static SdiFdoNotification *
+get_pending_notification(SdiNotify *self, const gchar *topic,
+                         const gchar *title, const gchar *body,
+                         const gchar *icon_name) {
+  SdiFdoNotification *notification =
+      g_hash_table_lookup(self->pending_notifications, topic);
+  if (notification != NULL) {
+    sdi_fdo_notification_update(notification, title, body, icon_name);
+    sdi_fdo_notification_clear_hints(notification);
+    sdi_fdo_notification_clear_actions(notification);
+    return notification;
+  }
+  notification = sdi_fdo_notification_new(title, body, icon_name);
+  g_signal_connect(notification, "closed",
+                   (GCallback)pending_notification_closed_cb, self);
+  g_hash_table_insert(self->pending_notifications, g_strdup(topic),
+                      notification);
+  return notification;
+}
+
+/**
+ * Closes the notification shown for a topic, if there is one.
+ */
+static void close_pending_notification(SdiNotify *self, const gchar *topic) {
+  SdiFdoNotification *notification =
+      g_hash_table_lookup(self->pending_notifications, topic);
+  if (notification == NULL) {
+    return;
+  }
+  g_signal_handlers_disconnect_by_data(notification, self);
+  sdi_fdo_notification_close(notification);
+  g_hash_table_remove(self->pending_notifications, topic);
 }
 
 static void show_pending_update_notification(SdiNotify *self,
+                                             const gchar *topic,
                                              const gchar *title,
                                              const gchar *body, GIcon *icon,
                                              GListModel *snaps,
                                              gboolean allow_to_ignore) {
   g_autofree gchar *icon_name = get_icon_name_from_gicon(icon);
-  // Don't use g_autoptr because it must survive for the actions
-  NotifyNotification *notification =
-      notify_notification_new(title, body, icon_name);
+  // owned by the `pending_notifications` table
+  SdiFdoNotification *notification =
+      get_pending_notification(self, topic, title, body, icon_name);
   if (icon_name != NULL) {
     // don't use g_autoptr with the GVariant because it is consumed in set_hint
-    notify_notification_set_hint(notification, "image-path",
-                                 g_variant_new_string(icon_name));
+    sdi_fdo_notification_set_hint(notification, "image-path",
+                                  g_variant_new_string(icon_name));
   }
-  notify_notification_add_action(notification, "app.show-updates",
-                                 _("Show updates"),
-                                 (NotifyActionCallback)app_show_updates,
-                                 g_object_ref(self), g_object_unref);
+  // the notification is owned by `self`, so the actions don't keep a ref
+  sdi_fdo_notification_add_action(
+      notification, "app.show-updates", _("Show updates"),
+      (SdiFdoNotificationActionCallback)app_show_updates, self, NULL);
   /* This is the default action, the one executed when the user clicks on the
    * notification itself. It has no button, so the _("Show updates") text is
    * really unnecesary. It's added just in case in a future notifications do
    * use it for... whatever... a popup, for example.
    */
-  notify_notification_add_action(notification, "default", _("Show updates"),
-                                 (NotifyActionCallback)app_show_updates,
-                                 g_object_ref(self), g_object_unref);
+  sdi_fdo_notification_add_action(
+      notification, "default", _("Show updates"),
+      (SdiFdoNotificationActionCallback)app_show_updates, self, NULL);
   if (allow_to_ignore) {
     g_autoptr(GVariant) snap_list = get_snap_list(snaps);
     /// TRANSLATORS: Text for a button in a notification. Pressing it
     /// will inform the program to not notify again that there are
     /// refreshes for the snaps specified in the notification.
-    notify_notification_add_action(
+    sdi_fdo_notification_add_action(
         notification, "app.ignore-notification", _("Don't remind me again"),
-        (NotifyActionCallback)app_ignore_snaps_notification,
+        (SdiFdoNotificationActionCallback)app_ignore_snaps_notification,
         ignore_notify_data_new(self, snap_list),
         (GFreeFunc)ignore_notify_data_free);
   }
-  notify_notification_show(notification, NULL);
+  sdi_fdo_notification_show(notification);
 }
 
 static void update_complete_notification(SdiNotify *self, const gchar *title,
@@ -255,34 +388,86 @@ static void update_complete_notification(SdiNotify *self, const gchar *title,
                                          const gchar *id,
                                          const gchar *desktop) {
   g_autofree gchar *icon_name = get_icon_name_from_gicon(icon);
-  // Don't use g_autoptr because it must survive for the actions
-  NotifyNotification *notification =
-      notify_notification_new(title, body, icon_name);
+  // kept alive by the notifications client while it is shown
+  g_autoptr(SdiFdoNotification) notification =
+      sdi_fdo_notification_new(title, body, icon_name);
 
   if (icon_name != NULL) {
-    notify_notification_set_hint(notification, "image-path",
-                                 g_variant_new_string(icon_name));
+    sdi_fdo_notification_set_hint(notification, "image-path",
+                                  g_variant_new_string(icon_name));
   }
 
   if (desktop == NULL) {
     /// TRANSLATORS: Text for one of the buttons in the notification shown
     /// after a snap has been refreshed. Pressing it will close the
     /// notification.
-    notify_notification_add_action(notification, "default", _("Close"),
-                                   (NotifyActionCallback)app_close_notification,
-                                   g_object_ref(self), g_object_unref);
+    sdi_fdo_notification_add_action(
+        notification, "default", _("Close"),
+        (SdiFdoNotificationActionCallback)app_close_notification,
+        g_object_ref(self), g_object_unref);
   } else {
     LaunchUpdatedApp *data = launch_updated_app_new(self, desktop);
-    notify_notification_add_action(notification, "default", _("Close"),
-                                   (NotifyActionCallback)app_launch_updated,
-                                   data, launch_updated_app_free);
+    sdi_fdo_notification_add_action(
+        notification, "default", _("Close"),
+        (SdiFdoNotificationActionCallback)app_launch_updated, data,
+        launch_updated_app_free);
   }
-  notify_notification_show(notification, NULL);
+  sdi_fdo_notification_show(notification);
+}
+
+static void update_complete_multiple_notification(SdiNotify *self,
+                                                  const gchar *title,
+                                                  const gchar *body,
+                                                  GIcon *icon,
+                                                  GListModel *snaps) {
+  g_autofree gchar *icon_name = get_icon_name_from_gicon(icon);
+  // kept alive by the notifications client while it is shown
+  g_autoptr(SdiFdoNotification) notification =
+      sdi_fdo_notification_new(title, body, icon_name);
+  if (icon_name != NULL) {
+    sdi_fdo_notification_set_hint(notification, "image-path",
+                                  g_variant_new_string(icon_name));
+  }
+  sdi_fdo_notification_add_action(
+      notification, "default", _("Close"),
+      (SdiFdoNotificationActionCallback)app_close_notification,
+      g_object_ref(self), g_object_unref);
+  // one button to launch each one of the refreshed apps
+  guint n_snaps = sdi_fdo_notification_server_has_capability("actions")
+                      ? g_list_model_get_n_items(snaps)
+                      : 0;
+  for (guint i = 0; i < n_snaps; i++) {
+    g_autoptr(SnapdSnap) snap = g_list_model_get_item(snaps, i);
+    g_autoptr(GAppInfo) app_info = sdi_get_desktop_file_from_snap(snap);
+    if (app_info == NULL) {
+      continue;
+    }
+    const gchar *desktop =
+        g_desktop_app_info_get_filename(G_DESKTOP_APP_INFO(app_info));
+    if (desktop == NULL) {
+      continue;
+    }
+    g_autofree gchar *action = g_strdup_printf("launch-%u", i);
+    sdi_fdo_notification_add_action(
+        notification, action, g_app_info_get_display_name(app_info),
+        (SdiFdoNotificationActionCallback)app_launch_updated,
+        launch_updated_app_new(self, desktop), launch_updated_app_free);
+  }
+  sdi_fdo_notification_show(notification);
 }
 
 #else
 
+static void close_pending_notification(SdiNotify *self, const gchar *topic) {
+  g_application_withdraw_notification(self->application, topic);
+}
+
+/**
+ * Shows a notification for a topic, replacing the previous one of the same
+ * topic.
+ */
 static void show_pending_update_notification(SdiNotify *self,
+                                             const gchar *topic,
                                              const gchar *title,
                                              const gchar *body, GIcon *icon,
                                              GListModel *snaps,
@@ -308,8 +493,7 @@ static void show_pending_update_notification(SdiNotify *self,
     g_notification_add_button_with_target_value(
         notification, _("Don't remind me again"), "app.ignore-updates", values);
   }
-  g_application_send_notification(self->application, "pending-update",
-                                  notification);
+  g_application_send_notification(self->application, topic, notification);
 }
 
 static void update_complete_notification(SdiNotify *self, const gchar *title,
@@ -327,6 +511,34 @@ static void update_complete_notification(SdiNotify *self, const gchar *title,
   }
   g_application_send_notification(self->application, id, notification);
 }
+
+static void update_complete_multiple_notification(SdiNotify *self,
+                                                  const gchar *title,
+                                                  const gchar *body,
+                                                  GIcon *icon,
+                                                  GListModel *snaps) {
+  g_autoptr(GNotification) notification = g_notification_new(title);
+  g_notification_set_body(notification, body);
+  if (icon != NULL) {
+    g_notification_set_icon(notification, g_object_ref(icon));
+  }
+  for (guint i = 0; i < g_list_model_get_n_items(snaps); i++) {
+    g_autoptr(SnapdSnap) snap = g_list_model_get_item(snaps, i);
+    g_autoptr(GAppInfo) app_info = sdi_get_desktop_file_from_snap(snap);
+    if (app_info == NULL) {
+      continue;
+    }
+    const gchar *desktop =
+        g_desktop_app_info_get_filename(G_DESKTOP_APP_INFO(app_info));
+    if (desktop != NULL) {
+      g_notification_add_button_with_target(
+          notification, g_app_info_get_display_name(app_info),
+          "app.launch-refreshed-app", "s", desktop);
+    }
+  }
+  g_application_send_notification(self->application, "update-complete",
+                                  notification);
+}
 #endif
 
 void sdi_notify_pending_refresh_forced(SdiNotify *self, SnapdSnap *snap,
@@ -374,11 +586,14 @@ void sdi_notify_pending_refresh_forced(SdiNotify *self, SnapdSnap *snap,
 
   g_autoptr(GListStore) snap_list = g_list_store_new(SNAPD_TYPE_SNAP);
   g_list_store_append(snap_list, snap);
+  sdi_latency_record_snap(SDI_LATENCY_NOTIFICATION, snapd_snap_get_name(snap));
+  g_autofree gchar *topic = get_forced_refresh_topic(snapd_snap_get_name(snap));
   /// TRANSLATORS: This message is shown below the "%s will quit and update
   /// in..." message.
   show_pending_update_notification(
-      self, title, _("Save your progress and quit now to prevent data loss."),
-      icon, G_LIST_MODEL(snap_list), allow_to_ignore);
+      self, topic, title,
+      _("Save your progress and quit now to prevent data loss."), icon,
+      G_LIST_MODEL(snap_list), allow_to_ignore);
 }
 
 static gchar *get_name_from_snap(SnapdSnap *snap) {
@@ -473,7 +688,13 @@ void sdi_notify_pending_refresh(SdiNotify *self, GListModel *snaps) {
       icon = g_app_info_get_icon(G_APP_INFO(app_info2));
     }
   }
-  show_pending_update_notification(self, title, body, icon, snaps, TRUE);
+  for (guint i = 0; i < n_snaps; i++) {
+    g_autoptr(SnapdSnap) snap = g_list_model_get_item(snaps, i);
+    sdi_latency_record_snap(SDI_LATENCY_NOTIFICATION,
+                            snapd_snap_get_name(snap));
+  }
+  show_pending_update_notification(self, PENDING_UPDATE_TOPIC, title, body,
+                                   icon, snaps, TRUE);
 }
 
 void sdi_notify_refresh_complete(SdiNotify *self, SnapdSnap *snap,
@@ -503,10 +724,57 @@ void sdi_notify_refresh_complete(SdiNotify *self, SnapdSnap *snap,
 
   g_autofree gchar *title = g_strdup_printf(_("%s was updated"), name);
 
+  g_autofree gchar *topic = get_forced_refresh_topic(
+      (snap == NULL) ? snap_name : snapd_snap_get_name(snap));
+  close_pending_notification(self, topic);
+  sdi_latency_record_snap(SDI_LATENCY_NOTIFICATION,
+                          (snap == NULL) ? snap_name
+                                         : snapd_snap_get_name(snap));
+
   update_complete_notification(self, title, _("You can reopen it now."), icon,
                                "update-complete", desktop);
 }
 
+/**
+ * Shows a single notification for several snaps that have been refreshed at
+ * the same time, with a button to launch each one of them.
+ */
+void sdi_notify_refresh_complete_multiple(SdiNotify *self, GListModel *snaps) {
+  g_return_if_fail(SDI_IS_NOTIFY(self));
+  g_return_if_fail(snaps != NULL);
+
+  guint n_snaps = g_list_model_get_n_items(snaps);
+  if (n_snaps == 0) {
+    return;
+  }
+  if (n_snaps == 1) {
+    g_autoptr(SnapdSnap) snap = g_list_model_get_item(snaps, 0);
+    sdi_notify_refresh_complete(self, snap, NULL);
+    return;
+  }
+
+  for (guint i = 0; i < n_snaps; i++) {
+    g_autoptr(SnapdSnap) snap = g_list_model_get_item(snaps, i);
+    g_autofree gchar *topic =
+        get_forced_refresh_topic(snapd_snap_get_name(snap));
+    close_pending_notification(self, topic);
+    sdi_latency_record_snap(SDI_LATENCY_NOTIFICATION,
+                            snapd_snap_get_name(snap));
+  }
+  /// TRANSLATORS: The %d is the number of snaps that have been refreshed
+  /// at the same time.
+  g_autofree gchar *title = g_strdup_printf(
+      ngettext("%d app was updated", "%d apps were updated", n_snaps),
+      n_snaps);
+  GIcon *icon = NULL;
+  g_autoptr(GDesktopAppInfo) app_info = g_desktop_app_info_new(SNAP_STORE);
+  if (app_info != NULL) {
+    icon = g_app_info_get_icon(G_APP_INFO(app_info));
+  }
+  update_complete_multiple_notification(
+      self, title, _("You can reopen them now."), icon, snaps);
+}
+
 static void set_actions(SdiNotify *self) {
   g_autoptr(GVariantType) type_ignore = g_variant_type_new("as");
   g_autoptr(GSimpleAction) action_ignore =
@@ -541,6 +809,10 @@ static void sdi_notify_set_property(GObject *object, guint prop_id,
     if (p != NULL) {
       self->application = g_object_ref(p);
       set_actions(self);
+      // the notifications client is also used by the theme monitor
+      sdi_fdo_notification_setup(
+          g_application_get_dbus_connection(self->application),
+          "Snapd Desktop Integration");
     }
     break;
   default:
@@ -566,14 +838,34 @@ static void sdi_notify_get_property(GObject *object, guint prop_id,
 static void sdi_notify_dispose(GObject *object) {
   SdiNotify *self = SDI_NOTIFY(object);
 
+  g_cancellable_cancel(self->cancellable);
+  g_clear_object(&self->cancellable);
+  g_clear_object(&self->launcher);
+  g_clear_pointer(&self->pending_launches, g_ptr_array_unref);
+#ifndef USE_GNOTIFY
+  if (self->pending_notifications != NULL) {
+    GHashTableIter iter;
+    gpointer notification;
+    g_hash_table_iter_init(&iter, self->pending_notifications);
+    while (g_hash_table_iter_next(&iter, NULL, &notification)) {
+      // the actions point to `self` without a ref
+      g_signal_handlers_disconnect_by_data(notification, self);
+      sdi_fdo_notification_clear_actions(notification);
+    }
+  }
+  g_clear_pointer(&self->pending_notifications, g_hash_table_unref);
+#endif
   g_clear_object(&self->application);
 
   G_OBJECT_CLASS(sdi_notify_parent_class)->dispose(object);
 }
 
 void sdi_notify_init(SdiNotify *self) {
+  self->pending_launches = g_ptr_array_new_with_free_func(g_free);
+  self->cancellable = g_cancellable_new();
 #ifndef USE_GNOTIFY
-  notify_init("Snapd Desktop Integration");
+  self->pending_notifications =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
 #endif
 }
 
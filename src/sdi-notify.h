@@ -35,6 +35,9 @@ void sdi_notify_pending_refresh(SdiNotify *notify, GListModel *snaps);
 void sdi_notify_refresh_complete(SdiNotify *notify, SnapdSnap *snap,
                                  const gchar *snap_name);
 
+void sdi_notify_refresh_complete_multiple(SdiNotify *notify,
+                                          GListModel *snaps);
+
 void sdi_notify_pending_refresh_forced(SdiNotify *self, SnapdSnap *snap,
                                        GTimeSpan remaining_time,
                                        gboolean allow_to_ignore);
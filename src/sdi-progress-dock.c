@@ -17,58 +17,180 @@
 
 #include "sdi-progress-dock.h"
 #include "com.canonical.Unity.LauncherEntry.h"
+#include "sdi-latency.h"
 #include <glib/gi18n.h>
 #include <snapd-glib/snapd-glib.h>
 
 /**
  * This class manages the progress bars in the dock for each snap
  * being updated.
+ *
+ * The dock extensions must wake up to process every signal, so the last
+ * state sent for each desktop file is kept, and only the properties that
+ * have changed are sent.
+ */
+
+/* Minimum time, in ms, between two updates of the progress bars in the dock.
+ * Each update is a DBus signal, and the dock doesn't need to be as smooth
+ * as the progress window.
  */
+#define DOCK_UPDATE_INTERVAL 250
 
 struct _SdiProgressDock {
   GObject parent_instance;
 
   GApplication *application;
   UnityComCanonicalUnityLauncherEntry *unity_manager;
+  // the key is the snap name; the value is a PendingProgress structure.
+  GHashTable *pending_progress;
+  guint progress_timer_id;
+  // monotonic time of the last update sent to the dock
+  gint64 last_progress_update;
+  // the key is the desktop file; the value is a DockEntry structure.
+  GHashTable *dock_entries;
 };
 
 G_DEFINE_TYPE(SdiProgressDock, sdi_progress_dock, G_TYPE_OBJECT)
 
+typedef struct {
+  GStrv desktop_files;
+  guint done_tasks;
+  guint total_tasks;
+} PendingProgress;
+
+static void free_pending_progress(PendingProgress *progress) {
+  g_strfreev(progress->desktop_files);
+  g_free(progress);
+}
+
+/* The state of a progress bar, as last sent to the dock. There is only an
+ * entry while the progress bar is visible.
+ */
+typedef struct {
+  gdouble progress;
+} DockEntry;
+
+/**
+ * Sends to the dock the properties of each desktop file that differ from
+ * the ones already sent. When the task is done, the progress bar is always
+ * hidden, and its state forgotten.
+ */
+static void send_progress(SdiProgressDock *self, const gchar *snap_name,
+                          GStrv desktop_files, guint done_tasks,
+                          guint total_tasks, gboolean task_done) {
+  gdouble progress = done_tasks / ((gdouble)total_tasks);
+  gboolean sent = FALSE;
+  for (gchar **desktop_file = desktop_files; *desktop_file != NULL;
+       desktop_file++) {
+    DockEntry *entry = g_hash_table_lookup(self->dock_entries, *desktop_file);
+    gboolean visible_changed = task_done || (entry == NULL);
+    gboolean progress_changed =
+        !task_done && ((entry == NULL) || (entry->progress != progress));
+    if (!visible_changed && !progress_changed) {
+      continue;
+    }
+
+    // Update dock progress bar
+    g_autoptr(GVariantBuilder) builder =
+        g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+    if (progress_changed) {
+      g_variant_builder_add(builder, "{sv}", "progress",
+                            g_variant_new_double(progress));
+    }
+    if (visible_changed) {
+      g_variant_builder_add(builder, "{sv}", "progress-visible",
+                            g_variant_new_boolean(!task_done));
+      g_variant_builder_add(builder, "{sv}", "updating",
+                            g_variant_new_boolean(!task_done));
+    }
+    unity_com_canonical_unity_launcher_entry_emit_update(
+        self->unity_manager, *desktop_file, g_variant_builder_end(builder));
+    sent = TRUE;
+
+    if (task_done) {
+      g_hash_table_remove(self->dock_entries, *desktop_file);
+      continue;
+    }
+    if (entry == NULL) {
+      entry = g_malloc0(sizeof(DockEntry));
+      g_hash_table_insert(self->dock_entries, g_strdup(*desktop_file), entry);
+    }
+    entry->progress = progress;
+  }
+  if (sent) {
+    sdi_latency_record_snap(SDI_LATENCY_DOCK, snap_name);
+  }
+}
+
+static void flush_pending_progress(SdiProgressDock *self) {
+  self->progress_timer_id = 0;
+  self->last_progress_update = g_get_monotonic_time();
+
+  GHashTableIter iter;
+  const gchar *snap_name;
+  PendingProgress *progress;
+  g_hash_table_iter_init(&iter, self->pending_progress);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&snap_name,
+                                (gpointer *)&progress)) {
+    send_progress(self, snap_name, progress->desktop_files,
+                  progress->done_tasks, progress->total_tasks, FALSE);
+    g_hash_table_iter_remove(&iter);
+  }
+}
+
 /**
  * This callback should be connected to the `refresh-progress` signal from a
  * #sdi_refresh_monitor object. It will receive the total number of tasks and
  * how many have been done, and if the task has been completed, and with that
  * will update the progress bars in the dock.
+ *
+ * The intermediate values are sent at most once every DOCK_UPDATE_INTERVAL
+ * ms, keeping only the last one of each snap, and only if they differ from
+ * the ones already in the dock; the final state, which hides the progress
+ * bars, is always sent immediately.
  */
 void sdi_progress_dock_update_progress(SdiProgressDock *self, gchar *snap_name,
                                        GStrv desktop_files,
                                        gchar *task_description,
                                        guint done_tasks, guint total_tasks,
                                        gboolean task_done) {
-  if ((desktop_files == NULL) || (total_tasks == 0)) {
+  if ((snap_name == NULL) || (desktop_files == NULL) || (total_tasks == 0)) {
     return;
   }
-  for (gchar **desktop_file = desktop_files; *desktop_file != NULL;
-       desktop_file++) {
-    // Update dock progress bar
-    g_autoptr(GVariantBuilder) builder =
-        g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
-    g_variant_builder_add(
-        builder, "{sv}", "progress",
-        g_variant_new_double(done_tasks / ((gdouble)total_tasks)));
-    g_variant_builder_add(builder, "{sv}", "progress-visible",
-                          g_variant_new_boolean(!task_done));
-    g_variant_builder_add(builder, "{sv}", "updating",
-                          g_variant_new_boolean(!task_done));
 
-    unity_com_canonical_unity_launcher_entry_emit_update(
-        self->unity_manager, *desktop_file, g_variant_builder_end(builder));
+  if (task_done) {
+    g_hash_table_remove(self->pending_progress, snap_name);
+    send_progress(self, snap_name, desktop_files, done_tasks, total_tasks,
+                  TRUE);
+    return;
+  }
+
+  PendingProgress *progress = g_malloc0(sizeof(PendingProgress));
+  progress->desktop_files = g_strdupv(desktop_files);
+  progress->done_tasks = done_tasks;
+  progress->total_tasks = total_tasks;
+  g_hash_table_insert(self->pending_progress, g_strdup(snap_name), progress);
+
+  if (self->progress_timer_id != 0) {
+    return;
   }
+  gint64 elapsed =
+      (g_get_monotonic_time() - self->last_progress_update) / 1000;
+  if (elapsed >= DOCK_UPDATE_INTERVAL) {
+    flush_pending_progress(self);
+    return;
+  }
+  self->progress_timer_id =
+      g_timeout_add_once(DOCK_UPDATE_INTERVAL - elapsed,
+                         (GSourceOnceFunc)flush_pending_progress, self);
 }
 
 static void sdi_progress_dock_dispose(GObject *object) {
   SdiProgressDock *self = SDI_PROGRESS_DOCK(object);
 
+  g_clear_handle_id(&self->progress_timer_id, g_source_remove);
+  g_clear_pointer(&self->pending_progress, g_hash_table_unref);
+  g_clear_pointer(&self->dock_entries, g_hash_table_unref);
   g_clear_object(&self->unity_manager);
   g_clear_object(&self->application);
 
@@ -81,8 +203,12 @@ static void sdi_progress_dock_class_init(SdiProgressDockClass *klass) {
   gobject_class->dispose = sdi_progress_dock_dispose;
 }
 
-// This method is mandatory in GObject, but we have nothing to do inside
-static void sdi_progress_dock_init(SdiProgressDock *self) {}
+static void sdi_progress_dock_init(SdiProgressDock *self) {
+  self->pending_progress = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)free_pending_progress);
+  self->dock_entries =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
 
 SdiProgressDock *sdi_progress_dock_new(GApplication *application) {
   SdiProgressDock *self = g_object_new(SDI_TYPE_PROGRESS_DOCK, NULL);
@@ -26,6 +26,11 @@
  * being updated is shown.
  */
 
+/* Minimum time, in ms, between two updates of the progress bars (about one
+ * frame at 60 Hz).
+ */
+#define PROGRESS_UPDATE_INTERVAL 16
+
 struct _SdiProgressWindow {
   GObject parent_instance;
 
@@ -33,8 +38,24 @@ struct _SdiProgressWindow {
   GApplication *application;
   GtkBox *refresh_bar_container;
   GHashTable *dialogs;
+  // the key is the snap name; the value is a PendingProgress structure.
+  GHashTable *pending_progress;
+  guint progress_timer_id;
+  // monotonic time of the last update of the progress bars
+  gint64 last_progress_update;
 };
 
+typedef struct {
+  gchar *task_description;
+  guint done_tasks;
+  guint total_tasks;
+} PendingProgress;
+
+static void free_pending_progress(PendingProgress *progress) {
+  g_free(progress->task_description);
+  g_free(progress);
+}
+
 G_DEFINE_TYPE(SdiProgressWindow, sdi_progress_window, G_TYPE_OBJECT)
 
 #ifdef DEBUG_TESTS
@@ -114,12 +135,20 @@ static void add_dialog_to_main_window(SdiProgressWindow *self,
  * This callback should be connected to the `begin-refresh` signal from a
  * #sdi_refresh_monitor object. It will create a new window if required, and
  * insert into it a new #sdi_refresh_dialog with the snap name, snap icon and
- * progress bar.
+ * progress bar. If there is already a dialog for that snap (for example, a
+ * placeholder created while the snap data was being retrieved), it will
+ * update its name and icon.
  */
 void sdi_progress_window_begin_refresh(SdiProgressWindow *self,
                                        gchar *snap_name, gchar *visible_name,
                                        gchar *icon) {
-  if (g_hash_table_contains(self->dialogs, snap_name)) {
+  SdiRefreshDialog *current_dialog =
+      (SdiRefreshDialog *)g_hash_table_lookup(self->dialogs, snap_name);
+  if (current_dialog != NULL) {
+    sdi_refresh_dialog_set_visible_name(current_dialog, visible_name);
+    if (icon != NULL) {
+      sdi_refresh_dialog_set_icon_image(current_dialog, icon);
+    }
     return;
   }
   g_autoptr(SdiRefreshDialog) dialog =
@@ -141,6 +170,7 @@ void sdi_progress_window_begin_refresh(SdiProgressWindow *self,
 
 void sdi_progress_window_end_refresh(SdiProgressWindow *self,
                                      gchar *snap_name) {
+  g_hash_table_remove(self->pending_progress, snap_name);
   SdiRefreshDialog *dialog =
       (SdiRefreshDialog *)g_hash_table_lookup(self->dialogs, snap_name);
   if (dialog != NULL) {
@@ -148,12 +178,45 @@ void sdi_progress_window_end_refresh(SdiProgressWindow *self,
   }
 }
 
+static void set_dialog_progress(SdiProgressWindow *self,
+                                const gchar *snap_name,
+                                const gchar *task_description,
+                                guint done_tasks, guint total_tasks) {
+  SdiRefreshDialog *dialog =
+      (SdiRefreshDialog *)g_hash_table_lookup(self->dialogs, snap_name);
+  if (dialog != NULL) {
+    sdi_refresh_dialog_set_n_tasks_progress(dialog, task_description,
+                                            done_tasks, total_tasks);
+  }
+}
+
+static void flush_pending_progress(SdiProgressWindow *self) {
+  self->progress_timer_id = 0;
+  self->last_progress_update = g_get_monotonic_time();
+
+  GHashTableIter iter;
+  gchar *snap_name;
+  PendingProgress *progress;
+  g_hash_table_iter_init(&iter, self->pending_progress);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&snap_name,
+                                (gpointer *)&progress)) {
+    set_dialog_progress(self, snap_name, progress->task_description,
+                        progress->done_tasks, progress->total_tasks);
+    g_hash_table_iter_remove(&iter);
+  }
+}
+
 /**
  * This callback should be connected to the `refresh-progress` signal from a
  * #sdi_refresh_monitor object. It will receive the total number of tasks and
  * how many have been done, and if the task has been completed, and with that
  * will update the progress bars in a dialog (if it exists; if not, it will
  * be ignored).
+ *
+ * To avoid relayouting the window several times per frame when many snaps
+ * are being refreshed, the updates are stored and applied all together at
+ * most once every PROGRESS_UPDATE_INTERVAL ms. The final state is always
+ * applied immediately.
  */
 void sdi_progress_window_update_progress(SdiProgressWindow *self,
                                          gchar *snap_name, GStrv desktop_files,
@@ -164,18 +227,38 @@ void sdi_progress_window_update_progress(SdiProgressWindow *self,
     return;
   }
 
-  // Update dialog progress bar
-  SdiRefreshDialog *dialog =
-      (SdiRefreshDialog *)g_hash_table_lookup(self->dialogs, snap_name);
-  if (dialog != NULL) {
-    sdi_refresh_dialog_set_n_tasks_progress(dialog, task_description,
-                                            done_tasks, total_tasks);
+  if (task_done) {
+    g_hash_table_remove(self->pending_progress, snap_name);
+    set_dialog_progress(self, snap_name, task_description, done_tasks,
+                        total_tasks);
+    return;
+  }
+
+  PendingProgress *progress = g_malloc0(sizeof(PendingProgress));
+  progress->task_description = g_strdup(task_description);
+  progress->done_tasks = done_tasks;
+  progress->total_tasks = total_tasks;
+  g_hash_table_insert(self->pending_progress, g_strdup(snap_name), progress);
+
+  if (self->progress_timer_id != 0) {
+    return;
+  }
+  gint64 elapsed =
+      (g_get_monotonic_time() - self->last_progress_update) / 1000;
+  if (elapsed >= PROGRESS_UPDATE_INTERVAL) {
+    flush_pending_progress(self);
+    return;
   }
+  self->progress_timer_id =
+      g_timeout_add_once(PROGRESS_UPDATE_INTERVAL - elapsed,
+                         (GSourceOnceFunc)flush_pending_progress, self);
 }
 
 static void sdi_progress_window_dispose(GObject *object) {
   SdiProgressWindow *self = SDI_PROGRESS_WINDOW(object);
 
+  g_clear_handle_id(&self->progress_timer_id, g_source_remove);
+  g_clear_pointer(&self->pending_progress, g_hash_table_unref);
   g_clear_pointer(&self->dialogs, g_hash_table_unref);
   g_clear_pointer(&self->main_window, gtk_window_destroy);
   g_clear_object(&self->application);
@@ -193,6 +276,8 @@ static void sdi_progress_window_init(SdiProgressWindow *self) {
   // the key in this table is the snap name; the value is a SdiRefreshDialog
   self->dialogs =
       g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->pending_progress = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)free_pending_progress);
 }
 
 SdiProgressWindow *sdi_progress_window_new(GApplication *application) {
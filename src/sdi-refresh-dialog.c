@@ -124,15 +124,19 @@ SdiRefreshDialog *sdi_refresh_dialog_new(const gchar *app_name,
                                          const gchar *visible_name) {
   SdiRefreshDialog *self =
       g_object_ref_sink(g_object_new(SDI_TYPE_REFRESH_DIALOG, NULL));
-  g_autofree gchar *label_text = NULL;
 
   self->app_name = g_strdup(app_name);
   self->pulsed = true;
   self->current_percentage = -1;
-  label_text =
+  sdi_refresh_dialog_set_visible_name(self, visible_name);
+  return self;
+}
+
+void sdi_refresh_dialog_set_visible_name(SdiRefreshDialog *self,
+                                         const gchar *visible_name) {
+  g_autofree gchar *label_text =
       g_strdup_printf(_("Updating %s to the latest version."), visible_name);
   sdi_refresh_dialog_set_message(self, label_text);
-  return self;
 }
 
 const gchar *sdi_refresh_dialog_get_app_name(SdiRefreshDialog *self) {
@@ -31,6 +31,9 @@ SdiRefreshDialog *sdi_refresh_dialog_new(const gchar *app_name,
 
 const gchar *sdi_refresh_dialog_get_app_name(SdiRefreshDialog *dialog);
 
+void sdi_refresh_dialog_set_visible_name(SdiRefreshDialog *dialog,
+                                         const gchar *visible_name);
+
 void sdi_refresh_dialog_set_pulsed_progress(SdiRefreshDialog *dialog,
                                             const gchar *bar_text);
 
@@ -22,47 +22,65 @@
 #include <snapd-glib/snapd-glib.h>
 #include <unistd.h>
 
+#include "sdi-change-model.h"
+#include "sdi-change-scheduler.h"
+#include "sdi-deadline-scheduler.h"
+#include "sdi-desktop-file-index.h"
 #include "sdi-forced-refresh-time-constants.h"
 #include "sdi-helpers.h"
+#include "sdi-latency.h"
+#include "sdi-snap-cache.h"
 #include "sdi-snapd-client-factory.h"
+#include "sdi-trace.h"
 
-// time in ms for periodic check of each change in Refresh Monitor.
-#define CHANGE_REFRESH_PERIOD 500
-
-static void manage_change_update(SnapdClient *source, GAsyncResult *res,
-                                 gpointer p);
-
-enum { PROP_NOTIFY = 1, PROP_LAST };
+enum {
+  PROP_NOTIFY = 1,
+  PROP_MIN_POLL_INTERVAL,
+  PROP_MAX_POLL_INTERVAL,
+  PROP_LAST
+};
 
 struct _SdiRefreshMonitor {
   GObject parent_instance;
 
   GHashTable *snaps;
-  GHashTable *changes;
+  SdiChangeScheduler *scheduler;
+  SdiSnapCache *snap_cache;
   SnapdClient *client;
   GHashTable *refreshing_snap_list;
+  GHashTable *changes_progress;
+  GHashTable *pending_begin_refresh;
+  guint refresh_inhibit_timer_id;
+  gboolean refresh_inhibit_in_flight;
+  gboolean refresh_inhibit_pending;
+  /* the snaps inhibited in the last "refresh-inhibit" check; the key is the
+   * snap name, and the value an InhibitedSnap structure.
+   */
+  GHashTable *inhibited_snaps;
+  // emits `deadline` when an inhibited snap crosses a forced refresh threshold
+  SdiDeadlineScheduler *forced_refresh_deadlines;
+  // names of the snaps refreshed since the last refresh-complete signal
+  GPtrArray *completed_snaps;
+  guint refresh_complete_timer_id;
 };
 
 G_DEFINE_TYPE(SdiRefreshMonitor, sdi_refresh_monitor, G_TYPE_OBJECT)
 
 typedef struct {
-  gchar *change_id;
   gchar *snap_name;
   SdiRefreshMonitor *self;
 } SnapRefreshData;
 
 static SnapRefreshData *
 snap_refresh_data_new(SdiRefreshMonitor *refresh_monitor,
-                      const gchar *change_id, const gchar *snap_name) {
+                      const gchar *snap_name) {
   SnapRefreshData *data = g_malloc0(sizeof(SnapRefreshData));
   data->self = g_object_ref(refresh_monitor);
-  data->change_id = g_strdup(change_id);
   data->snap_name = g_strdup(snap_name);
   return data;
 }
 
 static void free_change_refresh_data(SnapRefreshData *data) {
-  g_free(data->change_id);
   g_free(data->snap_name);
   g_clear_object(&data->self);
   g_free(data);
@@ -70,11 +88,34 @@ static void free_change_refresh_data(SnapRefreshData *data) {
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(SnapRefreshData, free_change_refresh_data);
 
+// forced refresh thresholds, ordered by urgency
+typedef enum {
+  FORCED_REFRESH_NONE,
+  FORCED_REFRESH_REMINDER,
+  FORCED_REFRESH_ALERT,
+} ForcedRefreshLevel;
+
+typedef struct {
+  // the data received from snapd in the last check
+  SnapdSnap *snap;
+  // time when the snap will be refreshed even if it is running
+  gint64 proceed_time;
+  // the most urgent threshold already notified for this proceed time
+  ForcedRefreshLevel level;
+} InhibitedSnap;
+
+static void inhibited_snap_free(InhibitedSnap *inhibited) {
+  g_clear_object(&inhibited->snap);
+  g_free(inhibited);
+}
+
 typedef struct {
   guint total_tasks;
   guint done_tasks;
   gdouble old_progress;
   gboolean done;
+  // TRUE if the counters have changed since the last `refresh-progress`
+  gboolean dirty;
   GStrv desktop_files;
   gchar *snap_name;
   gchar *task_description;
@@ -88,6 +129,25 @@ static void free_progress_task_data(void *data) {
   g_free(p);
 }
 
+typedef struct {
+  // the Change as it was the last time it was checked.
+  SdiChange *last;
+  // the names of the snaps affected by any task of the Change.
+  GHashTable *snaps;
+} ChangeProgressData;
+
+static ChangeProgressData *new_change_progress_data(void) {
+  ChangeProgressData *data = g_malloc0(sizeof(ChangeProgressData));
+  data->snaps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  return data;
+}
+
+static void free_change_progress_data(ChangeProgressData *data) {
+  g_clear_pointer(&data->last, sdi_change_free);
+  g_hash_table_unref(data->snaps);
+  g_free(data);
+}
+
 static GTimeSpan get_remaining_time_in_seconds(SnapdSnap *snap) {
   GDateTime *proceed_time = snapd_snap_get_proceed_time(snap);
   g_autoptr(GDateTime) now = g_date_time_new_now_local();
@@ -95,33 +155,12 @@ static GTimeSpan get_remaining_time_in_seconds(SnapdSnap *snap) {
   return difference;
 }
 
-static GStrv get_desktop_filenames_for_snap(const gchar *snap_name) {
-  g_autoptr(GDir) desktop_folder =
-      g_dir_open(SNAPS_DESKTOP_FILES_FOLDER, 0, NULL);
-  if (desktop_folder == NULL) {
-    return NULL;
-  }
-  g_autofree gchar *prefix = g_strdup_printf("%s_", snap_name);
-  const gchar *filename = NULL;
-
-  g_autoptr(GStrvBuilder) desktop_files_builder = g_strv_builder_new();
-  while ((filename = g_dir_read_name(desktop_folder)) != NULL) {
-    if (!g_str_has_prefix(filename, prefix)) {
-      continue;
-    }
-    if (!g_str_has_suffix(filename, ".desktop")) {
-      continue;
-    }
-    g_strv_builder_add(desktop_files_builder, filename);
-  }
-  return g_strv_builder_end(desktop_files_builder);
-}
-
 static SnapProgressTaskData *new_progress_task_data(const gchar *snap_name) {
   SnapProgressTaskData *retval = g_malloc0(sizeof(SnapProgressTaskData));
   retval->old_progress = -1;
   retval->done = FALSE;
-  retval->desktop_files = get_desktop_filenames_for_snap(snap_name);
+  retval->desktop_files = sdi_desktop_file_index_get_desktop_files(
+      sdi_desktop_file_index_get_default(), snap_name);
   retval->snap_name = g_strdup(snap_name);
   return retval;
 }
@@ -151,39 +190,221 @@ static void remove_snap(SdiRefreshMonitor *self, SdiSnap *snap) {
   g_hash_table_remove(self->snaps, sdi_snap_get_name(snap));
 }
 
-static void show_snap_completed(GObject *source, GAsyncResult *res,
-                                gpointer p) {
-  g_autoptr(SnapRefreshData) data = p;
+/* Time, in ms, to wait for more snaps to finish their refresh before
+ * notifying them together.
+ */
+#define REFRESH_COMPLETE_BATCH_TIME 500
+
+typedef struct {
+  SdiRefreshMonitor *self;
+  GStrv snap_names;
+} CompletedSnapsData;
+
+static void free_completed_snaps_data(CompletedSnapsData *data) {
+  g_clear_object(&data->self);
+  g_strfreev(data->snap_names);
+  g_free(data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CompletedSnapsData, free_completed_snaps_data);
+
+static SnapdSnap *find_snap_in_array(GPtrArray *snaps, const gchar *name) {
+  for (guint i = 0; (snaps != NULL) && (i < snaps->len); i++) {
+    if (g_strcmp0(snapd_snap_get_name(snaps->pdata[i]), name) == 0) {
+      return snaps->pdata[i];
+    }
+  }
+  return NULL;
+}
+
+static void show_snaps_completed(GObject *source, GAsyncResult *res,
+                                 gpointer p) {
+  g_autoptr(CompletedSnapsData) data = p;
   g_autoptr(SdiRefreshMonitor) self = g_object_ref(data->self);
   g_autoptr(GError) error = NULL;
 
-  g_autoptr(SnapdSnap) snap =
-      snapd_client_get_snap_finish(SNAPD_CLIENT(source), res, &error);
+  g_autoptr(GPtrArray) snaps =
+      sdi_snap_cache_get_snaps_finish(SDI_SNAP_CACHE(source), res, &error);
   if ((error != NULL) &&
       (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))) {
     return;
   }
-  if ((error == NULL) && (snap != NULL)) {
-    g_signal_emit_by_name(self, "notify-refresh-complete", snap, NULL);
-  } else {
-    g_signal_emit_by_name(self, "notify-refresh-complete", NULL,
-                          data->snap_name);
+
+  if (g_strv_length(data->snap_names) == 1) {
+    SnapdSnap *snap = find_snap_in_array(snaps, data->snap_names[0]);
+    if (snap != NULL) {
+      g_signal_emit_by_name(self, "notify-refresh-complete", snap, NULL);
+    } else {
+      g_signal_emit_by_name(self, "notify-refresh-complete", NULL,
+                            data->snap_names[0]);
+    }
+    return;
+  }
+
+  g_autoptr(GListStore) snap_list = g_list_store_new(SNAPD_TYPE_SNAP);
+  for (gchar **name = data->snap_names; *name != NULL; name++) {
+    SnapdSnap *snap = find_snap_in_array(snaps, *name);
+    if (snap != NULL) {
+      g_list_store_append(snap_list, snap);
+    } else {
+      // without data from snapd, only the name can be shown
+      g_autoptr(SnapdSnap) placeholder =
+          g_object_new(SNAPD_TYPE_SNAP, "name", *name, NULL);
+      g_list_store_append(snap_list, placeholder);
+    }
+  }
+  g_signal_emit_by_name(self, "notify-refresh-complete-multiple",
+                        G_LIST_MODEL(snap_list));
+}
+
+static void notify_completed_snaps(SdiRefreshMonitor *self) {
+  self->refresh_complete_timer_id = 0;
+  g_ptr_array_add(self->completed_snaps, NULL);
+
+  CompletedSnapsData *data = g_malloc0(sizeof(CompletedSnapsData));
+  data->self = g_object_ref(self);
+  data->snap_names = (GStrv)g_ptr_array_steal(self->completed_snaps, NULL);
+  sdi_snap_cache_get_snaps_async(self->snap_cache, data->snap_names, NULL,
+                                 show_snaps_completed, data);
+}
+
+/**
+ * When a refresh with several snaps finishes, all of them finish at the
+ * same time, so they are grouped to request their data with a single call
+ * and show a single notification.
+ */
+static void add_completed_snap(SdiRefreshMonitor *self,
+                               const gchar *snap_name) {
+  for (guint i = 0; i < self->completed_snaps->len; i++) {
+    if (g_str_equal(self->completed_snaps->pdata[i], snap_name)) {
+      return;
+    }
+  }
+  g_ptr_array_add(self->completed_snaps, g_strdup(snap_name));
+  if (self->refresh_complete_timer_id == 0) {
+    self->refresh_complete_timer_id = g_timeout_add_once(
+        REFRESH_COMPLETE_BATCH_TIME, (GSourceOnceFunc)notify_completed_snaps,
+        self);
   }
 }
 
-static void refresh_change(gpointer p) {
+/* Time, in ms, to wait for more "refresh-inhibit" notices before requesting
+ * the list of inhibited snaps.
+ */
+#define REFRESH_INHIBIT_DEBOUNCE_TIME 50
+
+/* Time, in ms, to wait for the snap data before showing a progress dialog
+ * with just the snap name.
+ */
+#define BEGIN_REFRESH_PLACEHOLDER_DELAY 250
+
+typedef struct {
+  gchar *snap_name;
+  // not owned: the structure is owned by the refresh monitor itself
+  SdiRefreshMonitor *self;
+  guint placeholder_timeout_id;
+  gboolean placeholder_shown;
+} PendingBeginRefresh;
+
+static void free_pending_begin_refresh(PendingBeginRefresh *pending) {
+  g_clear_handle_id(&pending->placeholder_timeout_id, g_source_remove);
+  g_free(pending->snap_name);
+  g_free(pending);
+}
+
+static void show_placeholder_dialog(PendingBeginRefresh *pending) {
+  pending->placeholder_timeout_id = 0;
+  pending->placeholder_shown = TRUE;
+  g_signal_emit_by_name(pending->self, "begin-refresh", pending->snap_name,
+                        pending->snap_name, NULL);
+}
+
+/**
+ * Emits the `begin-refresh` signal with the "pretty name" and the icon of the
+ * snap.
+ */
+static void emit_begin_refresh(SdiRefreshMonitor *self, const gchar *snap_name,
+                               SnapdSnap *client_snap) {
+  const gchar *visible_name = NULL;
+  g_autoptr(GAppInfo) app_info = sdi_get_desktop_file_from_snap(client_snap);
+  g_autofree gchar *icon = NULL;
+  if (app_info != NULL) {
+    visible_name = g_app_info_get_display_name(G_APP_INFO(app_info));
+    icon = g_desktop_app_info_get_string(G_DESKTOP_APP_INFO(app_info), "Icon");
+  }
+  if (visible_name == NULL) {
+    visible_name = snap_name;
+  }
+  g_signal_emit_by_name(self, "begin-refresh", snap_name, visible_name, icon);
+}
+
+/**
+ * Callback for the asynchronous request of the snap data done when a
+ * refresh dialog must be shown. If the data took too long to arrive, a
+ * placeholder dialog will have been already shown, and this will update it.
+ */
+static void begin_refresh_snap_cb(GObject *source, GAsyncResult *res,
+                                  gpointer p) {
   g_autoptr(SnapRefreshData) data = p;
-  g_hash_table_remove(data->self->changes, data->change_id);
-  snapd_client_get_change_async(data->self->client, data->change_id, NULL,
-                                (GAsyncReadyCallback)manage_change_update,
-                                g_object_ref(data->self));
+  g_autoptr(SdiRefreshMonitor) self = g_object_ref(data->self);
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(SnapdSnap) client_snap =
+      sdi_snap_cache_get_snap_finish(SDI_SNAP_CACHE(source), res, &error);
+  if ((error != NULL) &&
+      (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))) {
+    return;
+  }
+
+  PendingBeginRefresh *pending =
+      g_hash_table_lookup(self->pending_begin_refresh, data->snap_name);
+  if (pending == NULL) {
+    // the refresh has already ended
+    return;
+  }
+  gboolean placeholder_shown = pending->placeholder_shown;
+  g_hash_table_remove(self->pending_begin_refresh, data->snap_name);
+
+  if (client_snap == NULL) {
+    // If no snap data is received, use default data and no icon
+    if (!placeholder_shown) {
+      g_signal_emit_by_name(self, "begin-refresh", data->snap_name,
+                            data->snap_name, NULL);
+    }
+    return;
+  }
+  // If we have snap data, we can use "pretty names" and icons
+  emit_begin_refresh(self, data->snap_name, client_snap);
 }
 
-static gboolean status_is_done(const gchar *status) {
-  gboolean done = g_str_equal(status, "Done") || g_str_equal(status, "Abort") ||
-                  g_str_equal(status, "Error") || g_str_equal(status, "Hold") ||
-                  g_str_equal(status, "Wait") || g_str_equal(status, "Undone");
-  return done;
+/**
+ * Starts the process of showing a refresh dialog for a snap. If the snap
+ * data isn't in the cache, it is requested asynchronously, and if it takes
+ * too long, a placeholder `begin-refresh` signal is emitted with just the
+ * snap name.
+ */
+static void begin_refresh(SdiRefreshMonitor *self, const gchar *snap_name) {
+  if (g_hash_table_contains(self->pending_begin_refresh, snap_name)) {
+    return;
+  }
+  g_autoptr(SnapdSnap) client_snap =
+      sdi_snap_cache_lookup(self->snap_cache, snap_name);
+  if (client_snap != NULL) {
+    emit_begin_refresh(self, snap_name, client_snap);
+    return;
+  }
+  PendingBeginRefresh *pending = g_malloc0(sizeof(PendingBeginRefresh));
+  pending->snap_name = g_strdup(snap_name);
+  pending->self = self;
+  pending->placeholder_timeout_id =
+      g_timeout_add_once(BEGIN_REFRESH_PLACEHOLDER_DELAY,
+                         (GSourceOnceFunc)show_placeholder_dialog, pending);
+  g_hash_table_insert(self->pending_begin_refresh, g_strdup(snap_name),
+                      pending);
+
+  g_autoptr(SnapRefreshData) data = snap_refresh_data_new(self, snap_name);
+  sdi_snap_cache_get_snap_async(self->snap_cache, snap_name, NULL,
+                                begin_refresh_snap_cb, g_steal_pointer(&data));
 }
 
 /** this function is called if a change is from an inhibited snap (one that was
@@ -194,19 +415,10 @@ static gboolean status_is_done(const gchar *status) {
  * a Change has been completed or cancelled and any dialog that corresponds to
  * it should be closed, in which case an ènd-refresh` signal will be emitted,
  * and a dialog will be shown. */
-static void process_inhibited_snaps(SdiRefreshMonitor *self,
-                                    SnapdChange *change, gboolean done,
-                                    gboolean cancelled) {
-  SnapdAutorefreshChangeData *change_data =
-      SNAPD_AUTOREFRESH_CHANGE_DATA(snapd_change_get_data(change));
-
-  if (change_data == NULL) {
-    return;
-  }
-
-  GStrv snap_names = snapd_autorefresh_change_data_get_snap_names(change_data);
-  for (gchar **p = snap_names; *p != NULL; p++) {
-    gchar *snap_name = *p;
+static void process_inhibited_snaps(SdiRefreshMonitor *self, SdiChange *change,
+                                    gboolean done, gboolean cancelled) {
+  for (guint i = 0; i < change->refresh_snaps->len; i++) {
+    const gchar *snap_name = sdi_change_get_refresh_snap(change, i);
     g_autoptr(SdiSnap) snap = find_snap(self, snap_name);
     if (snap == NULL) {
       continue;
@@ -220,20 +432,21 @@ static void process_inhibited_snaps(SdiRefreshMonitor *self,
     }
 
     if (done || cancelled) {
-      /* If the Change is completed, emit the `end-refresh` signal to close
-       * any Dialog that belongs to this snap...
+      // Don't show the dialog if the snap data didn't arrive yet...
+      g_hash_table_remove(self->pending_begin_refresh, snap_name);
+      /* and emit the `end-refresh` signal to close any Dialog that belongs
+       * to this snap...
        */
       g_signal_emit_by_name(self, "end-refresh", sdi_snap_get_name(snap));
       remove_snap(self, snap);
+      // if it is inhibited again, it will be a new inhibition
+      g_hash_table_remove(self->inhibited_snaps, snap_name);
+      sdi_deadline_scheduler_remove(self->forced_refresh_deadlines, snap_name);
       /* and show, if Done, a notification to inform the user that the snap
        * has been refreshed and they can launch it again.
        */
       if (done) {
-        g_autoptr(SnapRefreshData) data =
-            snap_refresh_data_new(self, NULL, snap_name);
-        snapd_client_get_snap_async(self->client, snap_name, NULL,
-                                    show_snap_completed,
-                                    g_steal_pointer(&data));
+        add_completed_snap(self, snap_name);
       }
       continue;
     }
@@ -245,31 +458,7 @@ static void process_inhibited_snaps(SdiRefreshMonitor *self,
        * if the user closes it.
        */
       sdi_snap_set_created_dialog(snap, TRUE);
-
-      g_autoptr(SnapdSnap) client_snap =
-          snapd_client_get_snap_sync(self->client, snap_name, NULL, NULL);
-
-      if (client_snap == NULL) {
-        // If no snap data is received, use default data and no icon
-        g_signal_emit_by_name(self, "begin-refresh", snap_name, snap_name,
-                              NULL);
-      } else {
-        // If we have snap data, we can use "pretty names" and icons
-        const gchar *visible_name = NULL;
-        g_autoptr(GAppInfo) app_info =
-            sdi_get_desktop_file_from_snap(client_snap);
-        g_autofree gchar *icon = NULL;
-        if (app_info != NULL) {
-          visible_name = g_app_info_get_display_name(G_APP_INFO(app_info));
-          icon = g_desktop_app_info_get_string(G_DESKTOP_APP_INFO(app_info),
-                                               "Icon");
-        }
-        if (visible_name == NULL) {
-          visible_name = snap_name;
-        }
-        g_signal_emit_by_name(self, "begin-refresh", snap_name, visible_name,
-                              icon);
-      }
+      begin_refresh(self, snap_name);
     }
   }
 }
@@ -281,101 +470,213 @@ static void process_inhibited_snaps(SdiRefreshMonitor *self,
  * both the Gtk dialog (if it was previously created due to the emission of
  * a `begin-refresh` signal) and the dock.
  */
-static void update_progress_bars(gpointer key, SnapProgressTaskData *task_data,
-                                 SdiRefreshMonitor *self) {
-  if (task_data->total_tasks == 0) {
-    return;
+static gboolean update_progress_bars(SdiRefreshMonitor *self,
+                                     SnapProgressTaskData *task_data,
+                                     gboolean force) {
+  if (!(task_data->dirty || force) || (task_data->total_tasks == 0)) {
+    return FALSE;
   }
+  task_data->dirty = FALSE;
+  task_data->done = task_data->done_tasks == task_data->total_tasks;
   gdouble progress = task_data->done_tasks / (gdouble)task_data->total_tasks;
 
-  if (task_data->done ||
+  if (force ||
       !G_APPROX_VALUE(progress, task_data->old_progress, DBL_EPSILON)) {
     task_data->old_progress = progress;
     g_signal_emit_by_name(self, "refresh-progress", task_data->snap_name,
                           task_data->desktop_files, task_data->task_description,
                           task_data->done_tasks, task_data->total_tasks,
                           task_data->done);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static SnapProgressTaskData *get_progress_task_data(SdiRefreshMonitor *self,
+                                                    const gchar *snap_name) {
+  SnapProgressTaskData *progress_task_data =
+      g_hash_table_lookup(self->refreshing_snap_list, snap_name);
+  if (progress_task_data == NULL) {
+    progress_task_data = new_progress_task_data(snap_name);
+    g_hash_table_insert(self->refreshing_snap_list, g_strdup(snap_name),
+                        progress_task_data);
+  }
+  return progress_task_data;
+}
+
+/**
+ * Updates the counters of the snaps affected by a task that has been seen
+ * for the first time (in which case `old_task` is NULL), or whose status has
+ * changed since the last time.
+ */
+static void update_task_progress(SdiRefreshMonitor *self,
+                                 ChangeProgressData *change_data,
+                                 SdiChange *change, SdiTask *task,
+                                 SdiTask *old_task) {
+  gboolean task_done = sdi_change_status_is_task_done(task->status);
+  gboolean was_done =
+      (old_task != NULL) && sdi_change_status_is_task_done(old_task->status);
+
+  for (guint i = 0; i < task->n_snaps; i++) {
+    const gchar *snap_name = sdi_change_get_task_snap(change, task, i);
+    SnapProgressTaskData *progress_task_data =
+        get_progress_task_data(self, snap_name);
+    g_hash_table_add(change_data->snaps, g_strdup(snap_name));
+    if (old_task == NULL) {
+      progress_task_data->total_tasks++;
+      if (task_done) {
+        progress_task_data->done_tasks++;
+      }
+    } else if (task_done && !was_done) {
+      progress_task_data->done_tasks++;
+    } else if (!task_done && was_done &&
+               (progress_task_data->done_tasks > 0)) {
+      progress_task_data->done_tasks--;
+    }
+    if ((task->status == SDI_CHANGE_STATUS_DOING) &&
+        (progress_task_data->task_description == NULL)) {
+      progress_task_data->task_description = g_strdup(task->summary);
+    }
+    progress_task_data->dirty = TRUE;
   }
-  task_data->done_tasks = 0;
-  task_data->total_tasks = 0;
 }
 
 /**
- * This method gets a Change object and analyzes its tasks to count how many
+ * Returns the task with the same ID in the previous check of the Change, or
+ * NULL if it is a new one.
+ */
+static SdiTask *find_old_task(SdiChange *last, guint index, SdiTask *task) {
+  return (last == NULL) ? NULL : sdi_change_find_task(last, task->id, index);
+}
+
+/**
+ * This method gets a Change and analyzes its tasks to count how many
  * are, how many have already been done, and which description text has the
  * task that is currently being done. All this info is used to calculate the
  * current progress percentage for each snap being refreshed.
+ *
+ * The Change is kept until the next check, so only the tasks whose status
+ * has changed update the counters of their snaps. This method takes the
+ * ownership of the Change.
+ *
+ * Returns TRUE if the progress of any snap did change since the last check.
  */
-static void process_change_progress(SdiRefreshMonitor *self,
-                                    SnapdChange *change, gboolean done,
-                                    gboolean cancelled) {
-  GPtrArray *tasks = snapd_change_get_tasks(change);
-  GSList *snaps_to_remove = NULL;
-
-  for (guint i = 0; i < tasks->len; i++) {
-    SnapdTask *task = tasks->pdata[i];
-    SnapdTaskData *task_data = snapd_task_get_data(task);
-    if (task_data == NULL) {
+static gboolean process_change_progress(SdiRefreshMonitor *self,
+                                        SdiChange *change, gboolean done,
+                                        gboolean cancelled) {
+  ChangeProgressData *change_data =
+      g_hash_table_lookup(self->changes_progress, change->id);
+  if (change_data == NULL) {
+    change_data = new_change_progress_data();
+    g_hash_table_insert(self->changes_progress, g_strdup(change->id),
+                        change_data);
+  }
+
+  /* Each Change has one or more Tasks. Each Task has zero or more affected
+   * Snaps. So we must keep a list of affected Snaps, and update the count
+   * of total tasks and done tasks for each snap affected by each task. This
+   * list is kept between Changes because that allows to send notifications
+   * only when there is a change in the progress.
+   */
+  for (guint i = 0; i < change->tasks->len; i++) {
+    SdiTask *task = sdi_change_get_task(change, i);
+    SdiTask *old_task = find_old_task(change_data->last, i, task);
+    if ((old_task != NULL) && (old_task->status == task->status)) {
       continue;
     }
-    GStrv affected_snaps = snapd_task_data_get_affected_snaps(task_data);
-    if (affected_snaps == NULL) {
+    update_task_progress(self, change_data, change, task, old_task);
+  }
+  g_clear_pointer(&change_data->last, sdi_change_free);
+  change_data->last = change;
+
+  /* If a Change is complete or has been cancelled, the final status of all
+   * its snaps is sent, and they are removed from the list.
+   */
+  gboolean finished = done || cancelled;
+  gboolean progressed = FALSE;
+  GHashTableIter iter;
+  gchar *snap_name;
+  g_hash_table_iter_init(&iter, change_data->snaps);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&snap_name, NULL)) {
+    SnapProgressTaskData *progress_task_data =
+        g_hash_table_lookup(self->refreshing_snap_list, snap_name);
+    if (progress_task_data == NULL) {
       continue;
     }
-    const gchar *status = snapd_task_get_status(task);
-    gboolean task_done = status_is_done(status);
-    for (gchar **p = affected_snaps; *p != NULL; p++) {
-      gchar *snap_name = *p;
-      SnapProgressTaskData *progress_task_data = NULL;
-      /* Each Change has one or more Tasks. Each Task has zero or more affected
-       * Snaps. So we must keep a list of affected Snaps, and update the count
-       * of total tasks and done tasks for each snap affected by each task. This
-       * list is kept between Changes because that allows to send notifications
-       * only when there is a change in the progress.
-       */
-      if (!g_hash_table_contains(self->refreshing_snap_list, snap_name)) {
-        progress_task_data = new_progress_task_data(snap_name);
-        g_hash_table_insert(self->refreshing_snap_list, g_strdup(snap_name),
-                            progress_task_data);
-      } else {
-        progress_task_data =
-            g_hash_table_lookup(self->refreshing_snap_list, snap_name);
-      }
-      progress_task_data->total_tasks++;
-      progress_task_data->done = task_done;
-      if (task_done) {
-        progress_task_data->done_tasks++;
-      } else if ((progress_task_data->task_description == NULL) &&
-                 g_str_equal("Doing", status)) {
-        progress_task_data->task_description =
-            g_strdup(snapd_task_get_summary(task));
-      }
-      if (done || cancelled) {
-        /* If a Change is complete or has been cancelled, we must remove those
-         * snaps from the list. But it must be done after updating the progress
-         * bars.
-         */
-        snaps_to_remove = g_slist_prepend(snaps_to_remove, g_strdup(snap_name));
-      }
+    progressed |= update_progress_bars(self, progress_task_data, finished);
+    if (finished) {
+      g_hash_table_remove(self->refreshing_snap_list, snap_name);
     }
   }
-  g_hash_table_foreach(self->refreshing_snap_list, (GHFunc)update_progress_bars,
-                       self);
-  for (GSList *p = snaps_to_remove; p != NULL; p = p->next) {
-    g_hash_table_remove(self->refreshing_snap_list, p->data);
+  if (finished) {
+    // this also frees the Change
+    g_autofree gchar *change_id = g_strdup(change->id);
+    g_hash_table_remove(self->changes_progress, change_id);
   }
-  g_slist_free_full(snaps_to_remove, g_free);
+  return progressed;
 }
 
-static gboolean cancelled_change_status(const gchar *status) {
-  return g_str_equal(status, "Undoing") || g_str_equal(status, "Undone") ||
-         g_str_equal(status, "Undo") || g_str_equal(status, "Error") ||
-         g_str_equal(status, "Abort");
+/**
+ * Removes from the snap cache all the snaps affected by a Change, because
+ * their data (like the revision) can have been modified by it.
+ */
+static void invalidate_change_snaps(SdiRefreshMonitor *self,
+                                    SdiChange *change) {
+  for (guint i = 0; i < change->snap_names->len; i++) {
+    sdi_snap_cache_invalidate(self->snap_cache, change->snap_names->pdata[i]);
+  }
 }
 
-static gboolean valid_working_change_status(const gchar *status) {
-  return g_str_equal(status, "Do") || g_str_equal(status, "Doing") ||
-         g_str_equal(status, "Done");
+/**
+ * This method processes a Change, either received after a "change-update"
+ * notice or during the periodic check of the changes in progress, and
+ * decides whether it must keep being checked periodically.
+ */
+static void process_change(SdiRefreshMonitor *self, SnapdChange *change) {
+  const gchar *change_id = snapd_change_get_id(change);
+  sdi_trace_record_change(change);
+  sdi_latency_record(SDI_LATENCY_FETCH, change_id);
+  // all the processing is done over the compact model of the change
+  g_autoptr(SdiChange) model = sdi_change_new(change);
+  for (guint i = 0; i < model->snap_names->len; i++) {
+    sdi_latency_link_snap(model->snap_names->pdata[i], change_id);
+  }
+
+  gboolean done = model->status == SDI_CHANGE_STATUS_DONE;
+  gboolean cancelled = sdi_change_status_is_cancelled(model->status);
+  gboolean valid_do = sdi_change_status_is_working(model->status);
+  if (!(valid_do || cancelled)) {
+    g_debug("Unknown change status %s", snapd_change_get_status(change));
+    sdi_change_scheduler_remove_change(self->scheduler, change_id);
+    g_hash_table_remove(self->changes_progress, change_id);
+    return;
+  }
+
+  if (done || cancelled) {
+    invalidate_change_snaps(self, model);
+  }
+  if (model->kind == SDI_CHANGE_KIND_AUTO_REFRESH) {
+    process_inhibited_snaps(self, model, done, cancelled);
+  }
+  gboolean progressed = process_change_progress(
+      self, g_steal_pointer(&model), done, cancelled);
+
+  if (done || cancelled) {
+    sdi_change_scheduler_remove_change(self->scheduler, change_id);
+  } else {
+    /* since the "change-update" notice event is sent only when new Tasks
+     * are added to a Change, or when the status of the Change has been
+     * modified, we must request periodically the Change to check which task
+     * is currently active and be able to update the progress bar.
+     */
+    sdi_change_scheduler_add_change(self->scheduler, change_id);
+    /* this allows the scheduler to check more often the changes that are
+     * progressing quickly, and less often those that are stalled (like
+     * when downloading a big snap).
+     */
+    sdi_change_scheduler_report_progress(self->scheduler, change_id,
+                                         progressed);
+  }
 }
 
 /**
@@ -400,35 +701,7 @@ static void manage_change_update(SnapdClient *source, GAsyncResult *res,
   if (change == NULL) {
     return;
   }
-
-  const gchar *change_status = snapd_change_get_status(change);
-
-  gboolean done = g_str_equal(change_status, "Done");
-  gboolean cancelled = cancelled_change_status(change_status);
-  gboolean valid_do = valid_working_change_status(change_status);
-  if (!(valid_do || cancelled)) {
-    g_debug("Unknown change status %s", change_status);
-    return;
-  }
-
-  if (g_str_equal(snapd_change_get_kind(change), "auto-refresh")) {
-    process_inhibited_snaps(self, change, done, cancelled);
-  }
-  process_change_progress(self, change, done, cancelled);
-
-  const gchar *change_id = snapd_change_get_id(change);
-  if (!done && !cancelled && !g_hash_table_contains(self->changes, change_id)) {
-    /* since the "change-update" notice event is sent only when new Tasks
-     * are added to a Change, or when the status of the Change has been
-     * modified, we must request periodically the Change to check which task
-     * is currently active and be able to update the progress bar.
-     */
-    SnapRefreshData *data = snap_refresh_data_new(self, change_id, NULL);
-    guint id = g_timeout_add_once(CHANGE_REFRESH_PERIOD,
-                                  (GSourceOnceFunc)refresh_change, data);
-    g_hash_table_insert(self->changes, g_strdup(change_id),
-                        GINT_TO_POINTER(id));
-  }
+  process_change(self, change);
 }
 
 static gboolean notify_check_forced_refresh(SdiRefreshMonitor *self,
@@ -452,12 +725,83 @@ static gboolean notify_check_forced_refresh(SdiRefreshMonitor *self,
   return FALSE;
 }
 
+static ForcedRefreshLevel get_forced_refresh_level(GTimeSpan next_refresh) {
+  if (next_refresh <= TIME_TO_SHOW_ALERT_BEFORE_FORCED_REFRESH) {
+    return FORCED_REFRESH_ALERT;
+  }
+  if (next_refresh <= TIME_TO_SHOW_REMAINING_TIME_BEFORE_FORCED_REFRESH) {
+    return FORCED_REFRESH_REMINDER;
+  }
+  return FORCED_REFRESH_NONE;
+}
+
+/**
+ * Sets the time when the snap will cross the next forced refresh threshold,
+ * so the notification is shown right then, without having to ask snapd.
+ */
+static void schedule_forced_refresh_deadline(SdiRefreshMonitor *self,
+                                             const gchar *snap_name,
+                                             InhibitedSnap *inhibited) {
+  GTimeSpan threshold;
+  switch (inhibited->level) {
+  case FORCED_REFRESH_NONE:
+    threshold = TIME_TO_SHOW_REMAINING_TIME_BEFORE_FORCED_REFRESH;
+    break;
+  case FORCED_REFRESH_REMINDER:
+    threshold = TIME_TO_SHOW_ALERT_BEFORE_FORCED_REFRESH;
+    break;
+  default:
+    sdi_deadline_scheduler_remove(self->forced_refresh_deadlines, snap_name);
+    return;
+  }
+  gint64 deadline = (inhibited->proceed_time - threshold) * G_USEC_PER_SEC;
+  sdi_deadline_scheduler_set(self->forced_refresh_deadlines, snap_name,
+                             deadline);
+}
+
+/**
+ * Notifies the user if the snap has crossed a forced refresh threshold that
+ * wasn't notified yet, and waits for the next one.
+ */
+static void update_forced_refresh_level(SdiRefreshMonitor *self,
+                                        const gchar *snap_name,
+                                        InhibitedSnap *inhibited,
+                                        SdiSnap *snap_data) {
+  GTimeSpan next_refresh = get_remaining_time_in_seconds(inhibited->snap);
+  ForcedRefreshLevel level = get_forced_refresh_level(next_refresh);
+  if (level > inhibited->level) {
+    inhibited->level = level;
+    notify_check_forced_refresh(self, inhibited->snap, snap_data);
+  }
+  schedule_forced_refresh_deadline(self, snap_name, inhibited);
+}
+
+static void forced_refresh_deadline_cb(SdiRefreshMonitor *self,
+                                       const gchar *snap_name) {
+  InhibitedSnap *inhibited =
+      g_hash_table_lookup(self->inhibited_snaps, snap_name);
+  g_autoptr(SdiSnap) snap_data = find_snap(self, snap_name);
+  if ((inhibited == NULL) || (snap_data == NULL)) {
+    return;
+  }
+  update_forced_refresh_level(self, snap_name, inhibited, snap_data);
+}
+
+static void schedule_refresh_inhibit_check(SdiRefreshMonitor *self);
+
 /**
  * This method manages the "refresh-inhibit" type notices.
  * It decides wether it should show a notification to the user
  * to inform they that there are one or more snaps that have
  * pending updates but can't be refreshed because there are
  * running instances of them.
+ *
+ * snapd sends these notices again and again while the snaps are running,
+ * so the new list is compared with the previous one: the grouped
+ * notification is only shown when there are newly inhibited snaps, and the
+ * forced refresh one only when a snap crosses a new threshold. The later
+ * thresholds are notified by a timer, because snapd may not send any
+ * notice when they are reached.
  */
 static void manage_refresh_inhibit(SnapdClient *source, GAsyncResult *res,
                                    gpointer p) {
@@ -467,6 +811,16 @@ static void manage_refresh_inhibit(SnapdClient *source, GAsyncResult *res,
   g_autoptr(GPtrArray) snaps =
       snapd_client_get_snaps_finish(source, res, &error);
 
+  self->refresh_inhibit_in_flight = FALSE;
+  if (self->refresh_inhibit_pending) {
+    /* More notices arrived while the request was being done, so the list
+     * must be requested again. This one is outdated, so ignore it.
+     */
+    self->refresh_inhibit_pending = FALSE;
+    schedule_refresh_inhibit_check(self);
+    return;
+  }
+
   if (error != NULL) {
     if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
       return;
@@ -474,10 +828,11 @@ static void manage_refresh_inhibit(SnapdClient *source, GAsyncResult *res,
     g_debug("Error in manage_refresh_inhibit: %s\n", error->message);
     return;
   }
-  if (snaps->len == 0) {
-    return;
-  }
-  // Check if there's at least one snap not marked as "ignore"
+  sdi_latency_record(SDI_LATENCY_FETCH, NULL);
+  g_autoptr(GHashTable) inhibited_snaps =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                            (GDestroyNotify)inhibited_snap_free);
+  // Check if there's at least one new snap not marked as "ignore"
   gboolean show_grouped_notification = FALSE;
   g_autoptr(GListStore) snap_list = g_list_store_new(SNAPD_TYPE_SNAP);
   for (guint i = 0; i < snaps->len; i++) {
@@ -486,6 +841,9 @@ static void manage_refresh_inhibit(SnapdClient *source, GAsyncResult *res,
     if (name == NULL) {
       continue;
     }
+    sdi_trace_record_inhibited_snap(snap);
+    sdi_latency_link_snap(name, NULL);
+    sdi_snap_cache_update(self->snap_cache, snap);
     g_autoptr(SdiSnap) snap_data = add_snap(self, name);
     if (snap_data == NULL) {
       continue;
@@ -509,32 +867,81 @@ static void manage_refresh_inhibit(SnapdClient *source, GAsyncResult *res,
      */
     sdi_snap_set_inhibited(snap_data, TRUE);
 
+    /* A snap is new if it wasn't inhibited in the previous check, or if its
+     * proceed time has changed, which means that it is a different refresh.
+     */
+    gint64 proceed_time =
+        g_date_time_to_unix(snapd_snap_get_proceed_time(snap));
+    InhibitedSnap *previous = g_hash_table_lookup(self->inhibited_snaps, name);
+    gboolean is_new =
+        (previous == NULL) || (previous->proceed_time != proceed_time);
+    InhibitedSnap *inhibited = g_malloc0(sizeof(InhibitedSnap));
+    inhibited->snap = g_object_ref(snap);
+    inhibited->proceed_time = proceed_time;
+    inhibited->level = is_new ? FORCED_REFRESH_NONE : previous->level;
+    g_hash_table_insert(inhibited_snaps, g_strdup(name), inhibited);
+
     /* If the user hasn't clicked the "Don't remind me again" button in
      * a notification, `ignored` property will be TRUE, so no pending
      * notification should be sent for this specific snap (but if there
      * are more snaps, then a notification could be sent if any of those
      * aren't ignored).
      */
-    if (!sdi_snap_get_ignored(snap_data)) {
+    if (is_new && !sdi_snap_get_ignored(snap_data)) {
       show_grouped_notification = TRUE;
     }
     g_list_store_append(snap_list, snap);
     /* Check if we have to notify the user because the snap will be
      * force-refreshed soon
      */
-    notify_check_forced_refresh(self, snap, snap_data);
+    update_forced_refresh_level(self, name, inhibited, snap_data);
+  }
+  // the snaps that aren't inhibited anymore are forgotten
+  GHashTableIter iter;
+  const gchar *snap_name;
+  g_hash_table_iter_init(&iter, self->inhibited_snaps);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&snap_name, NULL)) {
+    if (!g_hash_table_contains(inhibited_snaps, snap_name)) {
+      sdi_deadline_scheduler_remove(self->forced_refresh_deadlines, snap_name);
+    }
   }
+  g_clear_pointer(&self->inhibited_snaps, g_hash_table_unref);
+  self->inhibited_snaps = g_steal_pointer(&inhibited_snaps);
   if (show_grouped_notification) {
     g_signal_emit_by_name(self, "notify-pending-refresh",
                           G_LIST_MODEL(snap_list));
   }
 }
 
+static void check_refresh_inhibit(SdiRefreshMonitor *self) {
+  self->refresh_inhibit_timer_id = 0;
+  self->refresh_inhibit_in_flight = TRUE;
+  snapd_client_get_snaps_async(
+      self->client, SNAPD_GET_SNAPS_FLAGS_REFRESH_INHIBITED, NULL, NULL,
+      (GAsyncReadyCallback)manage_refresh_inhibit, g_object_ref(self));
+}
+
+/**
+ * snapd can send several "refresh-inhibit" notices in a row (for example,
+ * when several snaps are inhibited at the same time), so wait a little to
+ * group all of them in a single request. If a request is already being done,
+ * it will be repeated when it finishes.
+ */
+static void schedule_refresh_inhibit_check(SdiRefreshMonitor *self) {
+  if (self->refresh_inhibit_in_flight) {
+    self->refresh_inhibit_pending = TRUE;
+    return;
+  }
+  if (self->refresh_inhibit_timer_id != 0) {
+    return;
+  }
+  self->refresh_inhibit_timer_id =
+      g_timeout_add_once(REFRESH_INHIBIT_DEBOUNCE_TIME,
+                         (GSourceOnceFunc)check_refresh_inhibit, self);
+}
+
 void sdi_refresh_monitor_notice(SdiRefreshMonitor *self, SnapdNotice *notice,
                                 gboolean first_run) {
-  GHashTable *notice_data = snapd_notice_get_last_data2(notice);
-  g_autofree gchar *kind = g_strdup(g_hash_table_lookup(notice_data, "kind"));
-
   switch (snapd_notice_get_notice_type(notice)) {
   case SNAPD_NOTICE_TYPE_CHANGE_UPDATE:
     /**
@@ -544,8 +951,9 @@ void sdi_refresh_monitor_notice(SdiRefreshMonitor *self, SnapdNotice *notice,
     if (first_run) {
       return;
     }
-    if (!g_str_equal(kind, "auto-refresh") &&
-        !g_str_equal(kind, "refresh-snap")) {
+    GHashTable *notice_data = snapd_notice_get_last_data2(notice);
+    const gchar *kind = g_hash_table_lookup(notice_data, "kind");
+    if (sdi_change_kind_from_string(kind) == SDI_CHANGE_KIND_OTHER) {
       return;
     }
     snapd_client_get_change_async(
@@ -553,9 +961,7 @@ void sdi_refresh_monitor_notice(SdiRefreshMonitor *self, SnapdNotice *notice,
         (GAsyncReadyCallback)manage_change_update, g_object_ref(self));
     break;
   case SNAPD_NOTICE_TYPE_REFRESH_INHIBIT:
-    snapd_client_get_snaps_async(
-        self->client, SNAPD_GET_SNAPS_FLAGS_REFRESH_INHIBITED, NULL, NULL,
-        (GAsyncReadyCallback)manage_refresh_inhibit, g_object_ref(self));
+    schedule_refresh_inhibit_check(self);
     break;
   case SNAPD_NOTICE_TYPE_SNAP_RUN_INHIBIT:
     // TODO. At this moment, no notice of this kind is emmited.
@@ -568,29 +974,108 @@ void sdi_refresh_monitor_notice(SdiRefreshMonitor *self, SnapdNotice *notice,
 static void sdi_refresh_monitor_dispose(GObject *object) {
   SdiRefreshMonitor *self = SDI_REFRESH_MONITOR(object);
 
+  g_clear_handle_id(&self->refresh_inhibit_timer_id, g_source_remove);
+  g_clear_handle_id(&self->refresh_complete_timer_id, g_source_remove);
+  g_clear_pointer(&self->completed_snaps, g_ptr_array_unref);
+  g_clear_pointer(&self->inhibited_snaps, g_hash_table_unref);
+  g_clear_object(&self->forced_refresh_deadlines);
   g_clear_pointer(&self->snaps, g_hash_table_unref);
+  g_clear_object(&self->scheduler);
+  g_clear_object(&self->snap_cache);
   g_clear_object(&self->client);
-  g_clear_pointer(&self->changes, g_hash_table_unref);
   g_clear_pointer(&self->refreshing_snap_list, g_hash_table_unref);
+  g_clear_pointer(&self->changes_progress, g_hash_table_unref);
+  g_clear_pointer(&self->pending_begin_refresh, g_hash_table_unref);
 
   G_OBJECT_CLASS(sdi_refresh_monitor_parent_class)->dispose(object);
 }
 
-static void remove_source(gpointer data) {
-  g_source_remove(GPOINTER_TO_INT(data));
+static void sdi_refresh_monitor_set_property(GObject *object, guint prop_id,
+                                             const GValue *value,
+                                             GParamSpec *pspec) {
+  SdiRefreshMonitor *self = SDI_REFRESH_MONITOR(object);
+
+  switch (prop_id) {
+  case PROP_MIN_POLL_INTERVAL:
+    g_object_set_property(G_OBJECT(self->scheduler), "min-interval", value);
+    break;
+  case PROP_MAX_POLL_INTERVAL:
+    g_object_set_property(G_OBJECT(self->scheduler), "max-interval", value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void sdi_refresh_monitor_get_property(GObject *object, guint prop_id,
+                                             GValue *value, GParamSpec *pspec) {
+  SdiRefreshMonitor *self = SDI_REFRESH_MONITOR(object);
+
+  switch (prop_id) {
+  case PROP_MIN_POLL_INTERVAL:
+    g_object_get_property(G_OBJECT(self->scheduler), "min-interval", value);
+    break;
+  case PROP_MAX_POLL_INTERVAL:
+    g_object_get_property(G_OBJECT(self->scheduler), "max-interval", value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void begin_refresh_latency_cb(SdiRefreshMonitor *self,
+                                     const gchar *snap_name) {
+  sdi_latency_record_snap(SDI_LATENCY_BEGIN_REFRESH, snap_name);
+}
+
+static void refresh_progress_latency_cb(SdiRefreshMonitor *self,
+                                        const gchar *snap_name) {
+  sdi_latency_record_snap(SDI_LATENCY_REFRESH_PROGRESS, snap_name);
 }
 
 void sdi_refresh_monitor_init(SdiRefreshMonitor *self) {
   self->snaps =
       g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
-  self->changes =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, remove_source);
   /* the key in this table is the snap name; the value is a SnapProgressTaskData
    * structure.
    */
   self->refreshing_snap_list = g_hash_table_new_full(
       g_str_hash, g_str_equal, g_free, free_progress_task_data);
-  self->client = sdi_snapd_client_factory_new_snapd_client();
+  /* the key in this table is the change ID; the value is a ChangeProgressData
+   * structure.
+   */
+  self->changes_progress =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                            (GDestroyNotify)free_change_progress_data);
+  /* the key in this table is the snap name; the value is a
+   * PendingBeginRefresh structure.
+   */
+  self->pending_begin_refresh = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify)free_pending_begin_refresh);
+  self->completed_snaps = g_ptr_array_new_with_free_func(g_free);
+  self->inhibited_snaps =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                            (GDestroyNotify)inhibited_snap_free);
+  self->forced_refresh_deadlines = sdi_deadline_scheduler_new();
+  g_signal_connect_object(self->forced_refresh_deadlines, "deadline",
+                          (GCallback)forced_refresh_deadline_cb, self,
+                          G_CONNECT_SWAPPED);
+  self->client = sdi_snapd_client_factory_get_client();
+  /* all the changes in progress are checked together by the scheduler,
+   * which emits a `change-update` signal for each one of them.
+   */
+  self->snap_cache = sdi_snap_cache_new(self->client);
+  self->scheduler = sdi_change_scheduler_new(self->client);
+  g_signal_connect_object(self->scheduler, "change-update",
+                          (GCallback)process_change, self, G_CONNECT_SWAPPED);
+  // measure the time since the notice that caused each signal
+  g_signal_connect(self, "begin-refresh", (GCallback)begin_refresh_latency_cb,
+                   NULL);
+  g_signal_connect(self, "refresh-progress",
+                   (GCallback)refresh_progress_latency_cb, NULL);
 }
 
 /**
@@ -608,8 +1093,25 @@ void sdi_refresh_monitor_ignore_snap(SdiRefreshMonitor *self,
 void sdi_refresh_monitor_class_init(SdiRefreshMonitorClass *klass) {
   GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
 
+  gobject_class->set_property = sdi_refresh_monitor_set_property;
+  gobject_class->get_property = sdi_refresh_monitor_get_property;
   gobject_class->dispose = sdi_refresh_monitor_dispose;
 
+  g_object_class_install_property(
+      gobject_class, PROP_MIN_POLL_INTERVAL,
+      g_param_spec_uint("min-poll-interval", "min-poll-interval",
+                        "Minimum time in ms between checks of a change in "
+                        "progress",
+                        1, G_MAXUINT, SDI_CHANGE_SCHEDULER_DEFAULT_MIN_INTERVAL,
+                        G_PARAM_READWRITE));
+  g_object_class_install_property(
+      gobject_class, PROP_MAX_POLL_INTERVAL,
+      g_param_spec_uint("max-poll-interval", "max-poll-interval",
+                        "Maximum time in ms between checks of a change in "
+                        "progress",
+                        1, G_MAXUINT, SDI_CHANGE_SCHEDULER_DEFAULT_MAX_INTERVAL,
+                        G_PARAM_READWRITE));
+
   g_signal_new("notify-pending-refresh", G_TYPE_FROM_CLASS(klass),
                G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1,
                G_TYPE_OBJECT);
@@ -619,6 +1121,9 @@ void sdi_refresh_monitor_class_init(SdiRefreshMonitorClass *klass) {
   g_signal_new("notify-refresh-complete", G_TYPE_FROM_CLASS(klass),
                G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 2,
                G_TYPE_OBJECT, G_TYPE_STRING);
+  g_signal_new("notify-refresh-complete-multiple", G_TYPE_FROM_CLASS(klass),
+               G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1,
+               G_TYPE_OBJECT);
 
   g_signal_new("begin-refresh", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
                NULL, NULL, NULL, G_TYPE_NONE, 3, G_TYPE_STRING, G_TYPE_STRING,
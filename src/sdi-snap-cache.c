@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-snap-cache.h"
+
+/**
+ * This class keeps a cache of the snap data received from snapd, to avoid
+ * requesting it over and over. There is one entry per snap name, which is
+ * replaced every time new data for that snap is received (for example,
+ * with a new revision), and removed when the owner knows that the snap has
+ * changed (for example, because a Change that affected it has finished).
+ *
+ * Several requests for the same snap done while it is being retrieved are
+ * all answered with a single request to snapd, unless the snap has been
+ * invalidated since that request was sent, and the data of several snaps
+ * can be requested at once.
+ */
+
+struct _SdiSnapCache {
+  GObject parent_instance;
+
+  SnapdClient *client;
+  // the key is the snap name; the value is a SnapdSnap object.
+  GHashTable *snaps;
+  // the key is the snap name; the value is a PendingFetch structure.
+  GHashTable *fetches;
+  // the SnapsFetch structures of the pending requests of several snaps.
+  GPtrArray *snaps_fetches;
+};
+
+G_DEFINE_TYPE(SdiSnapCache, sdi_snap_cache, G_TYPE_OBJECT)
+
+typedef struct {
+  // the GTasks waiting for this snap
+  GPtrArray *tasks;
+  // TRUE if the snap was invalidated while being retrieved
+  gboolean invalidated;
+} PendingFetch;
+
+static void free_pending_fetch(PendingFetch *fetch) {
+  g_ptr_array_unref(fetch->tasks);
+  g_free(fetch);
+}
+
+typedef struct {
+  SdiSnapCache *self;
+  gchar *name;
+  /* owned by `fetches` while it is there; if it is replaced by a newer
+   * fetch, it is owned by this structure.
+   */
+  PendingFetch *fetch;
+} SnapFetchData;
+
+static void free_snap_fetch_data(SnapFetchData *data) {
+  g_clear_object(&data->self);
+  g_free(data->name);
+  g_free(data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(SnapFetchData, free_snap_fetch_data);
+
+typedef struct {
+  GStrv names;
+  /* the key is the snap name; the value is a SnapdSnap object, either
+   * taken from the cache when the request was done, or received from snapd.
+   */
+  GHashTable *snaps;
+  // the names of the snaps invalidated while the request was pending
+  GHashTable *invalidated;
+} SnapsFetch;
+
+static void free_snaps_fetch(SnapsFetch *fetch) {
+  g_strfreev(fetch->names);
+  g_hash_table_unref(fetch->snaps);
+  g_hash_table_unref(fetch->invalidated);
+  g_free(fetch);
+}
+
+static void fetch_snap_cb(GObject *source, GAsyncResult *res, gpointer p) {
+  g_autoptr(SnapFetchData) data = p;
+  SdiSnapCache *self = data->self;
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(SnapdSnap) snap =
+      snapd_client_get_snap_finish(SNAPD_CLIENT(source), res, &error);
+
+  PendingFetch *fetch = data->fetch;
+  if (g_hash_table_lookup(self->fetches, data->name) == fetch) {
+    g_autofree gchar *name = NULL;
+    g_hash_table_steal_extended(self->fetches, data->name, (gpointer *)&name,
+                                NULL);
+  }
+  if ((snap != NULL) && !fetch->invalidated) {
+    sdi_snap_cache_update(self, snap);
+  }
+  for (guint i = 0; i < fetch->tasks->len; i++) {
+    GTask *task = fetch->tasks->pdata[i];
+    if (snap == NULL) {
+      g_task_return_error(task, g_error_copy(error));
+    } else {
+      g_task_return_pointer(task, g_object_ref(snap), g_object_unref);
+    }
+  }
+  free_pending_fetch(fetch);
+}
+
+/**
+ * Returns the cached data for the specified snap, or NULL if it isn't in
+ * the cache.
+ */
+SnapdSnap *sdi_snap_cache_lookup(SdiSnapCache *self, const gchar *name) {
+  g_return_val_if_fail(SDI_IS_SNAP_CACHE(self), NULL);
+
+  SnapdSnap *snap = g_hash_table_lookup(self->snaps, name);
+  return (snap == NULL) ? NULL : g_object_ref(snap);
+}
+
+/**
+ * Stores in the cache new data for a snap, received from snapd by other
+ * means, replacing the old one.
+ */
+void sdi_snap_cache_update(SdiSnapCache *self, SnapdSnap *snap) {
+  g_return_if_fail(SDI_IS_SNAP_CACHE(self));
+  g_return_if_fail(SNAPD_IS_SNAP(snap));
+
+  const gchar *name = snapd_snap_get_name(snap);
+  if (name == NULL) {
+    return;
+  }
+  g_hash_table_insert(self->snaps, g_strdup(name), g_object_ref(snap));
+}
+
+/**
+ * Removes a snap from the cache, because it has changed. If it is being
+ * retrieved now, the result will be returned but not cached.
+ */
+void sdi_snap_cache_invalidate(SdiSnapCache *self, const gchar *name) {
+  g_return_if_fail(SDI_IS_SNAP_CACHE(self));
+
+  g_hash_table_remove(self->snaps, name);
+  PendingFetch *fetch = g_hash_table_lookup(self->fetches, name);
+  if (fetch != NULL) {
+    fetch->invalidated = TRUE;
+  }
+  for (guint i = 0; i < self->snaps_fetches->len; i++) {
+    SnapsFetch *snaps_fetch = self->snaps_fetches->pdata[i];
+    g_hash_table_add(snaps_fetch->invalidated, g_strdup(name));
+  }
+}
+
+/**
+ * Gets the data of a snap, from the cache if it is there, or from snapd
+ * if not.
+ */
+void sdi_snap_cache_get_snap_async(SdiSnapCache *self, const gchar *name,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data) {
+  g_return_if_fail(SDI_IS_SNAP_CACHE(self));
+  g_return_if_fail(name != NULL);
+
+  g_autoptr(GTask) task = g_task_new(self, cancellable, callback, user_data);
+  g_task_set_source_tag(task, sdi_snap_cache_get_snap_async);
+
+  SnapdSnap *snap = g_hash_table_lookup(self->snaps, name);
+  if (snap != NULL) {
+    g_task_return_pointer(task, g_object_ref(snap), g_object_unref);
+    return;
+  }
+
+  PendingFetch *fetch = g_hash_table_lookup(self->fetches, name);
+  if ((fetch != NULL) && !fetch->invalidated) {
+    g_ptr_array_add(fetch->tasks, g_steal_pointer(&task));
+    return;
+  }
+  if (fetch != NULL) {
+    /* The pending fetch was sent before the snap changed, so its data is
+     * old. It will still answer the requests already waiting for it, but
+     * this one needs a new fetch.
+     */
+    g_autofree gchar *old_name = NULL;
+    g_hash_table_steal_extended(self->fetches, name, (gpointer *)&old_name,
+                                NULL);
+  }
+  fetch = g_malloc0(sizeof(PendingFetch));
+  fetch->tasks = g_ptr_array_new_with_free_func(g_object_unref);
+  g_ptr_array_add(fetch->tasks, g_steal_pointer(&task));
+  g_hash_table_insert(self->fetches, g_strdup(name), fetch);
+
+  SnapFetchData *data = g_malloc0(sizeof(SnapFetchData));
+  data->self = g_object_ref(self);
+  data->name = g_strdup(name);
+  data->fetch = fetch;
+  snapd_client_get_snap_async(self->client, name, NULL, fetch_snap_cb, data);
+}
+
+SnapdSnap *sdi_snap_cache_get_snap_finish(SdiSnapCache *self,
+                                          GAsyncResult *result,
+                                          GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/**
+ * Returns, in the same order than `names`, the data of each snap. Snaps
+ * without data are skipped.
+ */
+static void return_snaps(GTask *task) {
+  SnapsFetch *fetch = g_task_get_task_data(task);
+  GPtrArray *snaps = g_ptr_array_new_with_free_func(g_object_unref);
+  for (gchar **name = fetch->names; *name != NULL; name++) {
+    SnapdSnap *snap = g_hash_table_lookup(fetch->snaps, *name);
+    if (snap != NULL) {
+      g_ptr_array_add(snaps, g_object_ref(snap));
+    }
+  }
+  g_task_return_pointer(task, snaps, (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void fetch_snaps_cb(GObject *source, GAsyncResult *res, gpointer p) {
+  g_autoptr(GTask) task = p;
+  SdiSnapCache *self = g_task_get_source_object(task);
+  SnapsFetch *fetch = g_task_get_task_data(task);
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GPtrArray) snaps =
+      snapd_client_get_snaps_finish(SNAPD_CLIENT(source), res, &error);
+  g_ptr_array_remove_fast(self->snaps_fetches, fetch);
+  if (snaps == NULL) {
+    g_task_return_error(task, g_steal_pointer(&error));
+    return;
+  }
+  for (guint i = 0; i < snaps->len; i++) {
+    SnapdSnap *snap = snaps->pdata[i];
+    const gchar *name = snapd_snap_get_name(snap);
+    if (name == NULL) {
+      continue;
+    }
+    // the data of an invalidated snap is returned, but not cached
+    if (!g_hash_table_contains(fetch->invalidated, name)) {
+      sdi_snap_cache_update(self, snap);
+    }
+    g_hash_table_insert(fetch->snaps, g_strdup(name), g_object_ref(snap));
+  }
+  return_snaps(task);
+}
+
+/**
+ * Gets the data of several snaps, requesting to snapd, in a single call,
+ * those that aren't in the cache. The snaps that aren't installed aren't
+ * included in the result.
+ */
+void sdi_snap_cache_get_snaps_async(SdiSnapCache *self, GStrv names,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data) {
+  g_return_if_fail(SDI_IS_SNAP_CACHE(self));
+  g_return_if_fail(names != NULL);
+
+  g_autoptr(GTask) task = g_task_new(self, cancellable, callback, user_data);
+  g_task_set_source_tag(task, sdi_snap_cache_get_snaps_async);
+  SnapsFetch *fetch = g_malloc0(sizeof(SnapsFetch));
+  fetch->names = g_strdupv(names);
+  fetch->snaps =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  fetch->invalidated =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_task_set_task_data(task, fetch, (GDestroyNotify)free_snaps_fetch);
+
+  // the names are owned by the task data
+  g_autoptr(GPtrArray) missing_snaps = g_ptr_array_new();
+  for (gchar **name = fetch->names; *name != NULL; name++) {
+    SnapdSnap *snap = g_hash_table_lookup(self->snaps, *name);
+    if (snap == NULL) {
+      g_ptr_array_add(missing_snaps, *name);
+    } else {
+      g_hash_table_insert(fetch->snaps, g_strdup(*name), g_object_ref(snap));
+    }
+  }
+  if (missing_snaps->len == 0) {
+    return_snaps(task);
+    return;
+  }
+  g_ptr_array_add(missing_snaps, NULL);
+  g_ptr_array_add(self->snaps_fetches, fetch);
+  snapd_client_get_snaps_async(self->client, SNAPD_GET_SNAPS_FLAGS_NONE,
+                               (GStrv)missing_snaps->pdata, cancellable,
+                               fetch_snaps_cb, g_steal_pointer(&task));
+}
+
+GPtrArray *sdi_snap_cache_get_snaps_finish(SdiSnapCache *self,
+                                           GAsyncResult *result,
+                                           GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void sdi_snap_cache_dispose(GObject *object) {
+  SdiSnapCache *self = SDI_SNAP_CACHE(object);
+
+  g_clear_pointer(&self->snaps, g_hash_table_unref);
+  g_clear_pointer(&self->fetches, g_hash_table_unref);
+  g_clear_pointer(&self->snaps_fetches, g_ptr_array_unref);
+  g_clear_object(&self->client);
+
+  G_OBJECT_CLASS(sdi_snap_cache_parent_class)->dispose(object);
+}
+
+static void sdi_snap_cache_init(SdiSnapCache *self) {
+  self->snaps =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->fetches = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)free_pending_fetch);
+  // the fetches are owned by their tasks
+  self->snaps_fetches = g_ptr_array_new();
+}
+
+static void sdi_snap_cache_class_init(SdiSnapCacheClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->dispose = sdi_snap_cache_dispose;
+}
+
+SdiSnapCache *sdi_snap_cache_new(SnapdClient *client) {
+  SdiSnapCache *self = g_object_new(SDI_TYPE_SNAP_CACHE, NULL);
+  self->client = g_object_ref(client);
+  return self;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <snapd-glib/snapd-glib.h>
+
+G_BEGIN_DECLS
+
+#define SDI_TYPE_SNAP_CACHE sdi_snap_cache_get_type()
+
+G_DECLARE_FINAL_TYPE(SdiSnapCache, sdi_snap_cache, SDI, SNAP_CACHE, GObject)
+
+SdiSnapCache *sdi_snap_cache_new(SnapdClient *client);
+
+SnapdSnap *sdi_snap_cache_lookup(SdiSnapCache *self, const gchar *name);
+
+void sdi_snap_cache_update(SdiSnapCache *self, SnapdSnap *snap);
+
+void sdi_snap_cache_invalidate(SdiSnapCache *self, const gchar *name);
+
+void sdi_snap_cache_get_snap_async(SdiSnapCache *self, const gchar *name,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data);
+
+SnapdSnap *sdi_snap_cache_get_snap_finish(SdiSnapCache *self,
+                                          GAsyncResult *result,
+                                          GError **error);
+
+void sdi_snap_cache_get_snaps_async(SdiSnapCache *self, GStrv names,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+
+GPtrArray *sdi_snap_cache_get_snaps_finish(SdiSnapCache *self,
+                                           GAsyncResult *result,
+                                           GError **error);
+
+G_END_DECLS
@@ -25,13 +25,35 @@
  * a custom path, useful for testing. If set, that custom path will
  * be used for any new #snapd_client object created by the factory
  * function.
+ *
+ * Most of the code should use `sdi_snapd_client_factory_get_client()`,
+ * which returns, in turns, one of a small pool of shared clients, to reuse
+ * their connections to snapd. Only code that does long requests that would
+ * block other ones (like waiting for notices) should create its own client
+ * with `sdi_snapd_client_factory_new_snapd_client()`.
  */
 
+/* Number of shared clients, and thus of connections to snapd. */
+#define SNAPD_CLIENT_POOL_SIZE 2
+
 static gchar *sdi_snapd_socket_path = NULL;
 
+static SnapdClient *client_pool[SNAPD_CLIENT_POOL_SIZE];
+// position in the pool of the next client to hand out
+static guint next_pooled_client = 0;
+
+static void clear_client_pool(void) {
+  for (guint i = 0; i < SNAPD_CLIENT_POOL_SIZE; i++) {
+    g_clear_object(&client_pool[i]);
+  }
+  next_pooled_client = 0;
+}
+
 void sdi_snapd_client_factory_set_custom_path(const gchar *path) {
   g_clear_pointer(&sdi_snapd_socket_path, g_free);
   sdi_snapd_socket_path = g_strdup(path);
+  // the shared clients are connected to the old path
+  clear_client_pool();
 }
 
 /**
@@ -45,3 +67,18 @@ SnapdClient *sdi_snapd_client_factory_new_snapd_client(void) {
   }
   return client;
 }
+
+/**
+ * Returns a shared snapd_client object, using the right socket path. The
+ * clients are handed out in turns (round-robin), so the users are spread
+ * between all of them. SnapdClient doesn't tell how many requests are
+ * pending, so the load of each client isn't taken into account.
+ */
+SnapdClient *sdi_snapd_client_factory_get_client(void) {
+  SnapdClient **client = &client_pool[next_pooled_client];
+  next_pooled_client = (next_pooled_client + 1) % SNAPD_CLIENT_POOL_SIZE;
+  if (*client == NULL) {
+    *client = sdi_snapd_client_factory_new_snapd_client();
+  }
+  return g_object_ref(*client);
+}
@@ -25,4 +25,6 @@ void sdi_snapd_client_factory_set_custom_path(const gchar *path);
 
 SnapdClient *sdi_snapd_client_factory_new_snapd_client(void);
 
+SnapdClient *sdi_snapd_client_factory_get_client(void);
+
 G_END_DECLS
@@ -17,80 +17,370 @@
 
 #include "sdi-snapd-monitor.h"
 #include "sdi-helpers.h"
+#include "sdi-latency.h"
 #include "sdi-snapd-client-factory.h"
+#include "sdi-trace.h"
+#include <errno.h>
+#include <glib/gstdio.h>
 #include <unistd.h>
 
 /**
  * This class creates a super-snapd-monitor. It is kept running no matter
  * if the socket to snapd is closed (for example, if snapd is updated)
  *
- * Internally it creates a #snapd_notices_monitor and wait for events.
- * Every received event is re-sent as-is in the `notice_cb` callback, thus
- * outside there is no difference between this class and the original.
+ * Internally it requests the notices to snapd in a loop, and sends each
+ * received notice in the `notice-event` signal, just like a
+ * #snapd_notices_monitor does, thus outside there is no difference between
+ * this class and the original.
  *
- * The difference is that, if the connection between the #snapd_notices_monitor
- * and snapd is severed for whatever reason, #sdi_snapd_monitor will create
- * a new one automagically, and continue to send new events.
+ * The difference is that, if the connection with snapd is severed for
+ * whatever reason, #sdi_snapd_monitor will connect again automagically, and
+ * continue to send new events. It also remembers the date of the last notice
+ * received (the "cursor"), both in memory and in a file in XDG_RUNTIME_DIR,
+ * and asks snapd only for the notices that happened after it. This way,
+ * after a reconnection or a restart of the daemon, the notices already
+ * processed aren't received again, and those that happened in between
+ * aren't lost.
+ *
+ * The received notices aren't relayed immediately, but queued and sent from
+ * an idle callback. In the queue, several notices with the same type and key
+ * (like several `change-update` notices for the same change) are collapsed
+ * into the newest one, and the `refresh-inhibit` notices are sent before the
+ * other ones, because they result in notifications for the user.
  *
  * It also uses `sdi_snapd_client_factory_new_snapd_client()` to obtain a
- * connection to snapd, so it will take into account custom paths.
+ * connection to snapd, so it will take into account custom paths. The same
+ * client is kept after an error, because it opens a new connection for the
+ * next request.
+ */
+
+/* Time, in microseconds, that snapd can wait for a new notice before
+ * answering a request.
  */
+#define NOTICES_TIMEOUT (60 * G_USEC_PER_SEC)
 
-static void error_cb(GObject *object, GError *error, SdiSnapdMonitor *self);
+/* Limits, in ms, of the time to wait before connecting again to snapd after
+ * an error. It is doubled after each failed attempt.
+ */
+#define MIN_RECONNECT_DELAY 100
+#define MAX_RECONNECT_DELAY 10000
 
 struct _SdiSnapdMonitor {
   GObject parent_instance;
 
-  SnapdNoticesMonitor *snapd_monitor;
-  guint signal_notice_id;
-  guint signal_error_id;
+  SnapdClient *client;
+  GCancellable *cancellable;
+  guint reconnect_timer_id;
+  // current reconnection delay, or 0 if the last request succeeded
+  guint reconnect_delay;
+  // watches the snapd socket while disconnected
+  GFileMonitor *socket_monitor;
+  // date of the last notice received; only newer ones will be requested
+  GDateTime *cursor;
+  gint64 cursor_nanoseconds;
+  // file where the cursor is stored between runs, or NULL to not store it
+  gchar *cursor_path;
+  // TRUE until the first set of notices is received, if there was no cursor
+  gboolean first_run;
+  // notice types to request to snapd; if empty, all of them are requested
+  GPtrArray *notice_types;
+  // kinds of the `change-update` notices to relay; if empty, all are relayed
+  GHashTable *change_kinds;
+  // QueuedNotice structures waiting to be relayed, in arrival order
+  GPtrArray *queue;
+  // the key is "type:key"; the value is the QueuedNotice in `queue`
+  GHashTable *queued_notices;
+  guint dispatch_id;
 };
 
 G_DEFINE_TYPE(SdiSnapdMonitor, sdi_snapd_monitor, G_TYPE_OBJECT)
 
-static void notice_cb(GObject *object, SnapdNotice *notice, gboolean first_run,
-                      SdiSnapdMonitor *self) {
-  g_signal_emit_by_name(self, "notice-event", notice, first_run);
+typedef struct {
+  SnapdNotice *notice;
+  gboolean first_run;
+} QueuedNotice;
+
+static void free_queued_notice(QueuedNotice *queued) {
+  g_clear_object(&queued->notice);
+  g_free(queued);
 }
 
-static void configure_snapd_monitor(SdiSnapdMonitor *self) {
-  g_autoptr(SnapdClient) client = sdi_snapd_client_factory_new_snapd_client();
-  self->snapd_monitor = snapd_notices_monitor_new_with_client(client);
-  self->signal_notice_id = g_signal_connect(self->snapd_monitor, "notice-event",
-                                            (GCallback)notice_cb, self);
-  self->signal_error_id = g_signal_connect(self->snapd_monitor, "error-event",
-                                           (GCallback)error_cb, self);
+static void request_notices(SdiSnapdMonitor *self);
+
+static void load_cursor(SdiSnapdMonitor *self) {
+  g_autofree gchar *contents = NULL;
+  if ((self->cursor_path == NULL) ||
+      !g_file_get_contents(self->cursor_path, &contents, NULL, NULL)) {
+    return;
+  }
+  g_auto(GStrv) fields = g_strsplit(g_strstrip(contents), " ", 2);
+  if (g_strv_length(fields) != 2) {
+    return;
+  }
+  g_autoptr(GDateTime) cursor = g_date_time_new_from_iso8601(fields[0], NULL);
+  if (cursor == NULL) {
+    return;
+  }
+  g_clear_pointer(&self->cursor, g_date_time_unref);
+  self->cursor = g_steal_pointer(&cursor);
+  self->cursor_nanoseconds = g_ascii_strtoll(fields[1], NULL, 10);
 }
 
-static void launch_snapd_monitor_after_error(SdiSnapdMonitor *self) {
-  configure_snapd_monitor(self);
-  snapd_notices_monitor_start(self->snapd_monitor, NULL);
+static void save_cursor(SdiSnapdMonitor *self) {
+  if (self->cursor_path == NULL) {
+    return;
+  }
+  g_autofree gchar *folder = g_path_get_dirname(self->cursor_path);
+  g_autofree gchar *date = g_date_time_format_iso8601(self->cursor);
+  g_autofree gchar *contents = g_strdup_printf(
+      "%s %" G_GINT64_FORMAT "\n", date, self->cursor_nanoseconds);
+  g_autoptr(GError) error = NULL;
+
+  if ((g_mkdir_with_parents(folder, 0700) != 0) ||
+      !g_file_set_contents(self->cursor_path, contents, -1, &error)) {
+    g_debug("Failed to store the notices cursor in %s: %s\n",
+            self->cursor_path,
+            (error == NULL) ? g_strerror(errno) : error->message);
+  }
 }
 
-static void error_cb(GObject *object, GError *error, SdiSnapdMonitor *self) {
-  g_debug("Error in sdi-snapd-monitor %d; %s\n", error->code, error->message);
-  g_signal_handler_disconnect(self->snapd_monitor, self->signal_notice_id);
-  g_signal_handler_disconnect(self->snapd_monitor, self->signal_error_id);
-  g_clear_object(&self->snapd_monitor);
-  /* wait one second to ensure that, in case that the error is because snapd is
-   * being replaced, the new instance has created the new socket, and thus avoid
-   * hundreds of error messages until it appears.
-   */
-  g_timeout_add_once(1000, (GSourceOnceFunc)launch_snapd_monitor_after_error,
-                     self);
+/**
+ * Returns TRUE if the notice happened after the cursor. snapd stores the
+ * dates with nanoseconds, but #GDateTime has only microseconds, so the
+ * `after` filter can return again the last notice already received.
+ */
+static gboolean is_after_cursor(SdiSnapdMonitor *self, SnapdNotice *notice) {
+  GDateTime *last_occurred = snapd_notice_get_last_occurred(notice);
+  if ((self->cursor == NULL) || (last_occurred == NULL)) {
+    return TRUE;
+  }
+  gint result = g_date_time_compare(last_occurred, self->cursor);
+  if (result != 0) {
+    return result > 0;
+  }
+  return snapd_notice_get_last_occurred_nanoseconds(notice) >
+         self->cursor_nanoseconds;
+}
+
+/**
+ * Returns TRUE if the notice must be relayed: that is, if it isn't a
+ * `change-update` notice, or if its kind is one of those requested.
+ */
+static gboolean is_wanted(SdiSnapdMonitor *self, SnapdNotice *notice) {
+  if ((g_hash_table_size(self->change_kinds) == 0) ||
+      (snapd_notice_get_notice_type(notice) !=
+       SNAPD_NOTICE_TYPE_CHANGE_UPDATE)) {
+    return TRUE;
+  }
+  GHashTable *notice_data = snapd_notice_get_last_data2(notice);
+  const gchar *kind = g_hash_table_lookup(notice_data, "kind");
+  return (kind != NULL) && g_hash_table_contains(self->change_kinds, kind);
+}
+
+static void emit_queued_notices(SdiSnapdMonitor *self, GPtrArray *queue,
+                                gboolean refresh_inhibit) {
+  for (guint i = 0; i < queue->len; i++) {
+    QueuedNotice *queued = queue->pdata[i];
+    if ((snapd_notice_get_notice_type(queued->notice) ==
+         SNAPD_NOTICE_TYPE_REFRESH_INHIBIT) == refresh_inhibit) {
+      g_signal_emit_by_name(self, "notice-event", queued->notice,
+                            queued->first_run);
+    }
+  }
+}
+
+static void dispatch_notices(SdiSnapdMonitor *self) {
+  self->dispatch_id = 0;
+
+  g_autoptr(GPtrArray) queue = g_steal_pointer(&self->queue);
+  self->queue =
+      g_ptr_array_new_with_free_func((GDestroyNotify)free_queued_notice);
+  g_hash_table_remove_all(self->queued_notices);
+
+  emit_queued_notices(self, queue, TRUE);
+  emit_queued_notices(self, queue, FALSE);
+}
+
+/**
+ * Adds a notice to the queue of notices to relay, replacing any other
+ * with the same type and key.
+ */
+static void queue_notice(SdiSnapdMonitor *self, SnapdNotice *notice,
+                         gboolean first_run) {
+  g_autofree gchar *id =
+      g_strdup_printf("%d:%s", snapd_notice_get_notice_type(notice),
+                      snapd_notice_get_key(notice));
+  QueuedNotice *queued = g_hash_table_lookup(self->queued_notices, id);
+  if (queued != NULL) {
+    g_set_object(&queued->notice, notice);
+    queued->first_run = first_run;
+    return;
+  }
+  queued = g_malloc0(sizeof(QueuedNotice));
+  queued->notice = g_object_ref(notice);
+  queued->first_run = first_run;
+  g_ptr_array_add(self->queue, queued);
+  g_hash_table_insert(self->queued_notices, g_steal_pointer(&id), queued);
+
+  if (self->dispatch_id == 0) {
+    self->dispatch_id =
+        g_idle_add_once((GSourceOnceFunc)dispatch_notices, self);
+  }
+}
+
+static void reconnect(SdiSnapdMonitor *self) {
+  self->reconnect_timer_id = 0;
+  request_notices(self);
+}
+
+static void socket_changed_cb(GFileMonitor *monitor, GFile *file,
+                              GFile *other_file, GFileMonitorEvent event,
+                              SdiSnapdMonitor *self) {
+  if ((event != G_FILE_MONITOR_EVENT_CREATED) ||
+      (self->reconnect_timer_id == 0)) {
+    return;
+  }
+  // snapd is back, so there is no need to wait
+  g_clear_handle_id(&self->reconnect_timer_id, g_source_remove);
+  request_notices(self);
+}
+
+/**
+ * Schedules a new connection to snapd after an error. The delay doubles
+ * after each failed attempt, to avoid flooding snapd while it is being
+ * restarted, and has a random part to avoid several clients connecting at
+ * the same time. But the socket is also watched, so if it is created again
+ * the connection is done immediately.
+ */
+static void schedule_reconnect(SdiSnapdMonitor *self) {
+  self->reconnect_delay =
+      (self->reconnect_delay == 0)
+          ? MIN_RECONNECT_DELAY
+          : MIN(self->reconnect_delay * 2, MAX_RECONNECT_DELAY);
+  guint delay = self->reconnect_delay / 2 +
+                g_random_int_range(0, self->reconnect_delay / 2 + 1);
+  self->reconnect_timer_id =
+      g_timeout_add_once(delay, (GSourceOnceFunc)reconnect, self);
+
+  if (self->socket_monitor == NULL) {
+    // snapd-glib chooses the socket path, so ask the client for it
+    g_autoptr(GFile) socket =
+        g_file_new_for_path(snapd_client_get_socket_path(self->client));
+    g_autoptr(GError) error = NULL;
+    self->socket_monitor =
+        g_file_monitor_file(socket, G_FILE_MONITOR_NONE, NULL, &error);
+    if (self->socket_monitor == NULL) {
+      g_debug("Failed to watch the snapd socket: %s\n", error->message);
+    } else {
+      g_signal_connect(self->socket_monitor, "changed",
+                       (GCallback)socket_changed_cb, self);
+    }
+  }
+#ifdef DEBUG_TESTS
+  g_signal_emit_by_name(self, "reconnect-scheduled", self->reconnect_delay);
+#endif
+}
+
+static void notices_cb(GObject *source, GAsyncResult *res, gpointer p) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) notices =
+      snapd_client_get_notices_finish(SNAPD_CLIENT(source), res, &error);
+
+  // if cancelled, the monitor has been disposed, so don't touch it
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    return;
+  }
+  SdiSnapdMonitor *self = p;
+
+  if (error != NULL) {
+    g_debug("Error in sdi-snapd-monitor %d; %s\n", error->code,
+            error->message);
+    schedule_reconnect(self);
+    return;
+  }
+  self->reconnect_delay = 0;
+  g_clear_object(&self->socket_monitor);
+
+  gboolean first_run = self->first_run;
+  gboolean cursor_moved = FALSE;
+  self->first_run = FALSE;
+  for (guint i = 0; i < notices->len; i++) {
+    SnapdNotice *notice = notices->pdata[i];
+    if (!is_after_cursor(self, notice)) {
+      continue;
+    }
+    GDateTime *last_occurred = snapd_notice_get_last_occurred(notice);
+    if (last_occurred != NULL) {
+      g_clear_pointer(&self->cursor, g_date_time_unref);
+      self->cursor = g_date_time_ref(last_occurred);
+      self->cursor_nanoseconds =
+          snapd_notice_get_last_occurred_nanoseconds(notice);
+      cursor_moved = TRUE;
+    }
+    if (is_wanted(self, notice)) {
+      sdi_trace_record_notice(notice);
+      sdi_latency_notice_received(notice);
+      queue_notice(self, notice, first_run);
+    }
+  }
+  if (cursor_moved) {
+    save_cursor(self);
+  }
+  request_notices(self);
+}
+
+static void request_notices(SdiSnapdMonitor *self) {
+  if (self->client == NULL) {
+    /* the request waits until there are new notices, so it would block
+     * other requests sent through a shared client.
+     */
+    self->client = sdi_snapd_client_factory_new_snapd_client();
+  }
+  g_autoptr(GString) types = NULL;
+  for (guint i = 0; i < self->notice_types->len; i++) {
+    if (types == NULL) {
+      types = g_string_new(self->notice_types->pdata[i]);
+    } else {
+      g_string_append_printf(types, ",%s",
+                             (gchar *)self->notice_types->pdata[i]);
+    }
+  }
+  snapd_client_get_notices_with_filters_async(
+      self->client, NULL, NULL, (types == NULL) ? NULL : types->str, NULL,
+      self->cursor, NOTICES_TIMEOUT, self->cancellable, notices_cb, self);
 }
 
 static void sdi_snapd_monitor_dispose(GObject *object) {
   SdiSnapdMonitor *self = SDI_SNAPD_MONITOR(object);
 
-  snapd_notices_monitor_stop(self->snapd_monitor, NULL);
-  g_clear_object(&self->snapd_monitor);
+  g_cancellable_cancel(self->cancellable);
+  g_clear_handle_id(&self->reconnect_timer_id, g_source_remove);
+  g_clear_object(&self->socket_monitor);
+  g_clear_object(&self->cancellable);
+  g_clear_object(&self->client);
+  g_clear_pointer(&self->cursor, g_date_time_unref);
+  g_clear_pointer(&self->cursor_path, g_free);
+  g_clear_pointer(&self->notice_types, g_ptr_array_unref);
+  g_clear_pointer(&self->change_kinds, g_hash_table_unref);
+  g_clear_handle_id(&self->dispatch_id, g_source_remove);
+  g_clear_pointer(&self->queued_notices, g_hash_table_unref);
+  g_clear_pointer(&self->queue, g_ptr_array_unref);
 
   G_OBJECT_CLASS(sdi_snapd_monitor_parent_class)->dispose(object);
 }
 
 static void sdi_snapd_monitor_init(SdiSnapdMonitor *self) {
-  configure_snapd_monitor(self);
+  self->cancellable = g_cancellable_new();
+  self->cursor_path =
+      g_build_filename(g_get_user_runtime_dir(), "snapd-desktop-integration",
+                       "notices-cursor", NULL);
+  self->notice_types = g_ptr_array_new_with_free_func(g_free);
+  self->change_kinds = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                             NULL);
+  self->queue =
+      g_ptr_array_new_with_free_func((GDestroyNotify)free_queued_notice);
+  self->queued_notices =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void sdi_snapd_monitor_class_init(SdiSnapdMonitorClass *klass) {
@@ -101,15 +391,65 @@ static void sdi_snapd_monitor_class_init(SdiSnapdMonitorClass *klass) {
   g_signal_new("notice-event", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
                NULL, NULL, NULL, G_TYPE_NONE, 2, SNAPD_TYPE_NOTICE,
                G_TYPE_BOOLEAN);
+#ifdef DEBUG_TESTS
+  g_signal_new("reconnect-scheduled", G_TYPE_FROM_CLASS(klass),
+               G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1,
+               G_TYPE_UINT);
+#endif
 }
 
 SdiSnapdMonitor *sdi_snapd_monitor_new(void) {
   return g_object_new(SDI_TYPE_SNAPD_MONITOR, NULL);
 }
 
+/**
+ * Adds a notice type (like "change-update") to the list of types requested
+ * to snapd. If no type is added, all the notices are received.
+ */
+void sdi_snapd_monitor_add_notice_type(SdiSnapdMonitor *self,
+                                       const gchar *type) {
+  g_return_if_fail(SDI_IS_SNAPD_MONITOR(self));
+
+  for (guint i = 0; i < self->notice_types->len; i++) {
+    if (g_strcmp0(self->notice_types->pdata[i], type) == 0) {
+      return;
+    }
+  }
+  g_ptr_array_add(self->notice_types, g_strdup(type));
+}
+
+/**
+ * Adds a change kind (like "auto-refresh") to the list of `change-update`
+ * notices that are relayed. If no kind is added, all of them are relayed.
+ */
+void sdi_snapd_monitor_add_change_kind(SdiSnapdMonitor *self,
+                                       const gchar *kind) {
+  g_return_if_fail(SDI_IS_SNAPD_MONITOR(self));
+
+  g_hash_table_add(self->change_kinds, g_strdup(kind));
+}
+
+/**
+ * Sets the file where the cursor is stored between runs, instead of the
+ * default one in XDG_RUNTIME_DIR. If it is NULL, the cursor isn't stored,
+ * so all the notices in snapd are received again after a restart.
+ */
+void sdi_snapd_monitor_set_cursor_path(SdiSnapdMonitor *self,
+                                       const gchar *path) {
+  g_return_if_fail(SDI_IS_SNAPD_MONITOR(self));
+
+  g_clear_pointer(&self->cursor_path, g_free);
+  self->cursor_path = g_strdup(path);
+}
+
 bool sdi_snapd_monitor_start(SdiSnapdMonitor *self) {
   g_return_val_if_fail(SDI_IS_SNAPD_MONITOR(self), false);
 
-  snapd_notices_monitor_start(self->snapd_monitor, NULL);
+  /* If there is a cursor from a previous run, the notices after it are new,
+   * so they must be processed like any other.
+   */
+  load_cursor(self);
+  self->first_run = (self->cursor == NULL);
+  request_notices(self);
   return true;
 }
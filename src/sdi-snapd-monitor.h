@@ -29,6 +29,15 @@ G_DECLARE_FINAL_TYPE(SdiSnapdMonitor, sdi_snapd_monitor, SDI, SNAPD_MONITOR,
 
 SdiSnapdMonitor *sdi_snapd_monitor_new(void);
 
+void sdi_snapd_monitor_add_notice_type(SdiSnapdMonitor *self,
+                                       const gchar *type);
+
+void sdi_snapd_monitor_add_change_kind(SdiSnapdMonitor *self,
+                                       const gchar *kind);
+
+void sdi_snapd_monitor_set_cursor_path(SdiSnapdMonitor *self,
+                                       const gchar *path);
+
 bool sdi_snapd_monitor_start(SdiSnapdMonitor *self);
 
 G_END_DECLS
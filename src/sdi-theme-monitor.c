@@ -18,9 +18,10 @@
 #include "sdi-theme-monitor.h"
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
-#include <libnotify/notify.h>
 #include <stdbool.h>
 
+#include "sdi-fdo-notification.h"
+
 struct _SdiThemeMonitor {
   GObject parent_instance;
 
@@ -41,9 +42,9 @@ struct _SdiThemeMonitor {
   SnapdThemeStatus sound_theme_status;
 
   /* The desktop notifications */
-  NotifyNotification *install_notification;
+  SdiFdoNotification *install_notification;
   bool install_notification_answered;
-  NotifyNotification *progress_notification;
+  SdiFdoNotification *progress_notification;
 
   // Connection to snapd.
   SnapdClient *client;
@@ -63,7 +64,7 @@ static void install_themes_cb(GObject *object, GAsyncResult *result,
   if (snapd_client_install_themes_finish(SNAPD_CLIENT(object), result,
                                          &error)) {
     g_message("Installation complete.\n");
-    notify_notification_update(
+    sdi_fdo_notification_update(
         self->progress_notification, _("Installing missing theme snaps:"),
         /// TRANSLATORS: installing a missing theme snap succeed
         _("Complete."), "dialog-information");
@@ -80,23 +81,23 @@ static void install_themes_cb(GObject *object, GAsyncResult *result,
       error_message = _("Failed.");
       break;
     }
-    notify_notification_update(self->progress_notification,
-                               _("Installing missing theme snaps:"),
-                               error_message, "dialog-information");
+    sdi_fdo_notification_update(self->progress_notification,
+                                _("Installing missing theme snaps:"),
+                                error_message, "dialog-information");
   }
 
-  notify_notification_show(self->progress_notification, NULL);
+  sdi_fdo_notification_show(self->progress_notification);
   g_clear_object(&self->progress_notification);
 }
 
-static void notification_closed_cb(NotifyNotification *notification,
+static void notification_closed_cb(SdiFdoNotification *notification,
                                    SdiThemeMonitor *self) {
   /* Notification has been closed: */
   g_clear_object(&self->install_notification);
   self->install_notification_answered = false;
 }
 
-static void notify_cb(NotifyNotification *notification, gchar *action,
+static void notify_cb(SdiFdoNotification *notification, gchar *action,
                       gpointer user_data) {
   SdiThemeMonitor *self = user_data;
 
@@ -118,9 +119,9 @@ static void notify_cb(NotifyNotification *notification, gchar *action,
   self->install_notification_answered = true;
   if ((strcmp(action, "yes") == 0) || (strcmp(action, "default") == 0)) {
     g_message("Installing missing theme snaps...\n");
-    self->progress_notification = notify_notification_new(
+    self->progress_notification = sdi_fdo_notification_new(
         _("Installing missing theme snaps:"), "...", "dialog-information");
-    notify_notification_show(self->progress_notification, NULL);
+    sdi_fdo_notification_show(self->progress_notification);
 
     g_autoptr(GPtrArray) gtk_theme_names = g_ptr_array_new();
     if (self->gtk_theme_status == SNAPD_THEME_STATUS_AVAILABLE) {
@@ -153,27 +154,27 @@ static void show_install_notification(SdiThemeMonitor *self) {
     return;
   }
 
-  self->install_notification = notify_notification_new(
+  self->install_notification = sdi_fdo_notification_new(
       _("Some required theme snaps are missing."),
       _("Would you like to install them now?"), "dialog-question");
   g_signal_connect(self->install_notification, "closed",
                    G_CALLBACK(notification_closed_cb), self);
-  notify_notification_set_timeout(self->install_notification,
-                                  NOTIFY_EXPIRES_NEVER);
-  notify_notification_add_action(
+  sdi_fdo_notification_set_timeout(self->install_notification,
+                                   SDI_FDO_NOTIFICATION_EXPIRES_NEVER);
+  sdi_fdo_notification_add_action(
       self->install_notification, "yes",
       /// TRANSLATORS: answer to the question "Would you like to install them
       /// now?" referred to snap themes
       _("Yes"), notify_cb, self, NULL);
-  notify_notification_add_action(
+  sdi_fdo_notification_add_action(
       self->install_notification, "no",
       /// TRANSLATORS: answer to the question "Would you like to install them
       /// now?" referred to snap themes
       _("No"), notify_cb, self, NULL);
-  notify_notification_add_action(self->install_notification, "default",
-                                 "default", notify_cb, self, NULL);
+  sdi_fdo_notification_add_action(self->install_notification, "default",
+                                  "default", notify_cb, self, NULL);
 
-  notify_notification_show(self->install_notification, NULL);
+  sdi_fdo_notification_show(self->install_notification);
 }
 
 static void check_themes_cb(GObject *object, GAsyncResult *result,
@@ -317,6 +318,12 @@ static void sdi_theme_monitor_dispose(GObject *object) {
   g_clear_pointer(&self->icon_theme_name, g_free);
   g_clear_pointer(&self->cursor_theme_name, g_free);
   g_clear_pointer(&self->sound_theme_name, g_free);
+  if (self->install_notification != NULL) {
+    // the actions and the handler point to `self` without a ref
+    g_signal_handlers_disconnect_by_data(self->install_notification, self);
+    sdi_fdo_notification_clear_actions(self->install_notification);
+    sdi_fdo_notification_close(self->install_notification);
+  }
   g_clear_object(&self->install_notification);
   g_clear_object(&self->progress_notification);
   g_clear_object(&self->client);
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sdi-trace.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+/**
+ * This module records the notices received from snapd, and the data that
+ * the daemon requested to snapd because of them, into a trace file. That
+ * file can be replayed later against the mock snapd with the
+ * `replay-refresh-monitor` tool, to reproduce and benchmark a real refresh.
+ *
+ * The trace is a text file, with one record per line, and the fields
+ * separated by tabs. The first field is the record type, and the second one
+ * the time, in ms, since the recording started. The strings are escaped
+ * with g_strescape(). The records are:
+ *
+ *   start <wall clock time when the recording started>
+ *   notice <time> <type> <key> <change kind>
+ *   change <time> <id> <kind> <status> <number of tasks> <refresh snaps>
+ *   task <status> <done> <total> <summary> <affected snaps>
+ *   snap <time> <name> <proceed time>
+ *
+ * Each `change` record is followed by its `task` records. The refresh snaps
+ * (the ones listed in the data of an auto-refresh change) and the affected
+ * snaps are separated by commas.
+ *
+ * If no trace has been started, the record functions do nothing.
+ */
+
+static FILE *trace_file = NULL;
+static gint64 start_time = 0;
+
+/**
+ * Starts recording into the specified file, replacing it if it exists.
+ */
+gboolean sdi_trace_start(const gchar *path, GError **error) {
+  sdi_trace_stop();
+  trace_file = g_fopen(path, "w");
+  if (trace_file == NULL) {
+    int saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "Failed to create the trace file %s: %s", path,
+                g_strerror(saved_errno));
+    return FALSE;
+  }
+  start_time = g_get_monotonic_time();
+  g_autoptr(GDateTime) now = g_date_time_new_now_utc();
+  g_autofree gchar *date = g_date_time_format_iso8601(now);
+  fprintf(trace_file, "start\t%s\n", date);
+  fflush(trace_file);
+  return TRUE;
+}
+
+void sdi_trace_stop(void) {
+  if (trace_file == NULL) {
+    return;
+  }
+  fclose(trace_file);
+  trace_file = NULL;
+}
+
+/**
+ * Escapes a field of a record. The fields not sent by snapd are stored as
+ * empty strings.
+ */
+static gchar *escape(const gchar *value) {
+  return g_strescape((value == NULL) ? "" : value, NULL);
+}
+
+static gchar *join_snaps(GStrv snaps) {
+  g_autofree gchar *joined =
+      (snaps == NULL) ? g_strdup("") : g_strjoinv(",", snaps);
+  return escape(joined);
+}
+
+static gint64 get_time(void) {
+  return (g_get_monotonic_time() - start_time) / 1000;
+}
+
+static const gchar *get_notice_type_name(SnapdNoticeType type) {
+  switch (type) {
+  case SNAPD_NOTICE_TYPE_CHANGE_UPDATE:
+    return "change-update";
+  case SNAPD_NOTICE_TYPE_REFRESH_INHIBIT:
+    return "refresh-inhibit";
+  case SNAPD_NOTICE_TYPE_SNAP_RUN_INHIBIT:
+    return "snap-run-inhibit";
+  default:
+    return NULL;
+  }
+}
+
+void sdi_trace_record_notice(SnapdNotice *notice) {
+  if (trace_file == NULL) {
+    return;
+  }
+  const gchar *type =
+      get_notice_type_name(snapd_notice_get_notice_type(notice));
+  if (type == NULL) {
+    return;
+  }
+  GHashTable *notice_data = snapd_notice_get_last_data2(notice);
+  const gchar *kind = g_hash_table_lookup(notice_data, "kind");
+  g_autofree gchar *key = escape(snapd_notice_get_key(notice));
+  g_autofree gchar *escaped_kind = escape(kind);
+  fprintf(trace_file, "notice\t%" G_GINT64_FORMAT "\t%s\t%s\t%s\n", get_time(),
+          type, key, escaped_kind);
+  fflush(trace_file);
+}
+
+void sdi_trace_record_change(SnapdChange *change) {
+  if (trace_file == NULL) {
+    return;
+  }
+  GPtrArray *tasks = snapd_change_get_tasks(change);
+  g_autofree gchar *id = escape(snapd_change_get_id(change));
+  g_autofree gchar *kind = escape(snapd_change_get_kind(change));
+  g_autofree gchar *status = escape(snapd_change_get_status(change));
+  SnapdChangeData *change_data = snapd_change_get_data(change);
+  GStrv snap_names = NULL;
+  if ((change_data != NULL) && SNAPD_IS_AUTOREFRESH_CHANGE_DATA(change_data)) {
+    snap_names = snapd_autorefresh_change_data_get_snap_names(
+        SNAPD_AUTOREFRESH_CHANGE_DATA(change_data));
+  }
+  g_autofree gchar *refresh_snaps = join_snaps(snap_names);
+  fprintf(trace_file, "change\t%" G_GINT64_FORMAT "\t%s\t%s\t%s\t%u\t%s\n",
+          get_time(), id, kind, status, tasks->len, refresh_snaps);
+
+  for (guint i = 0; i < tasks->len; i++) {
+    SnapdTask *task = tasks->pdata[i];
+    SnapdTaskData *task_data = snapd_task_get_data(task);
+    GStrv affected_snaps = (task_data == NULL)
+                               ? NULL
+                               : snapd_task_data_get_affected_snaps(task_data);
+    g_autofree gchar *task_status = escape(snapd_task_get_status(task));
+    g_autofree gchar *summary = escape(snapd_task_get_summary(task));
+    g_autofree gchar *snaps = join_snaps(affected_snaps);
+    fprintf(trace_file, "task\t%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT
+            "\t%s\t%s\n",
+            task_status, snapd_task_get_progress_done(task),
+            snapd_task_get_progress_total(task), summary, snaps);
+  }
+  fflush(trace_file);
+}
+
+void sdi_trace_record_inhibited_snap(SnapdSnap *snap) {
+  if (trace_file == NULL) {
+    return;
+  }
+  GDateTime *proceed_time = snapd_snap_get_proceed_time(snap);
+  g_autofree gchar *name = escape(snapd_snap_get_name(snap));
+  g_autofree gchar *date = (proceed_time == NULL)
+                               ? g_strdup("")
+                               : g_date_time_format_iso8601(proceed_time);
+  fprintf(trace_file, "snap\t%" G_GINT64_FORMAT "\t%s\t%s\n", get_time(), name,
+          date);
+  fflush(trace_file);
+}
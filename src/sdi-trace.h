@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <snapd-glib/snapd-glib.h>
+
+G_BEGIN_DECLS
+
+gboolean sdi_trace_start(const gchar *path, GError **error);
+
+void sdi_trace_stop(void);
+
+void sdi_trace_record_notice(SnapdNotice *notice);
+
+void sdi_trace_record_change(SnapdChange *change);
+
+void sdi_trace_record_inhibited_snap(SnapdSnap *snap);
+
+G_END_DECLS
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Code shared by the programs that measure the cost of processing refreshes
+ * with the mock snapd.
+ */
+
+#include "benchmark-helpers.h"
+
+#include <time.h>
+
+/**
+ * Creates and starts a notices monitor, like the one used by the daemon, that
+ * sends every notice to the refresh monitor. The cursor isn't stored, to not
+ * replace the one of the daemon and to receive again the notices of the mock
+ * snapd in each run.
+ */
+SdiSnapdMonitor *benchmark_start_notices_monitor(SdiRefreshMonitor *monitor) {
+  SdiSnapdMonitor *notices_monitor = sdi_snapd_monitor_new();
+  sdi_snapd_monitor_set_cursor_path(notices_monitor, NULL);
+  g_signal_connect(notices_monitor, "notice-event",
+                   (GCallback)benchmark_notice_cb, monitor);
+  sdi_snapd_monitor_start(notices_monitor);
+  return notices_monitor;
+}
+
+/**
+ * Relays a notice to the refresh monitor. The notices can be created before
+ * the first request is answered, so they are never considered old ones.
+ */
+void benchmark_notice_cb(GObject *object, SnapdNotice *notice,
+                         gboolean first_run, SdiRefreshMonitor *monitor) {
+  sdi_refresh_monitor_notice(monitor, notice, FALSE);
+}
+
+/**
+ * Returns the CPU time, in microseconds, used by the calling thread. The mock
+ * snapd runs in its own thread, so it isn't included.
+ */
+gint64 benchmark_get_thread_cpu_time(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return time.tv_sec * G_USEC_PER_SEC + time.tv_nsec / 1000;
+}
+
+void benchmark_set_flag_cb(gpointer data) { *((gboolean *)data) = TRUE; }
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "../src/sdi-refresh-monitor.h"
+#include "../src/sdi-snapd-monitor.h"
+
+G_BEGIN_DECLS
+
+SdiSnapdMonitor *benchmark_start_notices_monitor(SdiRefreshMonitor *monitor);
+
+void benchmark_notice_cb(GObject *object, SnapdNotice *notice,
+                         gboolean first_run, SdiRefreshMonitor *monitor);
+
+gint64 benchmark_get_thread_cpu_time(void);
+
+void benchmark_set_flag_cb(gpointer data);
+
+G_END_DECLS
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Benchmark for the change processing path of the refresh monitor.
+ *
+ * It creates several auto-refresh changes in the mock snapd, each one with
+ * several snaps and several tasks per snap, and sends a "change-update"
+ * notice for each one. Then, in each round, one task of every snap is marked
+ * as done, and the benchmark waits until the refresh monitor has polled the
+ * changes and emitted the new progress for every snap.
+ *
+ * For each round it reports the CPU time used by the main thread (the mock
+ * snapd runs in its own thread, so it isn't included), the net growth of the
+ * heap, and the number of signals emitted by the refresh monitor. The heap
+ * growth doesn't include the memory allocated and freed during the round, and
+ * it is only available with glibc 2.33 or later; otherwise, "n/a" is shown.
+ */
+
+#include "../src/sdi-refresh-monitor.h"
+#include "../src/sdi-snapd-client-factory.h"
+#include "benchmark-helpers.h"
+#include "mock-snapd.h"
+
+#include <malloc.h>
+
+// __GLIBC_PREREQ is only defined by glibc
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+#define HAVE_MALLINFO2
+#endif
+#endif
+
+static gint n_snaps = 10;
+static gint n_tasks = 5;
+static gint n_changes = 4;
+static gint poll_interval = 10;
+
+static GOptionEntry entries[] = {
+    {"snaps", 's', 0, G_OPTION_ARG_INT, &n_snaps, "Snaps per change", "N"},
+    {"tasks", 't', 0, G_OPTION_ARG_INT, &n_tasks, "Tasks per snap", "N"},
+    {"changes", 'c', 0, G_OPTION_ARG_INT, &n_changes, "Concurrent changes",
+     "N"},
+    {"poll-interval", 'p', 0, G_OPTION_ARG_INT, &poll_interval,
+     "Time in ms between checks of a change", "MS"},
+    {NULL}};
+
+static guint n_signals = 0;
+static guint n_progress_signals = 0;
+static guint n_finished_snaps = 0;
+
+static void refresh_progress_cb(GObject *object, gchar *snap_name,
+                                GStrv desktop_files, gchar *task_description,
+                                guint done_tasks, guint total_tasks,
+                                gboolean task_done) {
+  n_signals++;
+  n_progress_signals++;
+  if (task_done) {
+    n_finished_snaps++;
+  }
+}
+
+static void count_signal_cb(GObject *object) { n_signals++; }
+
+static gssize get_heap_size(void) {
+#ifdef HAVE_MALLINFO2
+  return mallinfo2().uordblks;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * Returns the net growth of the heap since it had @heap_size bytes, or "n/a"
+ * if the size of the heap isn't known.
+ */
+static gchar *format_heap_growth(gssize heap_size) {
+  if (heap_size < 0) {
+    return g_strdup("n/a");
+  }
+  return g_strdup_printf("%" G_GSSIZE_FORMAT, get_heap_size() - heap_size);
+}
+
+static void add_notice(MockSnapd *snapd, MockChange *change) {
+  static int counter = 1;
+  g_autofree gchar *id = g_strdup_printf("%d", counter++);
+  MockNotice *notice = mock_snapd_add_notice(
+      snapd, id, mock_change_get_id(change), "change-update");
+  g_autoptr(GTimeZone) timezone = g_time_zone_new_utc();
+  g_autoptr(GDateTime) date = g_date_time_new(timezone, 2024, 3, 1, 0, 0, 0);
+  mock_notice_set_dates(notice, date, date, date, 1);
+  mock_notice_add_data_pair(notice, "kind", "auto-refresh");
+}
+
+/* Iterates the main loop until `counter` reaches `value`, or ten seconds
+ * have passed. Returns FALSE in the later case.
+ */
+static gboolean wait_for_counter(guint *counter, guint value) {
+  gboolean expired = FALSE;
+  guint timeout_id =
+      g_timeout_add_once(10000, benchmark_set_flag_cb, &expired);
+  while ((*counter < value) && !expired) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  if (!expired) {
+    g_source_remove(timeout_id);
+  }
+  return !expired;
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the refresh monitor");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_autoptr(GError) error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if ((n_snaps < 1) || (n_tasks < 1) || (n_changes < 1) ||
+      (poll_interval < 1)) {
+    g_printerr("All the values must be greater than zero\n");
+    return 1;
+  }
+
+  g_autoptr(MockSnapd) snapd = mock_snapd_new();
+  sdi_snapd_client_factory_set_custom_path(
+      (gchar *)mock_snapd_get_socket_path(snapd));
+
+  // the tasks are stored as [change][task][snap]
+  g_autofree MockTask **tasks =
+      g_malloc0_n(n_changes * n_tasks * n_snaps, sizeof(MockTask *));
+  g_autoptr(GPtrArray) changes = g_ptr_array_new();
+  for (gint c = 0; c < n_changes; c++) {
+    MockChange *change = mock_snapd_add_change(snapd);
+    mock_change_set_kind(change, "auto-refresh");
+    for (gint t = 0; t < n_tasks; t++) {
+      for (gint s = 0; s < n_snaps; s++) {
+        g_autofree gchar *snap_name = g_strdup_printf("snap-%d-%d", c, s);
+        if (t == 0) {
+          mock_snapd_add_snap(snapd, snap_name);
+        }
+        MockTask *task = mock_change_add_task(change, "download");
+        mock_task_add_affected_snap(task, snap_name);
+        mock_task_set_progress(task, 0, 1);
+        tasks[(c * n_tasks + t) * n_snaps + s] = task;
+      }
+    }
+    g_ptr_array_add(changes, change);
+  }
+
+  if (!mock_snapd_start(snapd, &error)) {
+    g_printerr("Failed to start mock snapd: %s\n", error->message);
+    return 1;
+  }
+
+  g_autoptr(SdiRefreshMonitor) refresh_monitor = sdi_refresh_monitor_new();
+  g_object_set(refresh_monitor, "min-poll-interval", poll_interval,
+               "max-poll-interval", poll_interval, NULL);
+  g_signal_connect(refresh_monitor, "refresh-progress",
+                   (GCallback)refresh_progress_cb, NULL);
+  const gchar *other_signals[] = {"notify-pending-refresh",
+                                  "notify-pending-refresh-forced",
+                                  "notify-refresh-complete",
+                                  "notify-refresh-complete-multiple",
+                                  "begin-refresh",
+                                  "end-refresh",
+                                  NULL};
+  for (const gchar **signal = other_signals; *signal != NULL; signal++) {
+    g_signal_connect(refresh_monitor, *signal, (GCallback)count_signal_cb,
+                     NULL);
+  }
+
+  g_autoptr(SdiSnapdMonitor) notices_monitor =
+      benchmark_start_notices_monitor(refresh_monitor);
+
+  guint total_snaps = n_snaps * n_changes;
+  g_print("%d changes x %d snaps x %d tasks, polling every %d ms\n", n_changes,
+          n_snaps, n_tasks, poll_interval);
+  g_print("%6s %12s %16s %8s\n", "round", "cpu (us)", "net heap growth",
+          "signals");
+
+  for (guint c = 0; c < changes->len; c++) {
+    add_notice(snapd, changes->pdata[c]);
+  }
+  // the first round is the initial processing of each change
+  gint64 total_cpu = 0;
+  for (gint round = 0; round <= n_tasks; round++) {
+    if (round > 0) {
+      for (gint c = 0; c < n_changes; c++) {
+        for (gint s = 0; s < n_snaps; s++) {
+          MockTask *task = tasks[(c * n_tasks + round - 1) * n_snaps + s];
+          mock_task_set_progress(task, 1, 1);
+          mock_task_set_status(task, "Done");
+        }
+      }
+    }
+    guint signals = n_signals;
+    gint64 cpu = benchmark_get_thread_cpu_time();
+    gssize heap = get_heap_size();
+
+    gboolean completed =
+        (round == n_tasks)
+            ? wait_for_counter(&n_finished_snaps, total_snaps)
+            : wait_for_counter(&n_progress_signals, total_snaps * (round + 1));
+    if (!completed) {
+      g_printerr("Timeout waiting for the progress of round %d\n", round);
+      return 1;
+    }
+
+    cpu = benchmark_get_thread_cpu_time() - cpu;
+    total_cpu += cpu;
+    g_autofree gchar *heap_growth = format_heap_growth(heap);
+    g_print("%6d %12" G_GINT64_FORMAT " %16s %8u\n", round, cpu, heap_growth,
+            n_signals - signals);
+  }
+  g_print("total cpu: %" G_GINT64_FORMAT " us; mean per round: "
+          "%" G_GINT64_FORMAT " us; signals: %u\n",
+          total_cpu, total_cpu / (n_tasks + 1), n_signals);
+
+  mock_snapd_stop(snapd);
+  return 0;
+}
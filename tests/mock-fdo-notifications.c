@@ -50,7 +50,9 @@
  * expired.
  *
  * Another method is `mock_fdo_notifications_send_action()`, which allows to
- * emulate the user clicking on an action of a notification.
+ * emulate the user clicking on an action of a notification, and
+ * `mock_fdo_notifications_wait_for_close()` allows to check that the client
+ * has asked to close one.
  *
  * Finally, the object can emit the `notification-closed` signal when the
  * notification is removed from the system tray.
@@ -68,6 +70,7 @@ struct _MockFdoNotifications {
   guint32 current_uid;
   int notification_pipes[2];
   int actions_pipes[2];
+  int close_pipes[2];
   guint actions_source;
 };
 
@@ -100,7 +103,12 @@ static void handle_notifications_method_call_child(
     g_dbus_method_invocation_return_value(invocation,
                                           g_variant_new("(as)", capabilities));
   } else if (strcmp(method_name, "Notify") == 0) {
-    self->current_uid++;
+    // like the real servers, reuse the ID of the notification being replaced
+    guint32 uid;
+    g_variant_get_child(parameters, 1, "u", &uid);
+    if (uid == 0) {
+      uid = ++self->current_uid;
+    }
     gsize parameters_size = g_variant_get_size(parameters);
     g_autofree gpointer serialized_parameters = g_malloc(parameters_size);
     g_variant_store(parameters, serialized_parameters);
@@ -115,14 +123,41 @@ static void handle_notifications_method_call_child(
     // Then the serialized GVariant
     write(self->notification_pipes[1], serialized_parameters, parameters_size);
     // And finally, the notification ID
-    write(self->notification_pipes[1], &(self->current_uid),
-          sizeof(self->current_uid));
+    write(self->notification_pipes[1], &uid, sizeof(uid));
 
-    g_dbus_method_invocation_return_value(
-        invocation, g_variant_new("(u)", self->current_uid));
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(u)", uid));
+  } else if (strcmp(method_name, "CloseNotification") == 0) {
+    guint32 uid;
+    g_variant_get(parameters, "(u)", &uid);
+    write(self->close_pipes[1], &uid, sizeof(uid));
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    g_dbus_connection_emit_signal(
+        connection, NULL, "/org/freedesktop/Notifications",
+        "org.freedesktop.Notifications", "NotificationClosed",
+        g_variant_new("(uu)", uid, 3), NULL); // closed by CloseNotification
   }
 }
 
+/* Waits until there is data in a pipe. The default main context is iterated
+ * while waiting, because the client can need it to send its requests.
+ */
+static gboolean wait_for_pipe(int fd, guint timeout) {
+  struct pollfd poll_fd;
+  poll_fd.fd = fd;
+  poll_fd.events = POLLIN;
+  poll_fd.revents = 0;
+
+  gint64 end_time = g_get_monotonic_time() + timeout * 1000;
+  while (g_get_monotonic_time() < end_time) {
+    if (poll(&poll_fd, 1, 10) > 0) {
+      return TRUE;
+    }
+    g_main_context_iteration(NULL, FALSE);
+  }
+  return FALSE;
+}
+
 /**
  * mock_fdo_notifications_wait_for_notification
  * @mock: a #MockFdoNotifications
@@ -142,12 +177,8 @@ mock_fdo_notifications_wait_for_notification(MockFdoNotifications *self,
   g_autofree gpointer serialized_parameters = NULL;
   g_autoptr(GVariant) parameters = NULL;
   int read_size;
-  struct pollfd poll_fd;
-  poll_fd.fd = self->notification_pipes[0];
-  poll_fd.events = POLLIN;
-  poll_fd.revents = 0;
 
-  if (poll(&poll_fd, 1, timeout) <= 0) {
+  if (!wait_for_pipe(self->notification_pipes[0], timeout)) {
     return NULL;
   }
 
@@ -187,6 +218,27 @@ mock_fdo_notifications_wait_for_notification(MockFdoNotifications *self,
   return &self->last_notification_data;
 }
 
+/**
+ * mock_fdo_notifications_wait_for_close
+ * @mock: a #MockFdoNotifications
+ * @timeout: timeout in milliseconds
+ *
+ * Waits for the client to ask to close a notification.
+ *
+ * Returns: the UID of the closed notification, or 0 if timed out.
+ */
+guint32 mock_fdo_notifications_wait_for_close(MockFdoNotifications *self,
+                                              guint timeout) {
+  guint32 uid;
+  if (!wait_for_pipe(self->close_pipes[0], timeout)) {
+    return 0;
+  }
+  if (read(self->close_pipes[0], &uid, sizeof(uid)) != sizeof(uid)) {
+    return 0;
+  }
+  return uid;
+}
+
 /**
  * mock_fdo_notifications_send_action
  * @mock: a #MockFdoNotifications
@@ -261,6 +313,9 @@ static gboolean setup_mock_notifications_dbus_server(MockFdoNotifications *self,
       "      <arg type='i' direction='in'/>"
       "      <arg type='u' direction='out'/>"
       "    </method>"
+      "    <method name='CloseNotification'>"
+      "      <arg type='u' direction='in'/>"
+      "    </method>"
       "    <method name='GetCapabilities'>"
       "      <arg type='as' direction='out'/>"
       "    </method>"
@@ -313,6 +368,8 @@ static void mock_fdo_notifications_dispose(GObject *object) {
   close(self->notification_pipes[1]);
   close(self->actions_pipes[0]);
   close(self->actions_pipes[1]);
+  close(self->close_pipes[0]);
+  close(self->close_pipes[1]);
   g_clear_pointer(&self->dbus_address, g_free);
   if (self->dbus_subprocess) {
     g_subprocess_force_exit(self->dbus_subprocess);
@@ -367,6 +424,7 @@ void mock_fdo_notifications_run(MockFdoNotifications *self, int argc,
 static void mock_fdo_notifications_init(MockFdoNotifications *self) {
   pipe(self->notification_pipes);
   pipe(self->actions_pipes);
+  pipe(self->close_pipes);
 }
 
 static void
@@ -51,6 +51,9 @@ MockNotificationsData *
 mock_fdo_notifications_wait_for_notification(MockFdoNotifications *mock,
                                              guint timeout);
 
+guint32 mock_fdo_notifications_wait_for_close(MockFdoNotifications *mock,
+                                              guint timeout);
+
 void mock_fdo_notifications_send_action(MockFdoNotifications *mock, guint32 uid,
                                         gchar *action);
 
@@ -91,6 +91,7 @@ struct _MockSnapd {
   gchar *dir_path;
   gchar *socket_path;
   gboolean close_on_request;
+  guint snap_delay;
   gboolean decline_auth;
   GList *accounts;
   GList *users;
@@ -514,6 +515,11 @@ void mock_snapd_set_close_on_request(MockSnapd *self,
   self->close_on_request = close_on_request;
 }
 
+void mock_snapd_set_snap_delay(MockSnapd *self, guint snap_delay) {
+  g_return_if_fail(MOCK_IS_SNAPD(self));
+  self->snap_delay = snap_delay;
+}
+
 void mock_snapd_set_decline_auth(MockSnapd *self, gboolean decline_auth) {
   g_return_if_fail(MOCK_IS_SNAPD(self));
   self->decline_auth = decline_auth;
@@ -5237,6 +5243,15 @@ static void handle_request(SoupServer *server, SoupServerMessage *message,
     handle_model_serial(self, message, NULL);
   else
     send_error_not_found(self, message, "not found", NULL);
+
+  /* simulate a slow snapd: the answer has the data of the moment of the
+   * request, but it is sent later.
+   */
+  if ((self->snap_delay != 0) && ((strcmp(path, "/v2/snaps") == 0) ||
+                                  g_str_has_prefix(path, "/v2/snaps/"))) {
+    g_clear_pointer(&locker, g_mutex_locker_free);
+    g_usleep(self->snap_delay * 1000);
+  }
 }
 
 static gboolean mock_snapd_thread_quit(gpointer user_data) {
@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2024 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Replays a trace recorded with `snapd-desktop-integration --record-trace`
+ * against the mock snapd, to reproduce a real refresh in a deterministic way
+ * and measure the cost of processing it.
+ *
+ * The notices are sent at the same relative times than they were received
+ * (divided by the speed factor). The state of each change is applied to the
+ * mock snapd just after the previous time that the daemon read that change,
+ * so the refresh monitor finds it when it polls again; and the snaps that
+ * were inhibited are marked as such just before sending the corresponding
+ * "refresh-inhibit" notice.
+ *
+ * The task summaries aren't replayed, and the progress of each task is
+ * replaced by its status, because the mock snapd advances by itself the
+ * tasks that aren't complete.
+ *
+ * The number of times that each signal of the refresh monitor is emitted can
+ * be checked with `--expect SIGNAL=COUNT`; the replay fails if any differs.
+ */
+
+#include "../src/sdi-change-scheduler.h"
+#include "../src/sdi-refresh-monitor.h"
+#include "../src/sdi-snapd-client-factory.h"
+#include "benchmark-helpers.h"
+#include "mock-snapd.h"
+
+static gdouble speed = 1.0;
+static GStrv expectations = NULL;
+
+static GOptionEntry entries[] = {
+    {"speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed,
+     "Replay the trace this number of times faster", "FACTOR"},
+    {"expect", 'e', 0, G_OPTION_ARG_STRING_ARRAY, &expectations,
+     "Fail if the signal isn't emitted this number of times", "SIGNAL=COUNT"},
+    {NULL}};
+
+typedef enum { RECORD_NOTICE, RECORD_CHANGE } RecordType;
+
+typedef struct {
+  gchar *status;
+  GStrv snaps;
+} TraceTask;
+
+typedef struct {
+  RecordType type;
+  // time, in ms, when the record was stored
+  gint64 time;
+  // time, in ms, when the record must be applied to the mock snapd
+  gint64 apply_time;
+  // position in the trace, to keep the order of records with the same time
+  guint order;
+  // notice type for notices, or change status for changes
+  gchar *status;
+  // notice key or change ID
+  gchar *key;
+  gchar *kind;
+  GStrv refresh_snaps;
+  GArray *tasks;
+  // for "refresh-inhibit" notices, the snaps that were inhibited after it
+  GPtrArray *inhibited_snaps;
+} Record;
+
+typedef struct {
+  gchar *name;
+  // time remaining, when the notice was received, until the forced refresh
+  GTimeSpan remaining_time;
+} InhibitedSnap;
+
+typedef struct {
+  MockChange *change;
+  GPtrArray *tasks;
+  gboolean has_data;
+} ReplayChange;
+
+static MockSnapd *snapd = NULL;
+// maps the change IDs in the trace to the changes in the mock snapd
+static GHashTable *replay_changes = NULL;
+static GHashTable *mock_snaps = NULL;
+
+static struct {
+  const gchar *name;
+  guint count;
+  // number of emissions passed with `--expect`, or -1 if not checked
+  gint expected;
+} signal_counters[] = {
+    {"notify-pending-refresh", 0, -1},
+    {"notify-pending-refresh-forced", 0, -1},
+    {"notify-refresh-complete", 0, -1},
+    {"notify-refresh-complete-multiple", 0, -1},
+    {"begin-refresh", 0, -1},
+    {"end-refresh", 0, -1},
+    {"refresh-progress", 0, -1},
+};
+
+static void clear_task(TraceTask *task) {
+  g_free(task->status);
+  g_strfreev(task->snaps);
+}
+
+static void inhibited_snap_free(InhibitedSnap *snap) {
+  g_free(snap->name);
+  g_free(snap);
+}
+
+static void record_free(Record *record) {
+  g_free(record->status);
+  g_free(record->key);
+  g_free(record->kind);
+  g_strfreev(record->refresh_snaps);
+  g_clear_pointer(&record->tasks, g_array_unref);
+  g_clear_pointer(&record->inhibited_snaps, g_ptr_array_unref);
+  g_free(record);
+}
+
+static void replay_change_free(ReplayChange *change) {
+  g_ptr_array_unref(change->tasks);
+  g_free(change);
+}
+
+static void add_snap(const gchar *name) {
+  if (!g_hash_table_contains(mock_snaps, name)) {
+    g_hash_table_insert(mock_snaps, g_strdup(name),
+                        mock_snapd_add_snap(snapd, name));
+  }
+}
+
+static GStrv split_snaps(const gchar *snaps) {
+  GStrv names =
+      (*snaps == '\0') ? g_new0(gchar *, 1) : g_strsplit(snaps, ",", -1);
+  for (gchar **name = names; *name != NULL; name++) {
+    add_snap(*name);
+  }
+  return names;
+}
+
+static gint64 parse_time(const gchar *time) {
+  return g_ascii_strtoll(time, NULL, 10);
+}
+
+/* Reads the trace, creating in the mock snapd all the snaps referenced in it,
+ * and returns the records sorted by the time when they must be applied.
+ */
+static GPtrArray *load_trace(const gchar *path, GError **error) {
+  g_autofree gchar *contents = NULL;
+  if (!g_file_get_contents(path, &contents, NULL, error)) {
+    return NULL;
+  }
+  g_autoptr(GPtrArray) records =
+      g_ptr_array_new_with_free_func((GDestroyNotify)record_free);
+  // the last record in which the daemon received each change
+  g_autoptr(GHashTable) last_reads =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_autoptr(GDateTime) trace_start = NULL;
+  Record *last_change = NULL;
+  Record *last_inhibit = NULL;
+  g_auto(GStrv) lines = g_strsplit(contents, "\n", -1);
+
+  for (guint n = 0; lines[n] != NULL; n++) {
+    if (*lines[n] == '\0') {
+      continue;
+    }
+    g_auto(GStrv) fields = g_strsplit(lines[n], "\t", -1);
+    guint n_fields = g_strv_length(fields);
+    for (guint i = 0; i < n_fields; i++) {
+      gchar *field = fields[i];
+      fields[i] = g_strcompress(field);
+      g_free(field);
+    }
+
+    if (g_str_equal(fields[0], "start") && (n_fields == 2)) {
+      g_clear_pointer(&trace_start, g_date_time_unref);
+      trace_start = g_date_time_new_from_iso8601(fields[1], NULL);
+    } else if (g_str_equal(fields[0], "notice") && (n_fields == 5)) {
+      Record *record = g_new0(Record, 1);
+      record->type = RECORD_NOTICE;
+      record->time = parse_time(fields[1]);
+      record->apply_time = record->time;
+      record->status = g_strdup(fields[2]);
+      record->key = g_strdup(fields[3]);
+      record->kind = g_strdup(fields[4]);
+      if (g_str_equal(record->status, "change-update")) {
+        g_hash_table_insert(last_reads, g_strdup(record->key), record);
+      } else if (g_str_equal(record->status, "refresh-inhibit")) {
+        record->inhibited_snaps =
+            g_ptr_array_new_with_free_func((GDestroyNotify)inhibited_snap_free);
+        last_inhibit = record;
+      }
+      g_ptr_array_add(records, record);
+    } else if (g_str_equal(fields[0], "change") && (n_fields == 7)) {
+      Record *record = g_new0(Record, 1);
+      record->type = RECORD_CHANGE;
+      record->time = parse_time(fields[1]);
+      record->key = g_strdup(fields[2]);
+      record->kind = g_strdup(fields[3]);
+      record->status = g_strdup(fields[4]);
+      record->refresh_snaps = split_snaps(fields[6]);
+      record->tasks = g_array_new(FALSE, TRUE, sizeof(TraceTask));
+      g_array_set_clear_func(record->tasks, (GDestroyNotify)clear_task);
+      /* this state was read by the daemon after the previous read of the
+       * change (or after its notice), so it must be available since then.
+       */
+      Record *last_read = g_hash_table_lookup(last_reads, record->key);
+      record->apply_time =
+          (last_read == NULL) ? record->time : last_read->time;
+      g_hash_table_insert(last_reads, g_strdup(record->key), record);
+      last_change = record;
+      g_ptr_array_add(records, record);
+    } else if (g_str_equal(fields[0], "task") && (n_fields == 6) &&
+               (last_change != NULL)) {
+      TraceTask task = {
+          .status = g_strdup(fields[1]),
+          .snaps = split_snaps(fields[5]),
+      };
+      g_array_append_val(last_change->tasks, task);
+    } else if (g_str_equal(fields[0], "snap") && (n_fields == 4) &&
+               (last_inhibit != NULL) && (trace_start != NULL)) {
+      g_autoptr(GDateTime) proceed_time =
+          g_date_time_new_from_iso8601(fields[3], NULL);
+      if (proceed_time == NULL) {
+        continue;
+      }
+      InhibitedSnap *snap = g_new0(InhibitedSnap, 1);
+      snap->name = g_strdup(fields[2]);
+      snap->remaining_time =
+          g_date_time_difference(proceed_time, trace_start) -
+          last_inhibit->time * 1000;
+      add_snap(snap->name);
+      g_ptr_array_add(last_inhibit->inhibited_snaps, snap);
+    } else {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                  "Invalid record in line %u", n + 1);
+      return NULL;
+    }
+  }
+
+  for (guint i = 0; i < records->len; i++) {
+    ((Record *)records->pdata[i])->order = i;
+  }
+  return g_steal_pointer(&records);
+}
+
+/* Sorts the records by the time when they must be applied. With the same
+ * time, the changes go first, so they are already updated when the notice
+ * that announces them is sent.
+ */
+static gint compare_records(gconstpointer a, gconstpointer b) {
+  const Record *record_a = *((Record **)a);
+  const Record *record_b = *((Record **)b);
+  if (record_a->apply_time != record_b->apply_time) {
+    return (record_a->apply_time < record_b->apply_time) ? -1 : 1;
+  }
+  if (record_a->type != record_b->type) {
+    return (record_a->type == RECORD_CHANGE) ? -1 : 1;
+  }
+  return (gint)record_a->order - (gint)record_b->order;
+}
+
+static ReplayChange *get_replay_change(const gchar *id, const gchar *kind) {
+  ReplayChange *change = g_hash_table_lookup(replay_changes, id);
+  if (change != NULL) {
+    return change;
+  }
+  change = g_new0(ReplayChange, 1);
+  change->change = mock_snapd_add_change(snapd);
+  if (*kind != '\0') {
+    mock_change_set_kind(change->change, kind);
+  }
+  change->tasks = g_ptr_array_new();
+  g_hash_table_insert(replay_changes, g_strdup(id), change);
+  return change;
+}
+
+static void apply_change(Record *record) {
+  ReplayChange *change = get_replay_change(record->key, record->kind);
+  mock_change_set_status(change->change, record->status);
+
+  for (guint i = 0; i < record->tasks->len; i++) {
+    TraceTask *trace_task = &g_array_index(record->tasks, TraceTask, i);
+    if (i == change->tasks->len) {
+      MockTask *task = mock_change_add_task(change->change, "replay");
+      for (gchar **snap = trace_task->snaps; *snap != NULL; snap++) {
+        mock_task_add_affected_snap(task, *snap);
+      }
+      g_ptr_array_add(change->tasks, task);
+    }
+    MockTask *task = change->tasks->pdata[i];
+    mock_task_set_status(task, trace_task->status);
+    // a complete task isn't advanced by the mock snapd
+    mock_task_set_progress(task, 1, 1);
+  }
+
+  if (!change->has_data && (record->refresh_snaps[0] != NULL)) {
+    g_autoptr(JsonBuilder) builder = json_builder_new();
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "snap-names");
+    json_builder_begin_array(builder);
+    for (gchar **snap = record->refresh_snaps; *snap != NULL; snap++) {
+      json_builder_add_string_value(builder, *snap);
+    }
+    json_builder_end_array(builder);
+    json_builder_end_object(builder);
+    g_autoptr(JsonNode) node = json_builder_get_root(builder);
+    mock_change_add_data(change->change, node);
+    mock_change_set_force_data(change->change, TRUE);
+    change->has_data = TRUE;
+  }
+}
+
+static void apply_notice(Record *record) {
+  static int counter = 1;
+  const gchar *key = record->key;
+
+  if (g_str_equal(record->status, "change-update")) {
+    ReplayChange *change = get_replay_change(record->key, record->kind);
+    key = mock_change_get_id(change->change);
+  } else if (record->inhibited_snaps != NULL) {
+    g_autoptr(GDateTime) now = g_date_time_new_now_utc();
+    GHashTableIter iter;
+    MockSnap *snap;
+    g_hash_table_iter_init(&iter, mock_snaps);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&snap)) {
+      mock_snap_set_proceed_time(snap, NULL);
+    }
+    for (guint i = 0; i < record->inhibited_snaps->len; i++) {
+      InhibitedSnap *inhibited_snap = record->inhibited_snaps->pdata[i];
+      g_autoptr(GDateTime) proceed_time =
+          g_date_time_add(now, inhibited_snap->remaining_time);
+      g_autofree gchar *date = g_date_time_format_iso8601(proceed_time);
+      mock_snap_set_proceed_time(
+          g_hash_table_lookup(mock_snaps, inhibited_snap->name), date);
+    }
+  }
+
+  g_autofree gchar *id = g_strdup_printf("%d", counter++);
+  MockNotice *notice = mock_snapd_add_notice(snapd, id, key, record->status);
+  g_autoptr(GDateTime) date = g_date_time_new_now_utc();
+  mock_notice_set_dates(notice, date, date, date, 1);
+  if (*record->kind != '\0') {
+    mock_notice_add_data_pair(notice, "kind", record->kind);
+  }
+}
+
+/* Stores in the signal counters the number of emissions passed with
+ * `--expect`.
+ */
+static gboolean parse_expectations(GError **error) {
+  for (gchar **expectation = expectations;
+       (expectation != NULL) && (*expectation != NULL); expectation++) {
+    g_auto(GStrv) fields = g_strsplit(*expectation, "=", 2);
+    guint64 count = 0;
+    if ((g_strv_length(fields) != 2) ||
+        !g_ascii_string_to_unsigned(fields[1], 10, 0, G_MAXINT, &count,
+                                    NULL)) {
+      g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                  "Invalid expectation %s", *expectation);
+      return FALSE;
+    }
+    guint i;
+    for (i = 0; i < G_N_ELEMENTS(signal_counters); i++) {
+      if (g_str_equal(signal_counters[i].name, fields[0])) {
+        signal_counters[i].expected = count;
+        break;
+      }
+    }
+    if (i == G_N_ELEMENTS(signal_counters)) {
+      g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                  "Unknown signal %s", fields[0]);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static void count_signal_cb(guint *counter) { (*counter)++; }
+
+/* Iterates the main loop until the monotonic time reaches `deadline`. */
+static void wait_until(gint64 deadline) {
+  gint64 remaining = deadline - g_get_monotonic_time();
+  if (remaining <= 0) {
+    while (g_main_context_iteration(NULL, FALSE))
+      ;
+    return;
+  }
+  gboolean expired = FALSE;
+  g_timeout_add_once(remaining / 1000, benchmark_set_flag_cb, &expired);
+  while (!expired) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("TRACE - replay a trace of the refresh monitor");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_autoptr(GError) error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if (argc != 2) {
+    g_printerr("A trace file must be specified\n");
+    return 1;
+  }
+  if (speed <= 0) {
+    g_printerr("The speed must be greater than zero\n");
+    return 1;
+  }
+  if (!parse_expectations(&error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  snapd = mock_snapd_new();
+  sdi_snapd_client_factory_set_custom_path(
+      (gchar *)mock_snapd_get_socket_path(snapd));
+  replay_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)replay_change_free);
+  mock_snaps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  g_autoptr(GPtrArray) records = load_trace(argv[1], &error);
+  if (records == NULL) {
+    g_printerr("Failed to load the trace: %s\n", error->message);
+    return 1;
+  }
+  g_ptr_array_sort(records, compare_records);
+
+  if (!mock_snapd_start(snapd, &error)) {
+    g_printerr("Failed to start mock snapd: %s\n", error->message);
+    return 1;
+  }
+
+  guint min_poll_interval =
+      MAX(1, SDI_CHANGE_SCHEDULER_DEFAULT_MIN_INTERVAL / speed);
+  guint max_poll_interval =
+      MAX(1, SDI_CHANGE_SCHEDULER_DEFAULT_MAX_INTERVAL / speed);
+  g_autoptr(SdiRefreshMonitor) refresh_monitor = sdi_refresh_monitor_new();
+  g_object_set(refresh_monitor, "min-poll-interval", min_poll_interval,
+               "max-poll-interval", max_poll_interval, NULL);
+  for (guint i = 0; i < G_N_ELEMENTS(signal_counters); i++) {
+    g_signal_connect_swapped(refresh_monitor, signal_counters[i].name,
+                             (GCallback)count_signal_cb,
+                             &signal_counters[i].count);
+  }
+
+  g_autoptr(SdiSnapdMonitor) notices_monitor =
+      benchmark_start_notices_monitor(refresh_monitor);
+
+  guint n_notices = 0;
+  guint n_changes = 0;
+  gint64 cpu = benchmark_get_thread_cpu_time();
+  gint64 start = g_get_monotonic_time();
+  for (guint i = 0; i < records->len; i++) {
+    Record *record = records->pdata[i];
+    wait_until(start + record->apply_time * 1000 / speed);
+    if (record->type == RECORD_NOTICE) {
+      apply_notice(record);
+      n_notices++;
+    } else {
+      apply_change(record);
+      n_changes++;
+    }
+  }
+  // give time to the refresh monitor to check the last state of the changes
+  wait_until(g_get_monotonic_time() + 2 * max_poll_interval * 1000);
+  cpu = benchmark_get_thread_cpu_time() - cpu;
+
+  g_print("%u notices and %u change states replayed in %" G_GINT64_FORMAT
+          " ms\n",
+          n_notices, n_changes, (g_get_monotonic_time() - start) / 1000);
+  g_print("cpu: %" G_GINT64_FORMAT " us\n", cpu);
+  int result = 0;
+  for (guint i = 0; i < G_N_ELEMENTS(signal_counters); i++) {
+    g_print("%s: %u\n", signal_counters[i].name, signal_counters[i].count);
+    if ((signal_counters[i].expected >= 0) &&
+        (signal_counters[i].count != (guint)signal_counters[i].expected)) {
+      g_printerr("%s was emitted %u times, expected %d\n",
+                 signal_counters[i].name, signal_counters[i].count,
+                 signal_counters[i].expected);
+      result = 1;
+    }
+  }
+
+  g_clear_object(&notices_monitor);
+  g_clear_object(&refresh_monitor);
+  mock_snapd_stop(snapd);
+  g_clear_pointer(&replay_changes, g_hash_table_unref);
+  g_clear_pointer(&mock_snaps, g_hash_table_unref);
+  g_clear_object(&snapd);
+  g_clear_pointer(&expectations, g_strfreev);
+  return result;
+}
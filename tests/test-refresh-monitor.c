@@ -1,11 +1,18 @@
+#include "../src/sdi-change-model.h"
+#include "../src/sdi-change-scheduler.h"
+#include "../src/sdi-desktop-file-index.h"
 #include "../src/sdi-forced-refresh-time-constants.h"
 #include "../src/sdi-helpers.h"
 #include "../src/sdi-refresh-monitor.h"
+#include "../src/sdi-snap-cache.h"
 #include "../src/sdi-snapd-client-factory.h"
 #include "gtk/gtk.h"
 #include "mock-snapd.h"
 
+#include <fcntl.h>
+#include <glib/gstdio.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
 static SdiRefreshMonitor *refresh_monitor = NULL;
 static MockSnapd *snapd = NULL;
@@ -24,6 +31,7 @@ typedef enum {
   RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH,
   RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH_FORCED,
   RECEIVED_SIGNAL_NOTIFY_REFRESH_COMPLETE,
+  RECEIVED_SIGNAL_NOTIFY_REFRESH_COMPLETE_MULTIPLE,
   RECEIVED_SIGNAL_BEGIN_REFRESH,
   RECEIVED_SIGNAL_REFRESH_PROGRESS,
   RECEIVED_SIGNAL_END_REFRESH,
@@ -124,6 +132,15 @@ static void notify_refresh_complete_cb(GObject *self, SnapdSnap *snap,
   data->snap_name = g_strdup(snap_name);
 }
 
+static void notify_refresh_complete_multiple_cb(GObject *self,
+                                                GListModel *snaps) {
+  g_assert_true(self == G_OBJECT(refresh_monitor));
+
+  ReceivedSignalData *data =
+      new_received_signal(RECEIVED_SIGNAL_NOTIFY_REFRESH_COMPLETE_MULTIPLE);
+  data->snaps_list = g_object_ref(snaps);
+}
+
 static void begin_refresh_cb(GObject *self, gchar *snap_name,
                              gchar *visible_name, gchar *icon) {
   g_assert_true(self == G_OBJECT(refresh_monitor));
@@ -203,6 +220,33 @@ static ReceivedSignalData *wait_for_signal(ReceivedSignal desired_signal,
   return data;
 }
 
+/* Like `wait_for_signal`, but without discarding the signals already
+ * received. Useful for signals that are emitted asynchronously after others.
+ */
+static ReceivedSignalData *wait_for_next_signal(ReceivedSignal desired_signal,
+                                                guint timeout) {
+  GMainContext *context = g_main_context_default();
+  ReceivedSignalData *data = get_next_signal(desired_signal);
+
+  if (data != NULL) {
+    return data;
+  }
+  timeout_id = g_timeout_add_once(timeout, timeout_cb, NULL);
+  do {
+    g_main_context_iteration(context, TRUE);
+    data = get_next_signal(desired_signal);
+  } while ((data == NULL) && (timeout_id != 0));
+  if (timeout_id != 0) {
+    g_source_remove(timeout_id);
+    timeout_id = 0;
+  } else {
+    // remove the timeout mark from the list
+    g_autoptr(ReceivedSignalData) timeout_data =
+        get_next_signal(RECEIVED_SIGNAL_TIMEOUT);
+  }
+  return data;
+}
+
 static void reset_mock_snapd(void) {
   g_clear_object(&snapd_monitor);
   g_clear_object(&snapd);
@@ -227,6 +271,11 @@ static void reset_mock_snapd(void) {
   g_assert_true(snapd_notices_monitor_start(snapd_monitor, &error));
 
   refresh_monitor = sdi_refresh_monitor_new();
+  /* most tests rely on the changes being checked every 500 ms, so disable
+   * the adaptive interval.
+   */
+  g_object_set(refresh_monitor, "min-poll-interval", 500, "max-poll-interval",
+               500, NULL);
 
   g_signal_connect(refresh_monitor, "notify-pending-refresh",
                    (GCallback)notify_pending_refresh_cb, NULL);
@@ -234,6 +283,8 @@ static void reset_mock_snapd(void) {
                    (GCallback)notify_pending_refresh_forced_cb, NULL);
   g_signal_connect(refresh_monitor, "notify-refresh-complete",
                    (GCallback)notify_refresh_complete_cb, NULL);
+  g_signal_connect(refresh_monitor, "notify-refresh-complete-multiple",
+                   (GCallback)notify_refresh_complete_multiple_cb, NULL);
   g_signal_connect(refresh_monitor, "begin-refresh",
                    (GCallback)begin_refresh_cb, NULL);
   g_signal_connect(refresh_monitor, "refresh-progress",
@@ -420,6 +471,98 @@ static void test_refresh_inhibit_three_pending(void) {
   g_assert_true(assert_no_more_signals());
 }
 
+static void test_refresh_inhibit_burst(void) {
+  reset_mock_snapd();
+  MockSnap *snap1 = mock_snapd_add_snap(snapd, "snap1");
+  set_snap_as_inhibited(snap1, ONE_DAY * 10);
+  MockSnap *snap2 = mock_snapd_add_snap(snapd, "snap2");
+  set_snap_as_inhibited(snap2, ONE_DAY * 10);
+  new_notice("refresh-inhibit");
+
+  g_autoptr(ReceivedSignalData) notice =
+      wait_for_signal(RECEIVED_SIGNAL_NOTICE, 0);
+  g_assert_nonnull(notice);
+  g_assert_true(assert_no_more_signals());
+  // several notices in a row must be grouped in a single notification
+  for (int i = 0; i < 5; i++) {
+    sdi_refresh_monitor_notice(refresh_monitor, notice->notice, FALSE);
+  }
+
+  g_autoptr(ReceivedSignalData) data =
+      wait_for_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH, 200);
+  g_assert_nonnull(data);
+  g_assert_cmpint(g_list_model_get_n_items(data->snaps_list), ==, 2);
+  g_assert_true(snap_list_contains_name(data, "snap1"));
+  g_assert_true(snap_list_contains_name(data, "snap2"));
+  g_assert_true(wait_for_timeout(200));
+}
+
+static void test_refresh_inhibit_repeated(void) {
+  reset_mock_snapd();
+  MockSnap *snap1 = mock_snapd_add_snap(snapd, "snap1");
+  set_snap_as_inhibited(snap1, ONE_DAY * 10);
+  MockSnap *snap2 = mock_snapd_add_snap(snapd, "snap2");
+  set_snap_as_inhibited(snap2, TIME_TO_SHOW_ALERT_BEFORE_FORCED_REFRESH - 1);
+  new_notice("refresh-inhibit");
+  g_assert_true(wait_for_notice());
+
+  g_autoptr(ReceivedSignalData) data =
+      wait_for_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH_FORCED, 100);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(snapd_snap_get_name(data->snap), ==, "snap2");
+  g_autoptr(ReceivedSignalData) data2 =
+      get_next_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH);
+  g_assert_nonnull(data2);
+  g_assert_cmpint(g_list_model_get_n_items(data2->snaps_list), ==, 2);
+  g_assert_true(assert_no_more_signals());
+
+  // the same snaps are still inhibited, so nothing must be notified
+  new_notice("refresh-inhibit");
+  g_assert_true(wait_for_notice());
+  g_assert_true(wait_for_timeout(200));
+
+  // a new snap is inhibited, so the whole list must be notified again
+  MockSnap *snap3 = mock_snapd_add_snap(snapd, "snap3");
+  set_snap_as_inhibited(snap3, ONE_DAY * 10);
+  new_notice("refresh-inhibit");
+  g_assert_true(wait_for_notice());
+
+  g_autoptr(ReceivedSignalData) data3 =
+      wait_for_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH, 200);
+  g_assert_nonnull(data3);
+  g_assert_cmpint(g_list_model_get_n_items(data3->snaps_list), ==, 3);
+  g_assert_true(snap_list_contains_name(data3, "snap1"));
+  g_assert_true(snap_list_contains_name(data3, "snap2"));
+  g_assert_true(snap_list_contains_name(data3, "snap3"));
+  g_assert_true(assert_no_more_signals());
+}
+
+static void test_refresh_inhibit_forced_threshold(void) {
+  reset_mock_snapd();
+  MockSnap *snap1 = mock_snapd_add_snap(snapd, "snap1");
+  set_snap_as_inhibited(snap1, TIME_TO_SHOW_ALERT_BEFORE_FORCED_REFRESH + 3);
+  new_notice("refresh-inhibit");
+  g_assert_true(wait_for_notice());
+
+  g_autoptr(ReceivedSignalData) data =
+      wait_for_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH_FORCED, 100);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(snapd_snap_get_name(data->snap), ==, "snap1");
+  g_autoptr(ReceivedSignalData) data2 =
+      get_next_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH);
+  g_assert_nonnull(data2);
+  g_assert_true(assert_no_more_signals());
+
+  // the alert threshold must be notified without any new notice from snapd
+  g_autoptr(ReceivedSignalData) data3 =
+      wait_for_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH_FORCED, 5000);
+  g_assert_nonnull(data3);
+  g_assert_cmpstr(snapd_snap_get_name(data3->snap), ==, "snap1");
+  g_assert_true(remaining_times_are_equal(
+      data3->remaining_time, TIME_TO_SHOW_ALERT_BEFORE_FORCED_REFRESH));
+  g_assert_true(assert_no_more_signals());
+}
+
 static void test_refresh_inhibit_dont_show_again(void) {
   reset_mock_snapd();
   mock_snapd_add_snap(snapd, "snap1");
@@ -669,6 +812,123 @@ static void test_refresh_progress_for_non_inhibited_snap(const void *data) {
   g_assert_true(wait_for_timeout(1000));
 }
 
+static MockChange *add_two_tasks_change(const gchar *snap_name,
+                                        MockTask **first_task) {
+  MockChange *change = mock_snapd_add_change(snapd);
+  mock_change_set_kind(change, "auto-refresh");
+  MockTask *task1 = mock_change_add_task(change, "download");
+  MockTask *task2 = mock_change_add_task(change, "install");
+  mock_task_add_affected_snap(task1, snap_name);
+  mock_task_set_progress(task1, 0, 5);
+  mock_task_add_affected_snap(task2, snap_name);
+  mock_task_set_progress(task2, 0, 5);
+  *first_task = task1;
+  return change;
+}
+
+static void test_refresh_progress_concurrent_changes(void) {
+  reset_mock_snapd();
+  mock_snapd_add_snap(snapd, "kicad");
+  mock_snapd_add_snap(snapd, "simple-scan");
+  MockTask *task1 = NULL;
+  MockTask *task2 = NULL;
+  MockChange *change1 = add_two_tasks_change("kicad", &task1);
+  MockChange *change2 = add_two_tasks_change("simple-scan", &task2);
+
+  MockNotice *notice1 = new_notice("change-update");
+  mock_notice_set_key(notice1, mock_change_get_id(change1));
+  mock_notice_add_data_pair(notice1, "kind", "auto-refresh");
+  g_assert_true(wait_for_notice());
+  g_autoptr(ReceivedSignalData) data1 =
+      wait_for_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS, 100);
+  g_assert_nonnull(data1);
+  g_assert_cmpstr(data1->snap_name, ==, "kicad");
+
+  MockNotice *notice2 = new_notice("change-update");
+  mock_notice_set_key(notice2, mock_change_get_id(change2));
+  mock_notice_add_data_pair(notice2, "kind", "auto-refresh");
+  g_assert_true(wait_for_notice());
+  g_autoptr(ReceivedSignalData) data2 =
+      wait_for_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS, 100);
+  g_assert_nonnull(data2);
+  g_assert_cmpstr(data2->snap_name, ==, "simple-scan");
+
+  /* Both changes are checked in the same periodic request, so both progress
+   * updates must arrive together.
+   */
+  mock_task_set_progress(task1, 5, 5);
+  mock_task_set_status(task1, "Done");
+  mock_task_set_progress(task2, 5, 5);
+  mock_task_set_status(task2, "Done");
+  g_autoptr(ReceivedSignalData) data3 =
+      wait_for_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS, 1000);
+  g_assert_nonnull(data3);
+  g_autoptr(ReceivedSignalData) data4 =
+      get_next_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS);
+  g_assert_nonnull(data4);
+  g_assert_cmpint(data3->done_tasks, ==, 1);
+  g_assert_cmpint(data4->done_tasks, ==, 1);
+  g_assert_cmpstr(data3->snap_name, !=, data4->snap_name);
+  g_assert_true(assert_no_more_signals());
+}
+
+typedef struct {
+  gboolean progressed;
+  guint checks;
+} ChangeChecksData;
+
+static void count_change_update_cb(SdiChangeScheduler *scheduler,
+                                   SnapdChange *change,
+                                   ChangeChecksData *data) {
+  data->checks++;
+  sdi_change_scheduler_report_progress(scheduler, snapd_change_get_id(change),
+                                       data->progressed);
+}
+
+static void set_flag_cb(gpointer data) { *((gboolean *)data) = TRUE; }
+
+/* Counts how many times a change in progress is checked during two seconds,
+ * reporting always either progress or no progress.
+ */
+static guint count_change_checks(gboolean progressed) {
+  g_autoptr(SnapdClient) client = sdi_snapd_client_factory_new_snapd_client();
+  g_autoptr(SdiChangeScheduler) scheduler = sdi_change_scheduler_new(client);
+  g_object_set(scheduler, "min-interval", 100, "max-interval", 1000, NULL);
+
+  MockTask *task = NULL;
+  MockChange *change = add_two_tasks_change("kicad", &task);
+  ChangeChecksData data = {progressed, 0};
+  g_signal_connect(scheduler, "change-update",
+                   (GCallback)count_change_update_cb, &data);
+  sdi_change_scheduler_add_change(scheduler, mock_change_get_id(change));
+
+  gboolean finished = FALSE;
+  g_timeout_add_once(2000, set_flag_cb, &finished);
+  while (!finished) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  return data.checks;
+}
+
+static void test_adaptive_change_checks(void) {
+  reset_mock_snapd();
+  mock_snapd_add_snap(snapd, "kicad");
+
+  /* With no progress, the interval grows from 500 ms up to 1000 ms, so
+   * there should be only two checks: at 500 ms and at 1250 ms.
+   */
+  guint stalled_checks = count_change_checks(FALSE);
+  g_assert_cmpuint(stalled_checks, >=, 1);
+  g_assert_cmpuint(stalled_checks, <=, 3);
+
+  /* With progress, the interval shrinks down to 100 ms, so there should be
+   * many more checks.
+   */
+  guint progressing_checks = count_change_checks(TRUE);
+  g_assert_cmpuint(progressing_checks, >=, 6);
+  g_assert_cmpuint(progressing_checks, >, stalled_checks);
+}
+
 static void test_signals_inhibited_not_announced_refresh(void) {
   reset_mock_snapd();
   MockSnap *snap = mock_snapd_add_snap(snapd, "kicad");
@@ -766,7 +1026,7 @@ static void test_signals_inhibited_announced_refresh(void) {
   g_assert_false(data1->task_done);
   g_assert_cmpstr(data1->snap_name, ==, "kicad");
   g_autoptr(ReceivedSignalData) data2 =
-      get_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH);
+      wait_for_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH, 200);
   g_assert_nonnull(data2);
   g_assert_cmpstr(data2->snap_name, ==, "kicad");
   g_assert_cmpstr(data2->visible_name, ==, "KiCad");
@@ -812,6 +1072,194 @@ static void test_signals_inhibited_announced_refresh(void) {
   g_assert_true(wait_for_timeout(600));
 }
 
+static void test_refresh_complete_multiple(void) {
+  reset_mock_snapd();
+  MockSnap *snap1 = mock_snapd_add_snap(snapd, "kicad");
+  add_app_to_snap(snap1, "kicad", "kicad_kicad.desktop");
+  set_snap_as_inhibited(snap1, 6 * ONE_DAY); // six days until forced refresh
+  MockSnap *snap2 = mock_snapd_add_snap(snapd, "simple-scan");
+  add_app_to_snap(snap2, "simple-scan", "simple-scan_simple-scan.desktop");
+  set_snap_as_inhibited(snap2, 6 * ONE_DAY);
+  MockChange *change = mock_snapd_add_change(snapd);
+
+  MockTask *task1 = mock_change_add_task(change, "download");
+  MockTask *task2 = mock_change_add_task(change, "download");
+  mock_task_add_affected_snap(task1, "kicad");
+  mock_task_set_progress(task1, 0, 5);
+  mock_task_add_affected_snap(task2, "simple-scan");
+  mock_task_set_progress(task2, 0, 5);
+
+  g_autoptr(JsonBuilder) builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "snap-names");
+  json_builder_begin_array(builder);
+  json_builder_add_string_value(builder, "kicad");
+  json_builder_add_string_value(builder, "simple-scan");
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+  JsonNode *node = json_builder_get_root(builder);
+  mock_change_add_data(change, node);
+  mock_change_set_force_data(change, TRUE);
+  mock_change_set_kind(change, "auto-refresh");
+
+  new_notice("refresh-inhibit");
+  g_assert_true(wait_for_notice());
+  g_autoptr(ReceivedSignalData) data1 =
+      wait_for_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH, 100);
+  g_assert_nonnull(data1);
+  g_assert_cmpint(g_list_model_get_n_items(data1->snaps_list), ==, 2);
+
+  MockNotice *notice = new_notice("change-update");
+  mock_notice_set_key(notice, mock_change_get_id(change));
+  mock_notice_add_data_pair(notice, "kind", "auto-refresh");
+  g_assert_true(wait_for_notice());
+  g_autoptr(ReceivedSignalData) data2 =
+      wait_for_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH, 500);
+  g_assert_nonnull(data2);
+  g_autoptr(ReceivedSignalData) data3 =
+      wait_for_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH, 500);
+  g_assert_nonnull(data3);
+  clear_received_signals();
+
+  // both snaps finish at the same time
+  mock_task_set_progress(task1, 5, 5);
+  mock_task_set_status(task1, "Done");
+  mock_task_set_progress(task2, 5, 5);
+  mock_task_set_status(task2, "Done");
+  g_autoptr(ReceivedSignalData) data4 =
+      wait_for_next_signal(RECEIVED_SIGNAL_END_REFRESH, 600);
+  g_assert_nonnull(data4);
+  g_autoptr(ReceivedSignalData) data5 =
+      wait_for_next_signal(RECEIVED_SIGNAL_END_REFRESH, 600);
+  g_assert_nonnull(data5);
+
+  // so a single notification must be shown for both
+  g_autoptr(ReceivedSignalData) data6 = wait_for_next_signal(
+      RECEIVED_SIGNAL_NOTIFY_REFRESH_COMPLETE_MULTIPLE, 1000);
+  g_assert_nonnull(data6);
+  g_assert_cmpint(g_list_model_get_n_items(data6->snaps_list), ==, 2);
+  g_assert_true(snap_list_contains_name(data6, "kicad"));
+  g_assert_true(snap_list_contains_name(data6, "simple-scan"));
+  g_autoptr(ReceivedSignalData) data7 =
+      get_next_signal(RECEIVED_SIGNAL_NOTIFY_REFRESH_COMPLETE);
+  g_assert_null(data7);
+  g_autoptr(ReceivedSignalData) data8 = wait_for_next_signal(
+      RECEIVED_SIGNAL_NOTIFY_REFRESH_COMPLETE_MULTIPLE, 1000);
+  g_assert_null(data8);
+}
+
+static void test_begin_refresh_placeholder(void) {
+  reset_mock_snapd();
+  MockSnap *snap = mock_snapd_add_snap(snapd, "kicad");
+  add_app_to_snap(snap, "kicad", "kicad_kicad.desktop");
+  set_snap_as_inhibited(snap, 6 * ONE_DAY); // six days until forced refresh
+
+  new_notice("refresh-inhibit");
+  g_assert_true(wait_for_notice());
+  g_autoptr(ReceivedSignalData) data =
+      wait_for_signal(RECEIVED_SIGNAL_NOTIFY_PENDING_REFRESH, 100);
+  g_assert_nonnull(data);
+
+  /* a finished change removes the snap from the cache, so its data must be
+   * requested again when the refresh begins.
+   */
+  MockChange *change1 = mock_snapd_add_change(snapd);
+  mock_change_set_kind(change1, "refresh-snap");
+  MockTask *task1 = mock_change_add_task(change1, "link");
+  mock_task_add_affected_snap(task1, "kicad");
+  mock_task_set_status(task1, "Done");
+  mock_change_set_status(change1, "Done");
+  MockNotice *notice1 = new_notice("change-update");
+  mock_notice_set_key(notice1, mock_change_get_id(change1));
+  mock_notice_add_data_pair(notice1, "kind", "refresh-snap");
+  g_assert_true(wait_for_notice());
+  g_autoptr(ReceivedSignalData) data1 =
+      wait_for_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS, 100);
+  g_assert_nonnull(data1);
+  g_assert_true(data1->task_done);
+
+  // the snap data will arrive later than the placeholder dialog
+  mock_snapd_set_snap_delay(snapd, 600);
+
+  MockChange *change2 = mock_snapd_add_change(snapd);
+  MockTask *task2 = mock_change_add_task(change2, "download");
+  mock_task_add_affected_snap(task2, "kicad");
+  mock_task_set_progress(task2, 0, 5);
+  g_autoptr(JsonBuilder) builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "snap-names");
+  json_builder_begin_array(builder);
+  json_builder_add_string_value(builder, "kicad");
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+  JsonNode *node = json_builder_get_root(builder);
+  mock_change_add_data(change2, node);
+  mock_change_set_force_data(change2, TRUE);
+  mock_change_set_kind(change2, "auto-refresh");
+
+  MockNotice *notice2 = new_notice("change-update");
+  mock_notice_set_key(notice2, mock_change_get_id(change2));
+  mock_notice_add_data_pair(notice2, "kind", "auto-refresh");
+  g_assert_true(wait_for_notice());
+
+  // first, the placeholder with just the snap name...
+  g_autoptr(ReceivedSignalData) data2 =
+      wait_for_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH, 500);
+  g_assert_nonnull(data2);
+  g_assert_cmpstr(data2->snap_name, ==, "kicad");
+  g_assert_cmpstr(data2->visible_name, ==, "kicad");
+  g_assert_null(data2->icon);
+
+  // ...and then the real data, when it arrives
+  g_autoptr(ReceivedSignalData) data3 =
+      wait_for_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH, 1000);
+  g_assert_nonnull(data3);
+  g_assert_cmpstr(data3->snap_name, ==, "kicad");
+  g_assert_cmpstr(data3->visible_name, ==, "KiCad");
+  g_assert_cmpstr(data3->icon, ==, "kicad.svg");
+  mock_snapd_set_snap_delay(snapd, 0);
+}
+
+static void test_task_status_progress(void) {
+  reset_mock_snapd();
+  mock_snapd_add_snap(snapd, "kicad");
+  MockChange *change = mock_snapd_add_change(snapd);
+  mock_change_set_kind(change, "refresh-snap");
+  MockTask *task1 = mock_change_add_task(change, "download");
+  mock_task_add_affected_snap(task1, "kicad");
+  MockTask *task2 = mock_change_add_task(change, "install");
+  mock_task_add_affected_snap(task2, "kicad");
+
+  MockNotice *notice = new_notice("change-update");
+  mock_notice_set_key(notice, mock_change_get_id(change));
+  mock_notice_add_data_pair(notice, "kind", "refresh-snap");
+  g_assert_true(wait_for_notice());
+  g_autoptr(ReceivedSignalData) data1 =
+      wait_for_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS, 100);
+  g_assert_nonnull(data1);
+  g_assert_cmpint(data1->total_tasks, ==, 2);
+  g_assert_cmpint(data1->done_tasks, ==, 0);
+
+  mock_task_set_status(task1, "Done");
+  g_autoptr(ReceivedSignalData) data2 =
+      wait_for_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS, 1000);
+  g_assert_nonnull(data2);
+  g_assert_cmpint(data2->done_tasks, ==, 1);
+  g_assert_false(data2->task_done);
+
+  // a task going from Do to Doing must not change the progress
+  mock_task_set_status(task2, "Doing");
+  g_assert_true(wait_for_timeout(1000));
+
+  mock_task_set_status(task2, "Done");
+  g_autoptr(ReceivedSignalData) data3 =
+      wait_for_signal(RECEIVED_SIGNAL_REFRESH_PROGRESS, 1000);
+  g_assert_nonnull(data3);
+  g_assert_cmpint(data3->total_tasks, ==, 2);
+  g_assert_cmpint(data3->done_tasks, ==, 2);
+  g_assert_true(data3->task_done);
+}
+
 static void test_sdi_snap(void) {
   g_autoptr(SdiSnap) snap = sdi_snap_new("a name");
   GValue value = G_VALUE_INIT;
@@ -871,7 +1319,7 @@ static void test_cancelled_refresh(const void *param) {
   g_assert_false(data1->task_done);
   g_assert_cmpstr(data1->snap_name, ==, "kicad");
   g_autoptr(ReceivedSignalData) data2 =
-      get_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH);
+      wait_for_next_signal(RECEIVED_SIGNAL_BEGIN_REFRESH, 200);
   g_assert_nonnull(data2);
   g_assert_cmpstr(data2->snap_name, ==, "kicad");
   g_assert_cmpstr(data2->visible_name, ==, "KiCad");
@@ -889,6 +1337,259 @@ static void test_cancelled_refresh(const void *param) {
   g_assert_true(wait_for_timeout(600));
 }
 
+static void test_change_model_status(void) {
+  g_assert_cmpint(sdi_change_status_from_string("Doing"), ==,
+                  SDI_CHANGE_STATUS_DOING);
+  g_assert_cmpint(sdi_change_status_from_string("Undone"), ==,
+                  SDI_CHANGE_STATUS_UNDONE);
+  g_assert_cmpint(sdi_change_status_from_string("doing"), ==,
+                  SDI_CHANGE_STATUS_UNKNOWN);
+  g_assert_cmpint(sdi_change_status_from_string("a-new-status"), ==,
+                  SDI_CHANGE_STATUS_UNKNOWN);
+  g_assert_true(sdi_change_status_is_working(SDI_CHANGE_STATUS_DONE));
+  g_assert_false(sdi_change_status_is_working(SDI_CHANGE_STATUS_UNDO));
+  g_assert_true(sdi_change_status_is_cancelled(SDI_CHANGE_STATUS_ABORT));
+  g_assert_false(sdi_change_status_is_cancelled(SDI_CHANGE_STATUS_HOLD));
+  g_assert_true(sdi_change_status_is_task_done(SDI_CHANGE_STATUS_HOLD));
+  g_assert_false(sdi_change_status_is_task_done(SDI_CHANGE_STATUS_DOING));
+  g_assert_cmpint(sdi_change_kind_from_string("auto-refresh"), ==,
+                  SDI_CHANGE_KIND_AUTO_REFRESH);
+  g_assert_cmpint(sdi_change_kind_from_string(NULL), ==,
+                  SDI_CHANGE_KIND_OTHER);
+}
+
+static SdiChange *get_change_model(SnapdClient *client, MockChange *change) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(SnapdChange) snapd_change = snapd_client_get_change_sync(
+      client, mock_change_get_id(change), NULL, &error);
+  g_assert_no_error(error);
+  return sdi_change_new(snapd_change);
+}
+
+static void test_change_model_diff(void) {
+  reset_mock_snapd();
+  g_autoptr(SnapdClient) client = sdi_snapd_client_factory_new_snapd_client();
+  MockChange *change = mock_snapd_add_change(snapd);
+  MockTask *task1 = mock_change_add_task(change, "download");
+  mock_task_add_affected_snap(task1, "kicad");
+  MockTask *task2 = mock_change_add_task(change, "install");
+  mock_task_add_affected_snap(task2, "kicad");
+  mock_task_add_affected_snap(task2, "gnome-42");
+  g_autoptr(SdiChange) old_model = get_change_model(client, change);
+  g_assert_cmpuint(old_model->tasks->len, ==, 2);
+  g_assert_cmpuint(old_model->snap_names->len, ==, 2);
+
+  mock_task_set_status(task1, "Done");
+  MockTask *task3 = mock_change_add_task(change, "clean");
+  mock_task_add_affected_snap(task3, "kicad");
+  g_autoptr(SdiChange) model = get_change_model(client, change);
+  g_assert_cmpuint(model->tasks->len, ==, 3);
+
+  // the strings are borrowed from the SnapdChange
+  GPtrArray *tasks = snapd_change_get_tasks(model->change);
+  g_assert_true(sdi_change_get_task(model, 0)->id ==
+                snapd_task_get_id(tasks->pdata[0]));
+
+  // the old tasks are found at the same position, and the new one isn't
+  SdiTask *new_task1 = sdi_change_get_task(model, 0);
+  SdiTask *old_task1 = sdi_change_find_task(old_model, new_task1->id, 0);
+  g_assert_nonnull(old_task1);
+  g_assert_cmpint(old_task1->status, ==, SDI_CHANGE_STATUS_DO);
+  g_assert_cmpint(new_task1->status, ==, SDI_CHANGE_STATUS_DONE);
+  SdiTask *new_task2 = sdi_change_get_task(model, 1);
+  SdiTask *old_task2 = sdi_change_find_task(old_model, new_task2->id, 1);
+  g_assert_nonnull(old_task2);
+  g_assert_cmpint(old_task2->status, ==, new_task2->status);
+  g_assert_cmpuint(old_task2->n_snaps, ==, 2);
+  g_assert_cmpstr(sdi_change_get_task_snap(old_model, old_task2, 1), ==,
+                  "gnome-42");
+  SdiTask *new_task3 = sdi_change_get_task(model, 2);
+  g_assert_null(sdi_change_find_task(old_model, new_task3->id, 2));
+
+  // a task at another position is found by its ID
+  g_assert_true(sdi_change_find_task(old_model, new_task2->id, 0) ==
+                old_task2);
+  g_assert_null(sdi_change_find_task(old_model, "unknown-id", 0));
+}
+
+static void test_desktop_file_index(void) {
+  g_autoptr(SdiDesktopFileIndex) index =
+      sdi_desktop_file_index_new(SNAPS_DESKTOP_FILES_FOLDER);
+
+  g_auto(GStrv) kicad_files =
+      sdi_desktop_file_index_get_desktop_files(index, "kicad");
+  g_assert_cmpuint(g_strv_length(kicad_files), ==, 1);
+  g_assert_cmpstr(kicad_files[0], ==, "kicad_kicad.desktop");
+  g_assert_true(sdi_desktop_file_index_contains(index, "kicad_kicad.desktop"));
+  g_assert_false(sdi_desktop_file_index_contains(index, "kicad_other.desktop"));
+
+  g_auto(GStrv) no_files =
+      sdi_desktop_file_index_get_desktop_files(index, "nonexistent");
+  g_assert_cmpuint(g_strv_length(no_files), ==, 0);
+}
+
+static bool index_contains(SdiDesktopFileIndex *index,
+                           const gchar *desktop_file, bool expected) {
+  gint64 end = g_get_monotonic_time() + 2 * G_USEC_PER_SEC;
+  while (g_get_monotonic_time() < end) {
+    if (sdi_desktop_file_index_contains(index, desktop_file) == expected) {
+      return true;
+    }
+    g_main_context_iteration(NULL, FALSE);
+    g_usleep(10000);
+  }
+  return false;
+}
+
+static void get_snaps_cb(GObject *source, GAsyncResult *res, gpointer data) {
+  GPtrArray **snaps = data;
+  g_autoptr(GError) error = NULL;
+  *snaps = sdi_snap_cache_get_snaps_finish(SDI_SNAP_CACHE(source), res, &error);
+  g_assert_no_error(error);
+}
+
+static void test_snap_cache_invalidate_while_fetching_several(void) {
+  reset_mock_snapd();
+  MockSnap *mock_snap1 = mock_snapd_add_snap(snapd, "kicad");
+  mock_snap_set_revision(mock_snap1, "1");
+  MockSnap *mock_snap2 = mock_snapd_add_snap(snapd, "simple-scan");
+  mock_snap_set_revision(mock_snap2, "1");
+  g_autoptr(SnapdClient) client = sdi_snapd_client_factory_new_snapd_client();
+  g_autoptr(SdiSnapCache) cache = sdi_snap_cache_new(client);
+
+  // the answer has the data at the time of the request, but arrives later
+  mock_snapd_set_snap_delay(snapd, 300);
+  const gchar *names[] = {"kicad", "simple-scan", NULL};
+  g_autoptr(GPtrArray) snaps = NULL;
+  sdi_snap_cache_get_snaps_async(cache, (GStrv)names, NULL, get_snaps_cb,
+                                 &snaps);
+  gboolean requested = FALSE;
+  g_timeout_add_once(100, set_flag_cb, &requested);
+  while (!requested) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+
+  // one of the snaps changes while they are being retrieved
+  mock_snap_set_revision(mock_snap1, "2");
+  sdi_snap_cache_invalidate(cache, "kicad");
+  while (snaps == NULL) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  mock_snapd_set_snap_delay(snapd, 0);
+  g_assert_cmpint(snaps->len, ==, 2);
+  g_assert_cmpstr(snapd_snap_get_name(snaps->pdata[0]), ==, "kicad");
+  g_assert_cmpstr(snapd_snap_get_revision(snaps->pdata[0]), ==, "1");
+
+  // so its old data must not be cached, but the other's must
+  g_autoptr(SnapdSnap) snap1 = sdi_snap_cache_lookup(cache, "kicad");
+  g_assert_null(snap1);
+  g_autoptr(SnapdSnap) snap2 = sdi_snap_cache_lookup(cache, "simple-scan");
+  g_assert_true(snap2 == snaps->pdata[1]);
+}
+
+static void test_desktop_file_index_changes(void) {
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *folder = g_dir_make_tmp("sdi-desktop-files-XXXXXX", &error);
+  g_assert_no_error(error);
+  g_autoptr(SdiDesktopFileIndex) index = sdi_desktop_file_index_new(folder);
+  g_autofree gchar *path1 =
+      g_build_filename(folder, "snap1_app1.desktop", NULL);
+  g_autofree gchar *path2 =
+      g_build_filename(folder, "snap1_app2.desktop", NULL);
+
+  // a new file must be added to the index...
+  g_assert_true(g_file_set_contents(path1, "", -1, NULL));
+  g_assert_true(index_contains(index, "snap1_app1.desktop", true));
+
+  // a renamed file must be updated...
+  g_assert_cmpint(g_rename(path1, path2), ==, 0);
+  g_assert_true(index_contains(index, "snap1_app2.desktop", true));
+  g_assert_true(index_contains(index, "snap1_app1.desktop", false));
+  g_auto(GStrv) snap1_files =
+      sdi_desktop_file_index_get_desktop_files(index, "snap1");
+  g_assert_cmpuint(g_strv_length(snap1_files), ==, 1);
+
+  // and a removed file must be removed from the index
+  g_assert_cmpint(g_remove(path2), ==, 0);
+  g_assert_true(index_contains(index, "snap1_app2.desktop", false));
+  g_assert_cmpint(g_rmdir(folder), ==, 0);
+}
+
+static void get_snap_cb(GObject *source, GAsyncResult *res, gpointer data) {
+  SnapdSnap **snap = data;
+  g_autoptr(GError) error = NULL;
+  *snap = sdi_snap_cache_get_snap_finish(SDI_SNAP_CACHE(source), res, &error);
+  g_assert_no_error(error);
+}
+
+static SnapdSnap *get_snap_from_cache(SdiSnapCache *cache, const gchar *name) {
+  SnapdSnap *snap = NULL;
+  sdi_snap_cache_get_snap_async(cache, name, NULL, get_snap_cb, &snap);
+  while (snap == NULL) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  return snap;
+}
+
+static void test_snap_cache(void) {
+  reset_mock_snapd();
+  MockSnap *mock_snap = mock_snapd_add_snap(snapd, "kicad");
+  mock_snap_set_revision(mock_snap, "1");
+  g_autoptr(SnapdClient) client = sdi_snapd_client_factory_new_snapd_client();
+  g_autoptr(SdiSnapCache) cache = sdi_snap_cache_new(client);
+
+  g_assert_null(sdi_snap_cache_lookup(cache, "kicad"));
+  g_autoptr(SnapdSnap) snap1 = get_snap_from_cache(cache, "kicad");
+  g_assert_cmpstr(snapd_snap_get_revision(snap1), ==, "1");
+
+  // the second time it must come from the cache, with the old data
+  mock_snap_set_revision(mock_snap, "2");
+  g_autoptr(SnapdSnap) snap2 = sdi_snap_cache_lookup(cache, "kicad");
+  g_assert_true(snap1 == snap2);
+
+  // until it is invalidated
+  sdi_snap_cache_invalidate(cache, "kicad");
+  g_assert_null(sdi_snap_cache_lookup(cache, "kicad"));
+  g_autoptr(SnapdSnap) snap3 = get_snap_from_cache(cache, "kicad");
+  g_assert_cmpstr(snapd_snap_get_revision(snap3), ==, "2");
+}
+
+static void test_snap_cache_invalidate_while_fetching(void) {
+  reset_mock_snapd();
+  MockSnap *mock_snap = mock_snapd_add_snap(snapd, "kicad");
+  mock_snap_set_revision(mock_snap, "1");
+  g_autoptr(SnapdClient) client = sdi_snapd_client_factory_new_snapd_client();
+  g_autoptr(SdiSnapCache) cache = sdi_snap_cache_new(client);
+
+  // the answer has the data at the time of the request, but arrives later
+  mock_snapd_set_snap_delay(snapd, 300);
+  g_autoptr(SnapdSnap) snap1 = NULL;
+  sdi_snap_cache_get_snap_async(cache, "kicad", NULL, get_snap_cb, &snap1);
+  gboolean requested = FALSE;
+  g_timeout_add_once(100, set_flag_cb, &requested);
+  while (!requested) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+
+  /* the snap changes while it is being retrieved, so a new request must not
+   * get the old data.
+   */
+  mock_snap_set_revision(mock_snap, "2");
+  sdi_snap_cache_invalidate(cache, "kicad");
+  g_autoptr(SnapdSnap) snap2 = NULL;
+  sdi_snap_cache_get_snap_async(cache, "kicad", NULL, get_snap_cb, &snap2);
+  while ((snap1 == NULL) || (snap2 == NULL)) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  mock_snapd_set_snap_delay(snapd, 0);
+  g_assert_cmpstr(snapd_snap_get_revision(snap1), ==, "1");
+  g_assert_cmpstr(snapd_snap_get_revision(snap2), ==, "2");
+
+  // and only the new data must be cached
+  g_autoptr(SnapdSnap) snap3 = sdi_snap_cache_lookup(cache, "kicad");
+  g_assert_true(snap3 == snap2);
+}
+
 static void test_sdi_get_desktop_file_from_snap_no_apps(void) {
   g_autoptr(GPtrArray) apps_array =
       g_ptr_array_new_with_free_func(g_object_unref);
@@ -966,6 +1667,70 @@ test_sdi_get_desktop_file_from_snap_two_valid_apps_none_right(void) {
   g_assert_null(app_info);
 }
 
+static gchar *write_desktop_file(const gchar *folder, const gchar *name,
+                                 const gchar *display_name,
+                                 gboolean with_icon) {
+  gchar *path = g_build_filename(folder, name, NULL);
+  g_autofree gchar *contents = g_strdup_printf(
+      "[Desktop Entry]\nType=Application\nName=%s\nExec=true\n%s",
+      display_name, with_icon ? "Icon=applications-other\n" : "");
+  g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+  return path;
+}
+
+static void test_sdi_get_desktop_file_from_snap_cache(void) {
+  g_autofree gchar *folder = g_dir_make_tmp("sdi-desktop-files-XXXXXX", NULL);
+  g_assert_nonnull(folder);
+  g_autofree gchar *first =
+      write_desktop_file(folder, "first.desktop", "First App", FALSE);
+  g_autofree gchar *second =
+      write_desktop_file(folder, "second.desktop", "Second App", TRUE);
+
+  g_autoptr(GPtrArray) apps_array =
+      g_ptr_array_new_with_free_func(g_object_unref);
+  g_ptr_array_add(apps_array, g_object_new(SNAPD_TYPE_APP, "name", "first",
+                                           "desktop-file", first, NULL));
+  g_ptr_array_add(apps_array, g_object_new(SNAPD_TYPE_APP, "name", "second",
+                                           "desktop-file", second, NULL));
+  g_autoptr(SnapdSnap) snap = g_object_new(
+      SNAPD_TYPE_SNAP, "name", "cached-snap", "apps", apps_array, NULL);
+
+  // the first file has no icon, so the second one is chosen
+  g_autoptr(GAppInfo) app_info1 = sdi_get_desktop_file_from_snap(snap);
+  g_assert_nonnull(app_info1);
+  g_assert_cmpstr(g_app_info_get_display_name(app_info1), ==, "Second App");
+  // and it is kept while it doesn't change
+  g_autoptr(GAppInfo) app_info2 = sdi_get_desktop_file_from_snap(snap);
+  g_assert_true(app_info2 == app_info1);
+
+  /* change the chosen file without changing its size nor the seconds of its
+   * modification time; the nanoseconds must be enough to detect it.
+   */
+  GStatBuf stat_data;
+  g_assert_cmpint(g_stat(second, &stat_data), ==, 0);
+  g_free(write_desktop_file(folder, "second.desktop", "Second Apq", TRUE));
+  struct timespec times[2] = {stat_data.st_atim, stat_data.st_mtim};
+  times[1].tv_nsec += (times[1].tv_nsec == 999999999) ? -1 : 1;
+  g_assert_cmpint(utimensat(AT_FDCWD, second, times, 0), ==, 0);
+  g_autoptr(GAppInfo) app_info3 = sdi_get_desktop_file_from_snap(snap);
+  g_assert_nonnull(app_info3);
+  g_assert_cmpstr(g_app_info_get_display_name(app_info3), ==, "Second Apq");
+
+  // if the chosen file is removed, the snap has no file with an icon
+  g_assert_cmpint(g_remove(second), ==, 0);
+  g_autoptr(GAppInfo) app_info4 = sdi_get_desktop_file_from_snap(snap);
+  g_assert_null(app_info4);
+
+  // and if another file gets an icon, it is chosen
+  g_free(write_desktop_file(folder, "first.desktop", "First App", TRUE));
+  g_autoptr(GAppInfo) app_info5 = sdi_get_desktop_file_from_snap(snap);
+  g_assert_nonnull(app_info5);
+  g_assert_cmpstr(g_app_info_get_display_name(app_info5), ==, "First App");
+
+  g_assert_cmpint(g_remove(first), ==, 0);
+  g_assert_cmpint(g_rmdir(folder), ==, 0);
+}
+
 static void
 test_refresh_inhibit_with_negative_value_dont_shows_notifications(void) {
   // https://github.com/canonical/snapd-desktop-integration/issues/135
@@ -1000,6 +1765,10 @@ static void do_activate(GObject *object, gpointer data) {
   g_test_add_func("/refresh/no-pending", test_refresh_inhibit_no_pending);
   g_test_add_func("/refresh/one-pending", test_refresh_inhibit_one_pending);
   g_test_add_func("/refresh/three-pending", test_refresh_inhibit_three_pending);
+  g_test_add_func("/refresh/burst", test_refresh_inhibit_burst);
+  g_test_add_func("/refresh/repeated", test_refresh_inhibit_repeated);
+  g_test_add_func("/refresh/forced-threshold",
+                  test_refresh_inhibit_forced_threshold);
   g_test_add_func("/refresh/dont-show-again",
                   test_refresh_inhibit_dont_show_again);
   g_test_add_func("/refresh/dont-show-again-new-snap",
@@ -1022,10 +1791,19 @@ static void do_activate(GObject *object, gpointer data) {
   g_test_add_data_func("/update/non-inhibited-snap-refresh-snap",
                        (const void *)"refresh-snap",
                        test_refresh_progress_for_non_inhibited_snap);
+  g_test_add_func("/update/concurrent-changes",
+                  test_refresh_progress_concurrent_changes);
+  g_test_add_func("/update/adaptive-change-checks",
+                  test_adaptive_change_checks);
   g_test_add_func("/update/inhibited-non-announced-refresh",
                   test_signals_inhibited_not_announced_refresh);
   g_test_add_func("/update/inhibited-announced-refresh",
                   test_signals_inhibited_announced_refresh);
+  g_test_add_func("/update/begin-refresh-placeholder",
+                  test_begin_refresh_placeholder);
+  g_test_add_func("/update/refresh-complete-multiple",
+                  test_refresh_complete_multiple);
+  g_test_add_func("/update/task-status-progress", test_task_status_progress);
 
   g_test_add_data_func("/cancelled/abort", (const void *)"Abort",
                        test_cancelled_refresh);
@@ -1037,6 +1815,16 @@ static void do_activate(GObject *object, gpointer data) {
                        test_cancelled_refresh);
   g_test_add_data_func("/cancelled/error", (const void *)"Error",
                        test_cancelled_refresh);
+  g_test_add_func("/others/change-model-status", test_change_model_status);
+  g_test_add_func("/others/change-model-diff", test_change_model_diff);
+  g_test_add_func("/others/desktop-file-index", test_desktop_file_index);
+  g_test_add_func("/others/snap-cache", test_snap_cache);
+  g_test_add_func("/others/snap-cache-invalidate-while-fetching",
+                  test_snap_cache_invalidate_while_fetching);
+  g_test_add_func("/others/snap-cache-invalidate-while-fetching-several",
+                  test_snap_cache_invalidate_while_fetching_several);
+  g_test_add_func("/others/desktop-file-index-changes",
+                  test_desktop_file_index_changes);
   g_test_add_func("/others/get-desktop-file-from-snap-no-apps",
                   test_sdi_get_desktop_file_from_snap_no_apps);
   g_test_add_func("/others/get-desktop-file-from-snap-one-valid-app",
@@ -1050,6 +1838,8 @@ static void do_activate(GObject *object, gpointer data) {
   g_test_add_func(
       "/others/get-desktop-file-from-snap-two-valid-apps-none-right",
       test_sdi_get_desktop_file_from_snap_two_valid_apps_none_right);
+  g_test_add_func("/others/get-desktop-file-from-snap-cache",
+                  test_sdi_get_desktop_file_from_snap_cache);
 
   g_test_run();
   g_application_release(G_APPLICATION(object));
@@ -0,0 +1,158 @@
+#include "../src/sdi-deadline-scheduler.h"
+
+typedef struct {
+  // keys received in the `deadline` signals, in order
+  GPtrArray *keys;
+  // number of times that the timer has been armed
+  guint timers;
+} SchedulerData;
+
+static void deadline_cb(SdiDeadlineScheduler *scheduler, const gchar *key,
+                        SchedulerData *data) {
+  g_ptr_array_add(data->keys, g_strdup(key));
+}
+
+static void timer_scheduled_cb(SdiDeadlineScheduler *scheduler, guint delay,
+                               SchedulerData *data) {
+  data->timers++;
+}
+
+static SdiDeadlineScheduler *new_scheduler(SchedulerData *data) {
+  data->keys = g_ptr_array_new_with_free_func(g_free);
+  data->timers = 0;
+  SdiDeadlineScheduler *scheduler = sdi_deadline_scheduler_new();
+  g_signal_connect(scheduler, "deadline", (GCallback)deadline_cb, data);
+  g_signal_connect(scheduler, "timer-scheduled",
+                   (GCallback)timer_scheduled_cb, data);
+  return scheduler;
+}
+
+static void set_flag_cb(gpointer data) { *((gboolean *)data) = TRUE; }
+
+/* Iterates the main loop until `n_keys` deadlines have been emitted, and then
+ * a bit more, to check that no other one is.
+ */
+static void wait_for_deadlines(SchedulerData *data, guint n_keys) {
+  gboolean timeout = FALSE;
+  guint timeout_id = g_timeout_add_once(2000, set_flag_cb, &timeout);
+  while (!timeout && (data->keys->len < n_keys)) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_false(timeout);
+  g_source_remove(timeout_id);
+
+  gboolean waited = FALSE;
+  g_timeout_add_once(200, set_flag_cb, &waited);
+  while (!waited) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_cmpint(data->keys->len, ==, n_keys);
+}
+
+static void test_order(void) {
+  SchedulerData data;
+  g_autoptr(SdiDeadlineScheduler) scheduler = new_scheduler(&data);
+  gint64 now = g_get_real_time();
+
+  // only the deadlines that become the earliest one re-arm the timer
+  sdi_deadline_scheduler_set(scheduler, "a", now + 300000);
+  sdi_deadline_scheduler_set(scheduler, "b", now + 100000);
+  sdi_deadline_scheduler_set(scheduler, "c", now + 200000);
+  sdi_deadline_scheduler_set(scheduler, "d", now + 400000);
+  sdi_deadline_scheduler_set(scheduler, "e", now + 250000);
+  g_assert_cmpint(data.timers, ==, 2);
+
+  // setting the same time again does nothing
+  sdi_deadline_scheduler_set(scheduler, "b", now + 100000);
+  g_assert_cmpint(data.timers, ==, 2);
+
+  // removing one from the middle doesn't change the earliest one
+  sdi_deadline_scheduler_remove(scheduler, "c");
+  g_assert_cmpint(data.timers, ==, 2);
+
+  // moving one earlier, but not before the earliest one...
+  sdi_deadline_scheduler_set(scheduler, "d", now + 150000);
+  g_assert_cmpint(data.timers, ==, 2);
+  // ...or later
+  sdi_deadline_scheduler_set(scheduler, "a", now + 500000);
+  g_assert_cmpint(data.timers, ==, 2);
+
+  // moving one before the earliest one
+  sdi_deadline_scheduler_set(scheduler, "e", now + 50000);
+  g_assert_cmpint(data.timers, ==, 3);
+  // moving the earliest one later, behind others
+  sdi_deadline_scheduler_set(scheduler, "e", now + 350000);
+  g_assert_cmpint(data.timers, ==, 4);
+  // moving the earliest one, but still being the earliest
+  sdi_deadline_scheduler_set(scheduler, "b", now + 120000);
+  g_assert_cmpint(data.timers, ==, 5);
+
+  wait_for_deadlines(&data, 4);
+  g_assert_cmpstr(data.keys->pdata[0], ==, "b");
+  g_assert_cmpstr(data.keys->pdata[1], ==, "d");
+  g_assert_cmpstr(data.keys->pdata[2], ==, "e");
+  g_assert_cmpstr(data.keys->pdata[3], ==, "a");
+  g_ptr_array_unref(data.keys);
+}
+
+static void test_remove_first(void) {
+  SchedulerData data;
+  g_autoptr(SdiDeadlineScheduler) scheduler = new_scheduler(&data);
+  gint64 now = g_get_real_time();
+
+  sdi_deadline_scheduler_set(scheduler, "a", now + 100000);
+  sdi_deadline_scheduler_set(scheduler, "b", now + 200000);
+  sdi_deadline_scheduler_set(scheduler, "c", now + 300000);
+  g_assert_cmpint(data.timers, ==, 1);
+
+  // the timer must be re-armed for the next one
+  sdi_deadline_scheduler_remove(scheduler, "a");
+  g_assert_cmpint(data.timers, ==, 2);
+  // removing an unknown key does nothing
+  sdi_deadline_scheduler_remove(scheduler, "a");
+  g_assert_cmpint(data.timers, ==, 2);
+
+  wait_for_deadlines(&data, 2);
+  g_assert_cmpstr(data.keys->pdata[0], ==, "b");
+  g_assert_cmpstr(data.keys->pdata[1], ==, "c");
+  g_ptr_array_unref(data.keys);
+}
+
+static void test_several_due(void) {
+  SchedulerData data;
+  g_autoptr(SdiDeadlineScheduler) scheduler = new_scheduler(&data);
+  gint64 now = g_get_real_time();
+
+  // the deadlines that have already passed are all emitted at once, in order
+  sdi_deadline_scheduler_set(scheduler, "a", now - 3000000);
+  sdi_deadline_scheduler_set(scheduler, "b", now - 1000000);
+  sdi_deadline_scheduler_set(scheduler, "c", now - 2000000);
+  sdi_deadline_scheduler_set(scheduler, "d", now + 1000000);
+  g_assert_cmpint(data.timers, ==, 1);
+
+  gboolean done = FALSE;
+  g_timeout_add_once(200, set_flag_cb, &done);
+  while (!done) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_cmpint(data.keys->len, ==, 3);
+  g_assert_cmpstr(data.keys->pdata[0], ==, "a");
+  g_assert_cmpstr(data.keys->pdata[1], ==, "c");
+  g_assert_cmpstr(data.keys->pdata[2], ==, "b");
+  // and then the timer is armed for the remaining one
+  g_assert_cmpint(data.timers, ==, 2);
+
+  wait_for_deadlines(&data, 4);
+  g_assert_cmpstr(data.keys->pdata[3], ==, "d");
+  g_ptr_array_unref(data.keys);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/deadline-scheduler/order", test_order);
+  g_test_add_func("/deadline-scheduler/remove-first", test_remove_first);
+  g_test_add_func("/deadline-scheduler/several-due", test_several_due);
+
+  return g_test_run();
+}
@@ -0,0 +1,148 @@
+#include "../src/sdi-fdo-notification.h"
+#include "mock-fdo-notifications.h"
+
+static MockFdoNotifications *mock_notifications = NULL;
+
+static void setup_connection(void) {
+  sdi_fdo_notification_shutdown();
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GDBusConnection) bus =
+      g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+  g_assert_no_error(error);
+  sdi_fdo_notification_setup(bus, "test-sdi-fdo-notification");
+}
+
+static void action_cb(SdiFdoNotification *notification, gchar *action,
+                      gpointer data) {
+  gchar **received_action = data;
+  g_free(*received_action);
+  *received_action = g_strdup(action);
+}
+
+static void closed_cb(SdiFdoNotification *notification, gboolean *closed) {
+  *closed = TRUE;
+}
+
+static void test_wait_for_connection(void) {
+  // the connection is requested by the first notification, without waiting
+  sdi_fdo_notification_shutdown();
+  g_autoptr(SdiFdoNotification) notification1 =
+      sdi_fdo_notification_new("Title 1", "Body 1", NULL);
+  g_autoptr(SdiFdoNotification) notification2 =
+      sdi_fdo_notification_new("Title 2", "Body 2", NULL);
+  sdi_fdo_notification_show(notification1);
+  sdi_fdo_notification_show(notification1);
+  sdi_fdo_notification_show(notification2);
+  sdi_fdo_notification_close(notification2);
+
+  // once connected, only the first one must be shown, and only once
+  MockNotificationsData *data =
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(data->title, ==, "Title 1");
+  g_assert_cmpint(data->replaces_id, ==, 0);
+  guint32 uid = data->uid;
+  g_assert_null(
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 300));
+
+  sdi_fdo_notification_close(notification1);
+  g_assert_cmpint(
+      mock_fdo_notifications_wait_for_close(mock_notifications, 1000), ==, uid);
+}
+
+static void test_show_while_pending(void) {
+  setup_connection();
+  g_autoptr(SdiFdoNotification) notification =
+      sdi_fdo_notification_new("Title 1", "Body 1", NULL);
+  sdi_fdo_notification_show(notification);
+  // the ID to replace isn't known yet, so this must wait for the reply
+  sdi_fdo_notification_update(notification, "Title 2", "Body 2", NULL);
+  sdi_fdo_notification_show(notification);
+
+  MockNotificationsData *data =
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(data->title, ==, "Title 1");
+  g_assert_cmpint(data->replaces_id, ==, 0);
+  guint32 uid = data->uid;
+
+  data = mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(data->title, ==, "Title 2");
+  g_assert_cmpstr(data->body, ==, "Body 2");
+  g_assert_cmpint(data->replaces_id, ==, uid);
+  g_assert_null(
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 300));
+
+  sdi_fdo_notification_close(notification);
+  g_assert_cmpint(
+      mock_fdo_notifications_wait_for_close(mock_notifications, 1000), ==, uid);
+}
+
+static void test_close_while_pending(void) {
+  setup_connection();
+  g_autoptr(SdiFdoNotification) notification =
+      sdi_fdo_notification_new("Title", "Body", NULL);
+  sdi_fdo_notification_show(notification);
+  // the ID to close isn't known yet, so this must wait for the reply
+  sdi_fdo_notification_close(notification);
+
+  MockNotificationsData *data =
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(data->title, ==, "Title");
+  g_assert_cmpint(
+      mock_fdo_notifications_wait_for_close(mock_notifications, 1000), ==,
+      data->uid);
+  g_assert_null(
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 300));
+}
+
+static void test_actions(void) {
+  setup_connection();
+  g_autoptr(SdiFdoNotification) notification =
+      sdi_fdo_notification_new("Title", "Body", NULL);
+  g_autofree gchar *action = NULL;
+  gboolean closed = FALSE;
+  sdi_fdo_notification_add_action(notification, "yes", "Yes", action_cb,
+                                  &action, NULL);
+  g_signal_connect(notification, "closed", (GCallback)closed_cb, &closed);
+  sdi_fdo_notification_show(notification);
+
+  MockNotificationsData *data =
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpint(g_strv_length(data->actions), ==, 2);
+
+  // the signals come from the owner of the notifications name
+  mock_fdo_notifications_send_action(mock_notifications, data->uid, "yes");
+  while (!closed) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_cmpstr(action, ==, "yes");
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GError) error = NULL;
+  if (!mock_fdo_notifications_setup_session_bus(&error)) {
+    g_error("Failed to set up a new dbus-daemon for the emulation: %s",
+            error->message);
+  }
+
+  mock_notifications = mock_fdo_notifications_new();
+  mock_fdo_notifications_run(mock_notifications, argc, argv);
+
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/fdo-notification/wait-for-connection",
+                  test_wait_for_connection);
+  g_test_add_func("/fdo-notification/show-while-pending",
+                  test_show_while_pending);
+  g_test_add_func("/fdo-notification/close-while-pending",
+                  test_close_while_pending);
+  g_test_add_func("/fdo-notification/actions", test_actions);
+
+  int result = g_test_run();
+  sdi_fdo_notification_shutdown();
+  return result;
+}
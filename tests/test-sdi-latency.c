@@ -0,0 +1,96 @@
+#include "../src/sdi-latency.h"
+
+static void test_buckets(void) {
+  sdi_latency_shutdown();
+  g_assert_null(sdi_latency_report());
+
+  // the times are in microseconds, and are truncated to ms
+  sdi_latency_add_sample(SDI_LATENCY_FETCH, SDI_LATENCY_SINCE_OCCURRED, -5000);
+  sdi_latency_add_sample(SDI_LATENCY_FETCH, SDI_LATENCY_SINCE_OCCURRED, 500);
+  sdi_latency_add_sample(SDI_LATENCY_FETCH, SDI_LATENCY_SINCE_OCCURRED, 1999);
+  sdi_latency_add_sample(SDI_LATENCY_FETCH, SDI_LATENCY_SINCE_OCCURRED, 3000);
+  sdi_latency_add_sample(SDI_LATENCY_FETCH, SDI_LATENCY_SINCE_OCCURRED,
+                         150000);
+  sdi_latency_add_sample(SDI_LATENCY_FETCH, SDI_LATENCY_SINCE_OCCURRED,
+                         20000000);
+
+  // only the histograms with samples are reported, without empty buckets
+  g_autofree gchar *report = sdi_latency_report();
+  g_assert_cmpstr(report, ==,
+                  "fetch since occurred: 6 samples, mean 3359 ms, p50 1 ms, "
+                  "p95 20000 ms, max 20000 ms; <=1ms:3 <=5ms:1 <=200ms:1 "
+                  ">10000ms:1\n");
+}
+
+static void test_percentiles(void) {
+  sdi_latency_shutdown();
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_RECEIVED, 50),
+                  ==, -1);
+
+  for (gint64 time = 1; time <= 100; time++) {
+    sdi_latency_add_sample(SDI_LATENCY_DOCK, SDI_LATENCY_SINCE_RECEIVED,
+                           time * 1000);
+  }
+  // the estimate is the upper limit of the bucket with that percentile
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_RECEIVED, 0),
+                  ==, 1);
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_RECEIVED, 10),
+                  ==, 10);
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_RECEIVED, 11),
+                  ==, 20);
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_RECEIVED, 50),
+                  ==, 50);
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_RECEIVED, 95),
+                  ==, 100);
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_RECEIVED, 100),
+                  ==, 100);
+  // the other histograms are independent
+  g_assert_cmpint(sdi_latency_get_percentile(SDI_LATENCY_DOCK,
+                                             SDI_LATENCY_SINCE_OCCURRED, 50),
+                  ==, -1);
+
+  // but never above the maximum time measured
+  sdi_latency_add_sample(SDI_LATENCY_NOTIFICATION, SDI_LATENCY_SINCE_RECEIVED,
+                         30000);
+  g_assert_cmpint(
+      sdi_latency_get_percentile(SDI_LATENCY_NOTIFICATION,
+                                 SDI_LATENCY_SINCE_RECEIVED, 50),
+      ==, 30);
+  // and the times in the last bucket are estimated with the maximum
+  sdi_latency_add_sample(SDI_LATENCY_NOTIFICATION, SDI_LATENCY_SINCE_RECEIVED,
+                         12000000);
+  g_assert_cmpint(
+      sdi_latency_get_percentile(SDI_LATENCY_NOTIFICATION,
+                                 SDI_LATENCY_SINCE_RECEIVED, 100),
+      ==, 12000);
+}
+
+static void test_shutdown(void) {
+  sdi_latency_add_sample(SDI_LATENCY_BEGIN_REFRESH, SDI_LATENCY_SINCE_OCCURRED,
+                         1000);
+  sdi_latency_shutdown();
+  g_assert_null(sdi_latency_report());
+  g_assert_cmpint(
+      sdi_latency_get_percentile(SDI_LATENCY_BEGIN_REFRESH,
+                                 SDI_LATENCY_SINCE_OCCURRED, 50),
+      ==, -1);
+  // the module can be used again after a shutdown
+  sdi_latency_record(SDI_LATENCY_BEGIN_REFRESH, "1");
+  sdi_latency_record_snap(SDI_LATENCY_DOCK, "a-snap");
+  g_assert_null(sdi_latency_report());
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+  g_test_add_func("/latency/buckets", test_buckets);
+  g_test_add_func("/latency/percentiles", test_percentiles);
+  g_test_add_func("/latency/shutdown", test_shutdown);
+  return g_test_run();
+}
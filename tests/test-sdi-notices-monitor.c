@@ -23,16 +23,19 @@ static void async_data_free(AsyncData *data) {
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(AsyncData, async_data_free)
 
-static MockNotice *create_notice(MockSnapd *snapd, const gchar *kind) {
-  MockNotice *notice = mock_snapd_add_notice(snapd, "1", "8473", kind);
+/* Creates a notice that happened the specified day of March 2024. */
+static MockNotice *create_notice(MockSnapd *snapd, const gchar *kind,
+                                 gint day) {
+  g_autofree gchar *id = g_strdup_printf("%d", day);
+  MockNotice *notice = mock_snapd_add_notice(snapd, id, "8473", kind);
   g_autoptr(GTimeZone) timezone = g_time_zone_new_utc();
 
   g_autoptr(GDateTime) first_occurred =
-      g_date_time_new(timezone, 2024, 3, 1, 20, 29, 58);
+      g_date_time_new(timezone, 2024, 3, day, 20, 29, 58);
   g_autoptr(GDateTime) last_occurred =
-      g_date_time_new(timezone, 2024, 3, 2, 23, 28, 8);
+      g_date_time_new(timezone, 2024, 3, day + 1, 23, 28, 8);
   g_autoptr(GDateTime) last_repeated =
-      g_date_time_new(timezone, 2024, 3, 3, 22, 20, 7);
+      g_date_time_new(timezone, 2024, 3, day + 2, 22, 20, 7);
   mock_notice_set_dates(notice, first_occurred, last_occurred, last_repeated,
                         5);
   mock_notice_set_nanoseconds(notice, 6);
@@ -49,24 +52,19 @@ static void test_notices_events_are_received_cb(SdiSnapdMonitor *self,
     g_assert_true(first_set);
     g_assert_cmpint(snapd_notice_get_notice_type(notice), ==,
                     SNAPD_NOTICE_TYPE_CHANGE_UPDATE);
-    /* close the socket
-     * Called twice because there are two references:
-     * one in the 'snapd' variable, in the calling function, and another one in
-     * `data` struct.
+    /* stop and start again the snapd mock, simulating that the daemon died
+     * and a new one was launched. The socket is closed, but the old notices
+     * are kept by snapd.
      */
-    g_object_unref(data->snapd);
-    g_object_unref(data->snapd);
-    /* we create a new snapd mock, simulating that the daemon died and a new one
-     * was launched
-     */
-    data->snapd = g_object_ref(mock_snapd_new());
-    const gchar *path = mock_snapd_get_socket_path(data->snapd);
+    mock_snapd_stop(data->snapd);
+    create_notice(data->snapd, "refresh-inhibit", 2);
     g_assert_true(mock_snapd_start(data->snapd, NULL));
-    sdi_snapd_client_factory_set_custom_path((gchar *)path);
-    create_notice(data->snapd, "refresh-inhibit");
     break;
   case 2:
-    g_assert_true(first_set);
+    /* only the new notice must be received, and it isn't part of the first
+     * set, because the monitor continues from the last notice received.
+     */
+    g_assert_false(first_set);
     g_assert_cmpint(snapd_notice_get_notice_type(notice), ==,
                     SNAPD_NOTICE_TYPE_REFRESH_INHIBIT);
     g_main_loop_quit(data->loop);
@@ -77,7 +75,7 @@ static void test_notices_events_are_received_cb(SdiSnapdMonitor *self,
 static void test_notices_events_are_received(void) {
   g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
 
-  MockSnapd *snapd = mock_snapd_new();
+  g_autoptr(MockSnapd) snapd = mock_snapd_new();
   g_autoptr(AsyncData) data = async_data_new(loop, snapd);
 
   const gchar *path = mock_snapd_get_socket_path(snapd);
@@ -89,17 +87,261 @@ static void test_notices_events_are_received(void) {
   g_signal_connect(G_OBJECT(snapd_monitor), "notice-event",
                    G_CALLBACK(test_notices_events_are_received_cb), data);
 
-  create_notice(snapd, "change-update");
+  create_notice(snapd, "change-update", 1);
 
   g_assert_true(sdi_snapd_monitor_start(snapd_monitor));
   g_main_loop_run(loop);
   g_assert_cmpint(data->counter, ==, 2);
-  g_object_unref(data->snapd); // it has two references
+}
+
+static void test_notices_cursor_is_stored_cb(SdiSnapdMonitor *self,
+                                             SnapdNotice *notice,
+                                             gboolean first_set,
+                                             AsyncData *data) {
+  data->counter++;
+  if (data->counter == 1) {
+    g_assert_true(first_set);
+  } else {
+    g_assert_false(first_set);
+    g_assert_cmpint(snapd_notice_get_notice_type(notice), ==,
+                    SNAPD_NOTICE_TYPE_REFRESH_INHIBIT);
+  }
+  g_main_loop_quit(data->loop);
+}
+
+static void test_notices_cursor_is_stored(void) {
+  g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+  g_autoptr(MockSnapd) snapd = mock_snapd_new();
+  g_autoptr(AsyncData) data = async_data_new(loop, snapd);
+
+  sdi_snapd_client_factory_set_custom_path(
+      (gchar *)mock_snapd_get_socket_path(snapd));
+  g_assert_true(mock_snapd_start(snapd, NULL));
+  create_notice(snapd, "change-update", 1);
+
+  SdiSnapdMonitor *snapd_monitor = sdi_snapd_monitor_new();
+  g_signal_connect(G_OBJECT(snapd_monitor), "notice-event",
+                   G_CALLBACK(test_notices_cursor_is_stored_cb), data);
+  g_assert_true(sdi_snapd_monitor_start(snapd_monitor));
+  g_main_loop_run(loop);
+  g_assert_cmpint(data->counter, ==, 1);
+  g_object_unref(snapd_monitor);
+
+  /* a new monitor, like after restarting the daemon, must receive only the
+   * notices after the last one already received.
+   */
+  create_notice(snapd, "refresh-inhibit", 2);
+  g_autoptr(SdiSnapdMonitor) snapd_monitor2 = sdi_snapd_monitor_new();
+  g_signal_connect(G_OBJECT(snapd_monitor2), "notice-event",
+                   G_CALLBACK(test_notices_cursor_is_stored_cb), data);
+  g_assert_true(sdi_snapd_monitor_start(snapd_monitor2));
+  g_main_loop_run(loop);
+  g_assert_cmpint(data->counter, ==, 2);
+}
+
+static void test_notices_filter_cb(SdiSnapdMonitor *self, SnapdNotice *notice,
+                                   gboolean first_set, AsyncData *data) {
+  data->counter++;
+  g_assert_cmpstr(snapd_notice_get_id(notice), ==, "2");
+  g_main_loop_quit(data->loop);
+}
+
+static void test_notices_filter(void) {
+  g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+  g_autoptr(MockSnapd) snapd = mock_snapd_new();
+  g_autoptr(AsyncData) data = async_data_new(loop, snapd);
+
+  sdi_snapd_client_factory_set_custom_path(
+      (gchar *)mock_snapd_get_socket_path(snapd));
+  g_assert_true(mock_snapd_start(snapd, NULL));
+  MockNotice *notice1 = create_notice(snapd, "change-update", 1);
+  mock_notice_add_data_pair(notice1, "kind", "install-snap");
+  MockNotice *notice2 = create_notice(snapd, "change-update", 2);
+  mock_notice_add_data_pair(notice2, "kind", "auto-refresh");
+
+  g_autoptr(SdiSnapdMonitor) snapd_monitor = sdi_snapd_monitor_new();
+  sdi_snapd_monitor_add_notice_type(snapd_monitor, "change-update");
+  sdi_snapd_monitor_add_change_kind(snapd_monitor, "auto-refresh");
+  g_signal_connect(G_OBJECT(snapd_monitor), "notice-event",
+                   G_CALLBACK(test_notices_filter_cb), data);
+  g_assert_true(sdi_snapd_monitor_start(snapd_monitor));
+  g_main_loop_run(loop);
+  g_assert_cmpint(data->counter, ==, 1);
+
+  /* only the requested types must have been asked to snapd. Stop the mock
+   * first, because the monitor keeps doing requests.
+   */
+  mock_snapd_stop(snapd);
+  g_autoptr(GHashTable) parameters =
+      g_uri_parse_params(mock_snapd_get_notices_parameters(snapd), -1, "&",
+                         G_URI_PARAMS_NONE, NULL);
+  g_assert_nonnull(parameters);
+  g_assert_cmpstr(g_hash_table_lookup(parameters, "types"), ==,
+                  "change-update");
+}
+
+static void test_notices_queue_cb(SdiSnapdMonitor *self, SnapdNotice *notice,
+                                  gboolean first_set, AsyncData *data) {
+  data->counter++;
+  switch (data->counter) {
+  case 1:
+    // the refresh-inhibit notice must be sent first
+    g_assert_cmpint(snapd_notice_get_notice_type(notice), ==,
+                    SNAPD_NOTICE_TYPE_REFRESH_INHIBIT);
+    break;
+  case 2:
+    // and only the newest of the notices with the same key
+    g_assert_cmpint(snapd_notice_get_notice_type(notice), ==,
+                    SNAPD_NOTICE_TYPE_CHANGE_UPDATE);
+    g_assert_cmpstr(snapd_notice_get_id(notice), ==, "3");
+    g_timeout_add_once(200, (GSourceOnceFunc)g_main_loop_quit, data->loop);
+    break;
+  default:
+    g_assert_not_reached();
+  }
+}
+
+static void test_notices_queue(void) {
+  g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+  g_autoptr(MockSnapd) snapd = mock_snapd_new();
+  g_autoptr(AsyncData) data = async_data_new(loop, snapd);
+
+  sdi_snapd_client_factory_set_custom_path(
+      (gchar *)mock_snapd_get_socket_path(snapd));
+  g_assert_true(mock_snapd_start(snapd, NULL));
+  create_notice(snapd, "change-update", 1);
+  create_notice(snapd, "change-update", 2);
+  create_notice(snapd, "change-update", 3);
+  create_notice(snapd, "refresh-inhibit", 4);
+
+  g_autoptr(SdiSnapdMonitor) snapd_monitor = sdi_snapd_monitor_new();
+  g_signal_connect(G_OBJECT(snapd_monitor), "notice-event",
+                   G_CALLBACK(test_notices_queue_cb), data);
+  g_assert_true(sdi_snapd_monitor_start(snapd_monitor));
+  g_main_loop_run(loop);
+  g_assert_cmpint(data->counter, ==, 2);
+}
+
+typedef struct {
+  GMainLoop *loop;
+  MockSnapd *snapd;
+  // reconnection delays announced by the monitor
+  GArray *delays;
+  // monotonic time when the mock snapd was started again
+  gint64 restart_time;
+  int counter;
+} ReconnectData;
+
+static void test_reconnect_notice_cb(SdiSnapdMonitor *self,
+                                     SnapdNotice *notice, gboolean first_set,
+                                     ReconnectData *data) {
+  data->counter++;
+  switch (data->counter) {
+  case 1:
+    // snapd goes away, so the monitor must start to reconnect
+    mock_snapd_stop(data->snapd);
+    break;
+  case 2:
+    /* the socket was created again, so the monitor must have connected
+     * without waiting for the timer, that was set for at least 400 ms.
+     */
+    g_assert_cmpstr(snapd_notice_get_id(notice), ==, "2");
+    g_assert_cmpint(g_get_monotonic_time() - data->restart_time, <,
+                    400 * 1000);
+    // the connection worked, so the next failure starts the backoff again
+    mock_snapd_stop(data->snapd);
+    break;
+  default:
+    g_assert_not_reached();
+  }
+}
+
+static void test_reconnect_scheduled_cb(SdiSnapdMonitor *self, guint delay,
+                                        ReconnectData *data) {
+  g_array_append_val(data->delays, delay);
+  switch (data->delays->len) {
+  case 4:
+    create_notice(data->snapd, "refresh-inhibit", 2);
+    data->restart_time = g_get_monotonic_time();
+    g_assert_true(mock_snapd_start(data->snapd, NULL));
+    break;
+  case 5:
+    g_main_loop_quit(data->loop);
+    break;
+  }
+}
+
+static void test_notices_reconnect(void) {
+  g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+  g_autoptr(MockSnapd) snapd = mock_snapd_new();
+  g_autoptr(GArray) delays = g_array_new(FALSE, FALSE, sizeof(guint));
+  ReconnectData data = {.loop = loop, .snapd = snapd, .delays = delays};
+
+  sdi_snapd_client_factory_set_custom_path(
+      (gchar *)mock_snapd_get_socket_path(snapd));
+  g_assert_true(mock_snapd_start(snapd, NULL));
+  create_notice(snapd, "change-update", 1);
+
+  g_autoptr(SdiSnapdMonitor) snapd_monitor = sdi_snapd_monitor_new();
+  g_signal_connect(G_OBJECT(snapd_monitor), "notice-event",
+                   G_CALLBACK(test_reconnect_notice_cb), &data);
+  g_signal_connect(G_OBJECT(snapd_monitor), "reconnect-scheduled",
+                   G_CALLBACK(test_reconnect_scheduled_cb), &data);
+  g_assert_true(sdi_snapd_monitor_start(snapd_monitor));
+  g_main_loop_run(loop);
+  g_assert_cmpint(data.counter, ==, 2);
+
+  // the delay doubles after each failure, and is reset after a success
+  g_assert_cmpint(delays->len, ==, 5);
+  g_assert_cmpint(g_array_index(delays, guint, 0), ==, 100);
+  g_assert_cmpint(g_array_index(delays, guint, 1), ==, 200);
+  g_assert_cmpint(g_array_index(delays, guint, 2), ==, 400);
+  g_assert_cmpint(g_array_index(delays, guint, 3), ==, 800);
+  g_assert_cmpint(g_array_index(delays, guint, 4), ==, 100);
+}
+
+static void test_client_pool(void) {
+  sdi_snapd_client_factory_set_custom_path("/tmp/snapd-test-1.socket");
+
+  // the shared clients are handed out in turns
+  g_autoptr(SnapdClient) client1 = sdi_snapd_client_factory_get_client();
+  g_autoptr(SnapdClient) client2 = sdi_snapd_client_factory_get_client();
+  g_autoptr(SnapdClient) client3 = sdi_snapd_client_factory_get_client();
+  g_autoptr(SnapdClient) client4 = sdi_snapd_client_factory_get_client();
+  g_assert_true(client1 != client2);
+  g_assert_true(client3 == client1);
+  g_assert_true(client4 == client2);
+  g_assert_cmpstr(snapd_client_get_socket_path(client1), ==,
+                  "/tmp/snapd-test-1.socket");
+  g_assert_cmpstr(snapd_client_get_socket_path(client2), ==,
+                  "/tmp/snapd-test-1.socket");
+
+  // but a new path needs new clients
+  sdi_snapd_client_factory_set_custom_path("/tmp/snapd-test-2.socket");
+  g_autoptr(SnapdClient) client5 = sdi_snapd_client_factory_get_client();
+  g_assert_true(client5 != client1);
+  g_assert_true(client5 != client2);
+  g_assert_cmpstr(snapd_client_get_socket_path(client5), ==,
+                  "/tmp/snapd-test-2.socket");
+
+  // the own clients are never shared
+  g_autoptr(SnapdClient) own_client =
+      sdi_snapd_client_factory_new_snapd_client();
+  g_assert_true(own_client != client5);
+  g_assert_cmpstr(snapd_client_get_socket_path(own_client), ==,
+                  "/tmp/snapd-test-2.socket");
 }
 
 int main(int argc, char **argv) {
-  g_test_init(&argc, &argv, NULL);
+  // each test gets its own XDG_RUNTIME_DIR, where the cursor is stored
+  g_test_init(&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, NULL);
   g_test_add_func("/sdi-snapd-monitor/receive-notices",
                   test_notices_events_are_received);
+  g_test_add_func("/sdi-snapd-monitor/cursor-is-stored",
+                  test_notices_cursor_is_stored);
+  g_test_add_func("/sdi-snapd-monitor/filter", test_notices_filter);
+  g_test_add_func("/sdi-snapd-monitor/queue", test_notices_queue);
+  g_test_add_func("/sdi-snapd-monitor/reconnect", test_notices_reconnect);
+  g_test_add_func("/sdi-snapd-client-factory/pool", test_client_pool);
   return g_test_run();
 }
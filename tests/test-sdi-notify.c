@@ -425,6 +425,43 @@ void test_update_available_7() {
   g_assert_cmpstr(result, ==, expected);
 }
 
+void test_update_done_multiple() {
+  g_autofree gchar *icon_path = get_data_path("icon1.svg");
+  g_autofree gchar *desktop_file1 =
+      create_desktop_file("test11_1", "Test app 11_1", icon_path);
+  g_autofree gchar *desktop_file2 =
+      create_desktop_file("test11_2", "Test app 11_2", icon_path);
+  g_autoptr(GPtrArray) apps1 = add_app(NULL, "test_app11_1", desktop_file1);
+  g_autoptr(GPtrArray) apps2 = add_app(NULL, "test_app11_2", desktop_file2);
+  g_autoptr(SnapdSnap) snap1 = create_snap("test_snap11_1", apps1);
+  g_autoptr(SnapdSnap) snap2 = create_snap("test_snap11_2", apps2);
+  g_autoptr(GListStore) snaps = g_list_store_new(SNAPD_TYPE_SNAP);
+  g_list_store_append(snaps, snap1);
+  g_list_store_append(snaps, snap2);
+  sdi_notify_refresh_complete_multiple(notifier, G_LIST_MODEL(snaps));
+
+  MockNotificationsData *data =
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+
+  g_assert_cmpstr(data->title, ==, "2 apps were updated");
+  g_assert_cmpstr(data->body, ==, "You can reopen them now.");
+  g_assert_cmpint(g_strv_length(data->actions), ==, 6);
+  g_assert_true(has_action(data->actions, "default", NULL));
+  g_assert_true(has_action(data->actions, "launch-0", "Test app 11_1"));
+  g_assert_true(has_action(data->actions, "launch-1", "Test app 11_2"));
+
+  mock_fdo_notifications_send_action(mock_notifications, data->uid,
+                                     "launch-1");
+
+  g_autofree gchar *result = wait_for_notification_close();
+  unlink(desktop_file1); // delete desktop files
+  unlink(desktop_file2);
+  g_autofree gchar *expected =
+      g_strdup_printf("app-launch-updated %s", desktop_file2);
+  g_assert_cmpstr(result, ==, expected);
+}
+
 void test_update_available_8() {
   g_autofree gchar *icon_path = get_data_path("icon1.svg");
   g_autofree gchar *desktop_file1 =
@@ -523,6 +560,74 @@ void test_update_available_10() {
   g_assert_cmpint(signal_counter, ==, 1);
 }
 
+void test_update_available_reminder() {
+  g_autofree gchar *icon_path = get_data_path("icon1.svg");
+  g_autofree gchar *desktop_file =
+      create_desktop_file("test12", "Test app 12", icon_path);
+
+  g_autoptr(GPtrArray) apps = add_app(NULL, "test_app12", desktop_file);
+  g_autoptr(SnapdSnap) snap = create_snap("test_snap12", apps);
+  g_autoptr(GListStore) snaps = g_list_store_new(SNAPD_TYPE_SNAP);
+  g_list_store_append(snaps, snap);
+  sdi_notify_pending_refresh(notifier, G_LIST_MODEL(snaps));
+
+  MockNotificationsData *data =
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpint(data->replaces_id, ==, 0);
+  guint32 uid = data->uid;
+
+  // a second reminder must replace the first notification, not add another
+  sdi_notify_pending_refresh(notifier, G_LIST_MODEL(snaps));
+  data = mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpint(data->replaces_id, ==, uid);
+  g_assert_cmpint(data->uid, ==, uid);
+  g_assert_cmpstr(data->title, ==, "Update available for Test app 12");
+  g_assert_cmpint(g_strv_length(data->actions), ==, 6);
+
+  mock_fdo_notifications_send_action(mock_notifications, uid, "default");
+
+  g_autofree gchar *result = wait_for_notification_close();
+  unlink(desktop_file); // delete desktop file
+  g_assert_cmpstr(result, ==, "show-updates");
+}
+
+void test_update_forced_complete() {
+  g_autofree gchar *icon_path = get_data_path("icon1.svg");
+  g_autofree gchar *desktop_file1 =
+      create_desktop_file("test13", "Test app 13", icon_path);
+  g_autoptr(GPtrArray) apps1 = add_app(NULL, "test_app13", desktop_file1);
+  g_autoptr(SnapdSnap) snap1 = create_snap("test_snap13", apps1);
+  sdi_notify_pending_refresh_forced(notifier, snap1, SECONDS_IN_AN_HOUR * 5,
+                                    TRUE);
+
+  MockNotificationsData *data =
+      mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(data->title, ==,
+                  "Test app 13 will quit and update in 5 hours");
+  guint32 uid = data->uid;
+
+  // once the refresh has finished, the warning is no longer true
+  sdi_notify_refresh_complete(notifier, snap1, "test_snap13");
+  g_assert_cmpint(
+      mock_fdo_notifications_wait_for_close(mock_notifications, 1000), ==, uid);
+
+  data = mock_fdo_notifications_wait_for_notification(mock_notifications, 1000);
+  g_assert_nonnull(data);
+  g_assert_cmpstr(data->title, ==, "Test app 13 was updated");
+  g_assert_cmpint(data->replaces_id, ==, 0);
+
+  mock_fdo_notifications_send_action(mock_notifications, data->uid, "default");
+
+  g_autofree gchar *result = wait_for_notification_close();
+  unlink(desktop_file1); // delete desktop file
+  g_autofree gchar *expected =
+      g_strdup_printf("app-launch-updated %s", desktop_file1);
+  g_assert_cmpstr(result, ==, expected);
+}
+
 /**
  * Notify emulator callbacks
  */
@@ -548,10 +653,13 @@ static void do_activate(GObject *object, gpointer data) {
   g_test_add_func("/update_available/test4", test_update_available_4);
   g_test_add_func("/update_available/test5", test_update_available_5);
   g_test_add_func("/update_available/test6", test_update_available_6);
+  g_test_add_func("/update_available/reminder", test_update_available_reminder);
   g_test_add_func("/update_done/test7", test_update_available_7);
+  g_test_add_func("/update_done/multiple", test_update_done_multiple);
   g_test_add_func("/update_forced/test8", test_update_available_8);
   g_test_add_func("/update_forced/test9", test_update_available_9);
   g_test_add_func("/update_forced/test10", test_update_available_10);
+  g_test_add_func("/update_forced/complete", test_update_forced_complete);
 
   g_test_run();
   g_application_release(G_APPLICATION(object));
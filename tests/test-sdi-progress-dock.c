@@ -31,8 +31,9 @@ static void timeoutCB(guint *timeout_id) {
 
 static void wait_for_events(guint timeout, guint changes) {
   GMainContext *context = g_main_context_default();
-  guint timeout_id =
-      g_timeout_add_once(timeout, (GSourceOnceFunc)timeoutCB, NULL);
+  guint timeout_id = 0;
+  timeout_id =
+      g_timeout_add_once(timeout, (GSourceOnceFunc)timeoutCB, &timeout_id);
   do {
     g_main_context_iteration(context, TRUE);
   } while (timeout_id != 0 && (current_changes & changes) != changes);
@@ -57,24 +58,49 @@ static void test_progress_bar(void) {
 
   set_progress_bar("program1.desktop", 3, 10, FALSE);
   wait_for_events(4000, CHANGES_PROGRESS);
+  // the progress bar is already visible, so only the progress must be sent
+  g_assert_cmpint(current_changes, ==, CHANGES_PROGRESS);
   g_assert_true(updating_value);
   g_assert_true(progress_visible_value);
   g_assert_cmpfloat_with_epsilon(progress_value, 3 / 10.0, DBL_EPSILON);
 
   set_progress_bar("program1.desktop", 10, 10, FALSE);
   wait_for_events(4000, CHANGES_PROGRESS);
+  g_assert_cmpint(current_changes, ==, CHANGES_PROGRESS);
   g_assert_true(updating_value);
   g_assert_true(progress_visible_value);
   g_assert_cmpfloat_with_epsilon(progress_value, 10 / 10.0, DBL_EPSILON);
 }
 
+static void test_unchanged_progress(void) {
+  expected_program = "program2.desktop";
+
+  set_progress_bar("program2.desktop", 4, 10, FALSE);
+  wait_for_events(4000, CHANGES_PROGRESS | CHANGES_PROGRESS_VISIBLE |
+                            CHANGES_UPDATING);
+  g_assert_cmpfloat_with_epsilon(progress_value, 4 / 10.0, DBL_EPSILON);
+
+  // the dock already has this state, so nothing must be sent
+  set_progress_bar("program2.desktop", 4, 10, FALSE);
+  wait_for_events(1000, CHANGES_PROGRESS);
+  g_assert_cmpint(current_changes, ==, 0);
+
+  // hide it, to leave the dock as it was
+  set_progress_bar("program2.desktop", 10, 10, TRUE);
+  wait_for_events(4000, CHANGES_PROGRESS_VISIBLE | CHANGES_UPDATING);
+  g_assert_false(progress_visible_value);
+}
+
 static void test_updating(void) {
+  expected_program = "program3.desktop";
+
+  set_progress_bar("program3.desktop", 5, 10, FALSE);
+  wait_for_events(4000, CHANGES_PROGRESS | CHANGES_PROGRESS_VISIBLE |
+                            CHANGES_UPDATING);
   g_assert_true(updating_value);
   g_assert_true(progress_visible_value);
 
-  expected_program = "program1.desktop";
-
-  set_progress_bar("program1.desktop", 0, 10, TRUE);
+  set_progress_bar("program3.desktop", 0, 10, TRUE);
   wait_for_events(4000, CHANGES_PROGRESS_VISIBLE | CHANGES_UPDATING);
   g_assert_false(updating_value);
   g_assert_false(progress_visible_value);
@@ -116,10 +142,10 @@ static void dockCB(GDBusConnection *connection, const gchar *sender_name,
     if (!g_strcmp0(key, "progress")) {
       progress_value = g_variant_get_double(value_v);
       current_changes |= CHANGES_PROGRESS;
-    } else if (g_strcmp0(key, "progress-visible")) {
+    } else if (!g_strcmp0(key, "progress-visible")) {
       progress_visible_value = g_variant_get_boolean(value_v);
       current_changes |= CHANGES_PROGRESS_VISIBLE;
-    } else if (g_strcmp0(key, "updating")) {
+    } else if (!g_strcmp0(key, "updating")) {
       updating_value = g_variant_get_boolean(value_v);
       current_changes |= CHANGES_UPDATING;
     }
@@ -137,6 +163,7 @@ static void do_startup(GApplication *application, gpointer data) {
 
 static void do_activate(GApplication *app, gpointer data) {
   g_test_add_func("/dock/progress-bar", test_progress_bar);
+  g_test_add_func("/dock/unchanged-progress", test_unchanged_progress);
   g_test_add_func("/dock/updating", test_updating);
   g_test_run();
 }
@@ -13,15 +13,6 @@ gchar *app_list[] = {"kicad-no-icon_kicad-no-icon.desktop",
  * Several help functions
  */
 
-static void set_progress_bar(gchar *snap_name, guint done_tasks,
-                             guint total_tasks) {
-  g_autofree gchar *description =
-      g_strdup_printf("Description for task %d", done_tasks);
-  sdi_progress_window_update_progress(progress_window, snap_name, NULL,
-                                      description, done_tasks, total_tasks,
-                                      FALSE);
-}
-
 static void expire_timeout(gpointer data) { timeout_expired = TRUE; }
 
 static void wait_for_timeout(guint seconds) {
@@ -37,6 +28,19 @@ static void wait_for_timeout(guint seconds) {
   } while (!timeout_expired);
 }
 
+/* The progress bars are updated at most once per frame, so wait a little
+ * after each update to ensure that it has been applied.
+ */
+static void set_progress_bar(gchar *snap_name, guint done_tasks,
+                             guint total_tasks) {
+  g_autofree gchar *description =
+      g_strdup_printf("Description for task %d", done_tasks);
+  sdi_progress_window_update_progress(progress_window, snap_name, NULL,
+                                      description, done_tasks, total_tasks,
+                                      FALSE);
+  wait_for_timeout(0);
+}
+
 static void show_progress_window(gchar *snap_name, gchar *desktop_file) {
   g_autoptr(GDesktopAppInfo) app_info = g_desktop_app_info_new(desktop_file);
   g_assert_nonnull(app_info);